@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ARRAY_IO_H_
+#define _ARRAY_IO_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+bool write_npy(const std::string &filename, const float *dat, const std::vector<int64_t> &shape);
+bool write_npy(const std::string &filename, const int32_t *dat, const std::vector<int64_t> &shape);
+bool write_npy(const std::string &filename, const uint32_t *dat, const std::vector<int64_t> &shape);
+bool write_npy(const std::string &filename, const uint64_t *dat, const std::vector<int64_t> &shape);
+bool write_npy(const std::string &filename, const uint8_t *dat, const std::vector<int64_t> &shape);
+
+bool write_csv(const std::string &filename, const float *dat, int64_t rows, int64_t cols);
+bool write_csv(const std::string &filename, const int32_t *dat, int64_t rows, int64_t cols);
+bool write_csv(const std::string &filename, const uint32_t *dat, int64_t rows, int64_t cols);
+bool write_csv(const std::string &filename, const uint64_t *dat, int64_t rows, int64_t cols);
+
+bool write_png(const std::string &filename, const uint32_t *argb, int w, int h);
+
+#endif
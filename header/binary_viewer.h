@@ -20,8 +20,13 @@
 #ifndef _BINARY_VIEWER_
 #define _BINARY_VIEWER_
 
+#include <vector>
+
 #include <QWidget>
 
+#include "glyph_atlas.h"
+#include "search.h"
+
 class CHexLogic;
 class QScrollBar;
 
@@ -35,7 +40,9 @@ public:
 
 public slots:
     void setData(const quint8 *dat, qsizetype n);
-    void setStart(int);
+    void setStart(qsizetype row);
+    void setHits(const CSearchHits *hits);
+    void hitsChanged();
 
 protected slots:
 
@@ -44,13 +51,31 @@ protected:
     void resizeEvent(QResizeEvent *) override;
 
     int columnStart(int c, int fw) const;
+    void renderRows(QPainter &p, int first, int last);
+    void invalidateRows();
 
     const quint8 *m_Data;
     qsizetype m_Size;
     qsizetype m_Offset;
     QFont m_Font;
+
+    // Hits of the last search, and those overlapping the rows being rendered.
+    const CSearchHits *m_Hits;
+    std::vector<SearchHit_t> m_VisibleHits;
+
+    CGlyphAtlas m_Atlas;
+    std::vector<QPainter::PixmapFragment> m_Fragments;
+
+    // The visible rows as last rendered, starting at row m_RowsStart, shifted on scrolling so only the
+    // rows newly exposed are rendered.
+    QPixmap m_Rows;
+    qsizetype m_RowsStart;
+    bool m_RowsValid;
 };
 
+/// CHexView shows the rows of CHexLogic with a scroll bar. The first row shown is kept as a 64 bit row
+/// number, the scroll bar only mapping onto it coarsely where the file has more rows than its int range
+/// counts, while the wheel and the keys move by exact rows.
 class CHexView : public QWidget {
 Q_OBJECT
 public:
@@ -59,21 +84,45 @@ public:
 
 public slots:
     void setData(const quint8 *dat, qsizetype n);
-    void setStart(int);
+    void setStart(qsizetype row);
+    void jumpTo(qsizetype offset);
+    void askJump();
+    void setHits(const CSearchHits *hits);
+    void hitsChanged();
 
 protected slots:
+    void scrolled(int);
 
 protected:
     void paintEvent(QPaintEvent *) override;
     void resizeEvent(QResizeEvent *) override;
     void enterEvent(QEvent *) override;
     void wheelEvent(QWheelEvent *) override;
+    void keyPressEvent(QKeyEvent *) override;
+    void updateScrollRange();
+    void updateScrollBar();
+    int visibleRows() const;
+    qsizetype lastRow() const;
+    void moveTo(qsizetype row);
 
     CHexLogic *m_HexLogic;
     QScrollBar *m_ScrollBar;
 
     const quint8 *m_Data;
     qsizetype m_Size;
+
+    // First row shown.
+    qsizetype m_Row;
+
+    // Rows moved by each step of m_ScrollBar, whose int range cannot count the rows of files beyond 32 GB.
+    qsizetype m_RowsPerStep;
+
+    // Wheel rotation, in eighths of a degree, not yet enough for a step.
+    int m_WheelDelta;
+
+signals:
+    // Emitted when the user moves the view, with the offset of the first row shown.
+    void startChanged(qsizetype);
 };
 
 #endif
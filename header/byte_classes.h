@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BYTE_CLASSES_H_
+#define _BYTE_CLASSES_H_
+
+#include <string>
+#include <stdint.h>
+
+/// CByteClasses assigns byte values to a few classes, each drawn in its own color. Class 0 holds the
+/// bytes not assigned to any other and is drawn black. A scheme is written as classes separated by
+/// ';', each a list of byte values or ranges in hex followed by '=' and an RRGGBB color, such as
+/// "01-1f=0000f0;20-7f=00f000;80-fe=f00000;ff=ffffff", the default.
+class CByteClasses {
+public:
+    static const int s_MaxClasses = 8;
+    static const char *const s_DefaultScheme;
+
+    CByteClasses();
+
+    bool parse(const std::string &scheme);
+    std::string toString() const;
+
+    int classCount() const { return m_Count; }
+    /// byteClass returns the class of byte c, in [0, classCount()].
+    int byteClass(uint8_t c) const { return m_Class[c]; }
+    /// classColor returns the color of class k as 0xRRGGBB.
+    uint32_t classColor(int k) const { return m_Color[k]; }
+    /// byteColor returns the color of the class of byte c as 0xRRGGBB.
+    uint32_t byteColor(uint8_t c) const { return m_Color[m_Class[c]]; }
+
+    const uint8_t *classTable() const { return m_Class; }
+
+    void count(const uint8_t *dat, int64_t n, uint64_t class_counts[]) const;
+
+protected:
+    int m_Count;
+    uint8_t m_Class[256];
+    uint32_t m_Color[s_MaxClasses + 1];
+    // Per byte value, a 1 in the 8-bit lane of its class, see count().
+    uint64_t m_Lanes[256];
+};
+
+const CByteClasses &byte_classes_scheme();
+void set_byte_classes_scheme(const CByteClasses &scheme);
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BYTE_COUNT_H_
+#define _BYTE_COUNT_H_
+
+#include <stdint.h>
+
+void count_bytes(const uint8_t *dat_u8, int64_t n, uint64_t counts[256]);
+uint64_t sum_bytes(const uint8_t *dat_u8, int64_t n);
+const char *count_bytes_kernel_name();
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BYTE_INDEX_H_
+#define _BYTE_INDEX_H_
+
+#include <vector>
+#include <stdint.h>
+
+/// CByteIndex holds byte value counts at fixed block boundaries of a buffer, so that the byte histogram
+/// of any range is a few table lookups plus the partial blocks at either end. The counts are kept on two
+/// levels, 64-bit totals at the start of every group of blocks and 32-bit counts relative to those for
+/// the blocks in between. The block size is bounded, so the partial blocks stay cheap to count whatever
+/// the size of the buffer, and it is the index that grows with it instead.
+class CByteIndex {
+public:
+    CByteIndex();
+
+    void build(const uint8_t *dat, int64_t n, int64_t block_size = 0);
+    void begin(const uint8_t *dat, int64_t n, int64_t block_size = 0);
+    int64_t extend(int64_t end);
+    void clear();
+
+    bool empty() const;
+    int64_t size() const;
+    int64_t blockSize() const;
+    int64_t memoryUsage() const;
+    static int64_t expectedMemoryUsage(int64_t n);
+
+    void counts(int64_t start, int64_t end, uint64_t counts[256]) const;
+
+protected:
+    void prefix(int64_t block, uint64_t counts[256]) const;
+
+    const uint8_t *m_Data;
+    int64_t m_Size;
+    int64_t m_BlockSize;
+    int64_t m_BlockCount;
+    int64_t m_BlocksBuilt;
+
+    // (m_BlockCount / s_GroupBlocks + 1) rows of 256 counts, row g covering the bytes
+    // [0, g * s_GroupBlocks * m_BlockSize)
+    std::vector<uint64_t> m_Groups;
+
+    // (m_BlockCount + 1) rows of 256 counts, row b covering the bytes from the start of the group of
+    // block b up to b * m_BlockSize
+    std::vector<uint32_t> m_Blocks;
+};
+
+#endif
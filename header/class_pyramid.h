@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CLASS_PYRAMID_H_
+#define _CLASS_PYRAMID_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "byte_classes.h"
+
+/// CClassPyramid holds the byte class counts and the byte sums of fixed-size blocks of a buffer at
+/// successive 2x reductions. The counts of any range are then read from a few entries of the coarsest
+/// levels that fit within it, plus the partial blocks at either end counted from the bytes, so the
+/// cost of an overview is proportional to its pixels rather than to the bytes it summarizes.
+class CClassPyramid {
+public:
+    CClassPyramid();
+
+    void build(const uint8_t *dat, int64_t n, const CByteClasses &classes);
+    void begin(const uint8_t *dat, int64_t n, const CByteClasses &classes);
+    int64_t extend(int64_t end);
+    void clear();
+
+    bool empty() const;
+    bool complete() const;
+    const uint8_t *data() const { return m_Data; }
+    int64_t size() const { return m_Size; }
+    int64_t blockSize() const;
+    int levels() const { return int(m_Levels.size()); }
+    const CByteClasses &classes() const { return m_Classes; }
+    int64_t memoryUsage() const;
+    static int64_t expectedMemoryUsage(int64_t n, const CByteClasses &classes);
+
+    void counts(int64_t start, int64_t end, uint64_t *class_counts, uint64_t *sum) const;
+
+protected:
+    // Entries of m_Stride values: the byte sum followed by the counts of classes 1..classCount().
+    struct Level_t {
+        std::vector<uint32_t> entries;
+        int64_t count = 0;
+        int64_t built = 0;
+    };
+
+    void addEntry(const Level_t &l, int64_t i, uint64_t acc[]) const;
+    void countPartial(int64_t b, int64_t start, int64_t end, bool want_classes, bool want_sum, uint64_t acc[]) const;
+    void countBytes(int64_t start, int64_t end, bool want_classes, bool want_sum, uint64_t acc[]) const;
+
+    const uint8_t *m_Data;
+    int64_t m_Size;
+    CByteClasses m_Classes;
+    int m_Stride;
+    std::vector<Level_t> m_Levels;
+};
+
+#endif
@@ -40,7 +40,6 @@ public slots:
 
 protected slots:
     void setImage(QImage &img);
-    void advanceMat(int bs, const std::vector<std::pair<int, int> > &rand);
     void regenImage();
 
 protected:
@@ -56,9 +55,6 @@ protected:
     int m_MaterialMaxSize;
     int m_MaterialSize;
 
-    int m_PointsIndex;
-    std::vector<std::pair<int, int> > m_Points;
-
     QImage m_Image;
     QPixmap m_Pixmap;
 };
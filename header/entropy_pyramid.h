@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ENTROPY_PYRAMID_H_
+#define _ENTROPY_PYRAMID_H_
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+/// CEntropyPyramid holds the block entropy of a buffer at successive 2x reductions, each level
+/// keeping the mean, minimum and maximum of the level below. Any range can then be resampled to
+/// a given number of points from the level closest to that resolution.
+class CEntropyPyramid {
+public:
+    CEntropyPyramid();
+
+    bool build(const uint8_t *dat, int64_t n, int64_t bs = 256, const std::atomic<bool> *cancel = nullptr);
+    void clear();
+
+    bool empty() const;
+    int64_t size() const;
+    int64_t blockSize() const;
+    int levels() const;
+    int64_t memoryUsage() const;
+    static int64_t expectedMemoryUsage(int64_t n, int64_t bs = 256);
+
+    void sample(int64_t start, int64_t end, int n_out, float *mean, float *mn = nullptr, float *mx = nullptr) const;
+
+protected:
+    // Entropies are stored as fractions of 65535, plenty for plotting and a quarter of the memory of floats.
+    struct Level_t {
+        std::vector<uint16_t> mean;
+        std::vector<uint16_t> min;
+        std::vector<uint16_t> max;
+    };
+
+    int64_t m_Size;
+    int64_t m_BlockSize;
+    std::vector<Level_t> m_Levels;
+};
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GLYPH_ATLAS_H_
+#define _GLYPH_ATLAS_H_
+
+#include <QFont>
+#include <QPainter>
+#include <QPixmap>
+
+/// CGlyphAtlas holds the cells the hex view is drawn from, rasterized once per font, scale and colors: the
+/// 256 hex pairs and 256 ASCII cells, each in its byte's color, and the upper case hex digits and 'x' of the
+/// offset labels. Rows are then composed by copying cells with QPainter::drawPixmapFragments, whose cost
+/// does not depend on font shaping.
+class CGlyphAtlas {
+public:
+    enum Set_t {
+        HEX,
+        ASCII,
+        LABEL
+    };
+
+    // Index of 'x' in the LABEL set, after the 16 digits.
+    static const int s_LabelX = 16;
+
+    CGlyphAtlas();
+
+    bool update(const QFont &font, qreal dpr, QRgb label_color, const QRgb hex_colors[256], const QRgb ascii_colors[256]);
+
+    const QPixmap &pixmap() const { return m_Pixmap; }
+    int ascent() const { return m_Ascent; }
+    int labelAdvance() const { return m_LabelAdvance; }
+
+    QPainter::PixmapFragment fragment(Set_t set, int c, qreal x, qreal baseline) const;
+
+protected:
+    int cellWidth(Set_t set) const;
+    QPoint cellOrigin(Set_t set, int c) const;
+
+    QPixmap m_Pixmap;
+
+    QFont m_Font;
+    qreal m_Dpr;
+    QRgb m_LabelColor;
+    QRgb m_HexColors[256];
+    QRgb m_AsciiColors[256];
+
+    int m_CharWidth;
+    int m_CellHeight;
+    int m_Ascent;
+    int m_LabelAdvance;
+};
+
+#endif
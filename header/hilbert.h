@@ -20,11 +20,20 @@
 #ifndef __HILBERT_H__
 #define __HILBERT_H__
 
+#include <memory>
 #include <vector>
+#include <stdint.h>
 
 typedef std::pair<int, int> pt_t;
 typedef std::vector<pt_t> curve_t;
 
+// The pixel index, y * width + x, of each point along a curve.
+typedef std::vector<uint32_t> curve_lut_t;
+
 void gilbert2d(int width, int height, curve_t &curve);
+void gilbert2d_fill(int width, int height, int64_t d0, int64_t d1, uint32_t *lut);
+pt_t gilbert2d_d2xy(int64_t d, int width, int height);
+int64_t gilbert2d_xy2d(int x, int y, int width, int height);
+std::shared_ptr<const curve_lut_t> gilbert2d_lut(int width, int height);
 
 #endif
\ No newline at end of file
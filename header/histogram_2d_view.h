@@ -20,43 +20,72 @@
 #ifndef _HISTOGRAM_2D_VIEW_
 #define _HISTOGRAM_2D_VIEW_
 
+#include <atomic>
+#include <memory>
+
 #include <QLabel>
 #include <QImage>
 #include <QPixmap>
+#include <QFutureWatcher>
+
+#include "histogram_calc.h"
 
 class QSpinBox;
 class QComboBox;
 
+/// Histo2DJob_t is the result of a background computation of the histogram, generation telling which request it serves.
+struct Histo2DJob_t {
+    int generation = 0;
+    // 256 * 256 counts, null if cancelled.
+    std::shared_ptr<int> histogram;
+};
+
 class CHistogram2D : public QLabel {
 Q_OBJECT
 public:
     explicit CHistogram2D(QWidget *p = nullptr);
     ~CHistogram2D() override;
 
+    HistoDtype_t dtype() const;
+    std::shared_ptr<int> histogram() const { return m_Histogram; }
+    void setHistogram(const quint8 *dat, qsizetype n, const std::shared_ptr<int> &histogram);
+
 public slots:
     void setData(const quint8 *dat, qsizetype n);
     void parametersChanged();
+    void cancel();
+    void stop();
 
 protected slots:
     void setImage(QImage &img);
     void regenHisto();
+    void histoReady();
 
 protected:
     void paintEvent(QPaintEvent *) override;
     void resizeEvent(QResizeEvent *e) override;
     void updatePixmap();
+    void startJob();
 
     QSpinBox *m_Threshold, *m_Scale;
     QComboBox *m_Type;
-    int *m_Histogram;
+    std::shared_ptr<int> m_Histogram;
     const quint8 *m_Data;
     qsizetype m_Size;
 
+    // The histogram is computed in the background, one request at a time. A request made meanwhile
+    // cancels the running one and starts once it returns, results of superseded generations are dropped.
+    QFutureWatcher<Histo2DJob_t> *m_Watcher;
+    std::atomic<bool> m_Cancel;
+    int m_Generation;
+    bool m_Pending;
+
     QImage m_Image;
     QPixmap m_Pixmap;
 
 signals:
     void rangeSelected(float, float);
+    void histogramReady(const quint8 *dat, qsizetype n);
 };
 
 #endif
@@ -20,7 +20,13 @@
 #ifndef _HISTOGRAM_3D_VIEW_
 #define _HISTOGRAM_3D_VIEW_
 
+#include <atomic>
+#include <memory>
+
 #include <QGLWidget>
+#include <QFutureWatcher>
+
+#include "histogram_calc.h"
 
 enum TransformFlags
 {
@@ -38,15 +44,29 @@ class QSpinBox;
 class QComboBox;
 class QCheckBox;
 
+/// Histo3DJob_t is the result of a background computation of the histogram, generation telling which request it serves.
+struct Histo3DJob_t {
+    int generation = 0;
+    // Null if cancelled.
+    std::shared_ptr<SparseHisto3D_t> histogram;
+};
+
 class CHistogram3D : public QGLWidget {
 Q_OBJECT
 public:
     explicit CHistogram3D(QWidget *p = nullptr);
     ~CHistogram3D() override;
 
+    HistoDtype_t dtype() const;
+    bool overlap() const;
+    std::shared_ptr<const SparseHisto3D_t> histogram() const { return m_Histogram; }
+    void setHistogram(const quint8 *dat, qsizetype n, const std::shared_ptr<const SparseHisto3D_t> &histogram);
+
 public slots:
     void setData(const quint8 *dat, qsizetype n);
     void parametersChanged();
+    void cancel();
+    void stop();
 
     void setPositionScale(float f);
     void setTransformFlags(int flags);
@@ -54,6 +74,7 @@ public slots:
 
 protected slots:
     void regenHisto();
+    void histoReady();
     void colorHisto();
     void transformHisto();
     void initializeGL() override;
@@ -65,6 +86,7 @@ protected:
     void mouseMoveEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
     void wheelEvent(QWheelEvent* event) override;
+    void startJob();
 
     QSpinBox *m_Threshold, *m_Scale;
     QComboBox *m_Type;
@@ -75,11 +97,18 @@ protected:
     GLfloat* m_Vertices;
     GLfloat* m_Colors;
 
-    int *m_Histogram;
+    std::shared_ptr<const SparseHisto3D_t> m_Histogram;
     const quint8 *m_Data;
     qsizetype m_Size;
     int m_Flags;
 
+    // The histogram is computed in the background, one request at a time. A request made meanwhile
+    // cancels the running one and starts once it returns, results of superseded generations are dropped.
+    QFutureWatcher<Histo3DJob_t> *m_Watcher;
+    std::atomic<bool> m_Cancel;
+    int m_Generation;
+    bool m_Pending;
+
     int m_VertexCount;
 
     int m_MouseX;
@@ -90,6 +119,9 @@ protected:
     float m_ScaleX;
     float m_ScaleY;
     float m_ScaleZ;
+
+signals:
+    void histogramReady(const quint8 *dat, qsizetype n);
 };
 
 #endif
@@ -20,7 +20,10 @@
 #ifndef _HISTOGRAM_CALC_H_
 #define _HISTOGRAM_CALC_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 enum class HistoDtype_t {
@@ -31,14 +34,142 @@ enum class HistoDtype_t {
     U32,
     U64,
     F32,
-    F64
+    F64,
+    F32_BITS,
+    F64_BITS
 };
 
+// A single non-empty bin of a 3d histogram, index being a1 * 256 * 256 + a2 * 256 + a3. Counts are
+// 64-bit as a single trigram may occur more than 2^32 times in a large file.
+struct Trigram_t {
+    uint32_t index;
+    uint64_t count;
+};
+
+typedef std::vector<Trigram_t> SparseHisto3D_t;
+
 HistoDtype_t string_to_histo_dtype(const std::string &s);
+int histo_dtype_size(HistoDtype_t dtype);
+
+int *generate_histo_2d(const uint8_t *dat_u8, int64_t n, HistoDtype_t dtype, const std::atomic<bool> *cancel = nullptr);
+bool generate_histo_3d(const uint8_t *dat_u8, int64_t n, HistoDtype_t dtype, SparseHisto3D_t &hist, bool overlap = true,
+                       const std::atomic<bool> *cancel = nullptr);
+int64_t histo_3d_memory_usage(int64_t n, HistoDtype_t dtype, bool overlap = true, int64_t *pages = nullptr);
+float *generate_histo(const uint8_t *dat_u8, int64_t n, HistoDtype_t dtype = HistoDtype_t::U8);
+float *generate_histo(const uint64_t counts[256]);
+double histo_entropy(const uint64_t counts[256]);
+float *generate_entropy(const uint8_t*dat_u8, int64_t n, int64_t&rv_len, int64_t bs = 256, int64_t step = 0,
+                        const std::atomic<bool> *cancel = nullptr);
+
+template<class C>
+class CTrigramPages;
+
+/// CStreamAccum is the common part of the streaming accumulators below, which analyze data fed in
+/// consecutive chunks so that the whole input never has to be resident.
+///
+/// Every item (an n-gram or an entropy window) covers window bytes and starts on a multiple of align
+/// counted from offset 0 of the stream. An item is counted once its last byte has been fed. The
+/// last window - 1 bytes are kept so that items straddling two chunks can be completed by the next
+/// one, and the first window - 1 bytes are kept so that an accumulator fed from a later origin can
+/// be merged after the one covering the bytes immediately before it.
+class CStreamAccum {
+public:
+    virtual ~CStreamAccum() = default;
+
+    void feed(const uint8_t *dat_u8, int64_t n);
+
+    /// origin is the stream offset of the first byte fed to this accumulator.
+    int64_t origin() const { return m_Origin; }
+    /// end is the stream offset following the last byte fed to this accumulator.
+    int64_t end() const { return m_End; }
+
+protected:
+    CStreamAccum(int64_t window, int64_t align, int64_t origin);
+
+    bool mergeStream(const CStreamAccum &other);
+
+    /// countStarts counts count items, the first starting at p and the following ones align bytes apart.
+    virtual void countStarts(const uint8_t *p, int64_t count) = 0;
+
+    int64_t m_Window;
+    int64_t m_Align;
+    int64_t m_Origin;
+    int64_t m_End;
+    std::vector<uint8_t> m_Head;
+    std::vector<uint8_t> m_Tail;
+
+private:
+    void stitch(const uint8_t *head, int64_t head_len);
+    void countSpan(const uint8_t *p, int64_t p_off, int64_t s_lo, int64_t s_hi);
+};
+
+/// CHistoAccum accumulates the histogram computed by generate_histo.
+class CHistoAccum : public CStreamAccum {
+public:
+    explicit CHistoAccum(HistoDtype_t dtype = HistoDtype_t::U8, int64_t origin = 0);
+
+    bool merge(const CHistoAccum &other);
+    float *finish() const;
+
+    const uint64_t *counts() const { return m_Counts; }
+
+protected:
+    void countStarts(const uint8_t *p, int64_t count) override;
 
-int *generate_histo_2d(const uint8_t *dat_u8, int64_t n, HistoDtype_t dtype);
-int *generate_histo_3d(const uint8_t*dat_u8, int64_t n, HistoDtype_t dtype, bool overlap = true);
-float *generate_histo(const uint8_t*dat_u8, int64_t n);
-float *generate_entropy(const uint8_t*dat_u8, int64_t n, int64_t&rv_len, int64_t bs = 256);
+    HistoDtype_t m_Dtype;
+    uint64_t m_Counts[256];
+};
+
+/// CHisto2DAccum accumulates the 2d histogram computed by generate_histo_2d.
+class CHisto2DAccum : public CStreamAccum {
+public:
+    explicit CHisto2DAccum(HistoDtype_t dtype, int64_t origin = 0);
+
+    bool merge(const CHisto2DAccum &other);
+    int *finish() const;
+
+    const uint64_t *counts() const { return m_Counts.data(); }
+
+protected:
+    void countStarts(const uint8_t *p, int64_t count) override;
+
+    HistoDtype_t m_Dtype;
+    std::vector<uint64_t> m_Counts;
+};
+
+/// CHisto3DAccum accumulates the sparse 3d histogram computed by generate_histo_3d.
+class CHisto3DAccum : public CStreamAccum {
+public:
+    explicit CHisto3DAccum(HistoDtype_t dtype, bool overlap = true, int64_t origin = 0);
+    ~CHisto3DAccum() override;
+
+    CHisto3DAccum(const CHisto3DAccum &) = delete;
+    CHisto3DAccum &operator=(const CHisto3DAccum &) = delete;
+
+    bool merge(const CHisto3DAccum &other);
+    void finish(SparseHisto3D_t &hist) const;
+
+protected:
+    void countStarts(const uint8_t *p, int64_t count) override;
+
+    HistoDtype_t m_Dtype;
+    bool m_Overlap;
+    std::unique_ptr<CTrigramPages<uint64_t> > m_Pages;
+};
+
+/// CEntropyAccum accumulates the windowed entropy computed by generate_entropy.
+class CEntropyAccum : public CStreamAccum {
+public:
+    explicit CEntropyAccum(int64_t bs = 256, int64_t step = 0, int64_t origin = 0);
+
+    bool merge(const CEntropyAccum &other);
+    float *finish(int64_t &rv_len) const;
+
+protected:
+    void countStarts(const uint8_t *p, int64_t count) override;
+
+    std::vector<double> m_NLogN;
+    std::vector<float> m_Entropy;
+};
 
 #endif
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LOADED_FILE_H_
+#define _LOADED_FILE_H_
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "byte_index.h"
+#include "class_pyramid.h"
+#include "entropy_pyramid.h"
+#include "histogram_calc.h"
+#include "mapped_file.h"
+#include "overview.h"
+
+/// LoadParams_t are the view settings the analyses of a file depend on. Overview 0 shows the whole
+/// file, overview 1 the selected range, which is the whole file as long as nothing was selected.
+struct LoadParams_t {
+    int overview_w[2] = {0, 0};
+    int overview_h[2] = {0, 0};
+    bool byte_classes[2] = {true, true};
+    bool hilbert[2] = {true, true};
+    int64_t entropy_window = 256;
+
+    bool operator==(const LoadParams_t &o) const;
+    bool operator!=(const LoadParams_t &o) const { return !(*this == o); }
+};
+
+/// HistoKey_t identifies the result of a histogram view by the range of the file it covers and the settings
+/// it was computed with. Overlap only applies to the 3D histogram. A view not shown has no valid key.
+struct HistoKey_t {
+    bool valid = false;
+    int64_t start = 0;
+    int64_t end = 0;
+    HistoDtype_t dtype = HistoDtype_t::NONE;
+    bool overlap = false;
+
+    bool operator==(const HistoKey_t &o) const;
+    bool operator!=(const HistoKey_t &o) const { return !(*this == o); }
+};
+
+/// CLoadedFile is an open file together with the analyses made by a pass over all of it: the byte
+/// index, the byte class pyramid, both overview images and a preview of the entropy plot, followed
+/// by the entropy pyramid.
+/// The pass runs on a worker and may be cancelled, a later call to analyze() resumes where it stopped.
+/// While it runs, the parts of the results covering the first loaded() bytes may be read concurrently.
+/// The last result of each histogram view is kept too, so that returning to the file shows it at once.
+class CLoadedFile {
+public:
+    CLoadedFile();
+
+    CLoadedFile(const CLoadedFile &) = delete;
+    CLoadedFile &operator=(const CLoadedFile &) = delete;
+
+    bool open(const std::string &filename);
+    void setup(const LoadParams_t &params);
+
+    bool analyze(const std::atomic<bool> *cancel = nullptr);
+    bool buildPyramid(const std::atomic<bool> *cancel = nullptr);
+    bool buildHistograms(const HistoKey_t &key2d, const HistoKey_t &key3d, const std::atomic<bool> *cancel = nullptr);
+
+    const std::string &filename() const { return m_Filename; }
+    const CMappedFile &file() const { return m_File; }
+    const uint8_t *data() const { return m_File.data(); }
+    int64_t size() const { return m_File.size(); }
+
+    const LoadParams_t &params() const { return m_Params; }
+    int64_t loaded() const { return m_Loaded.load(std::memory_order_acquire); }
+    bool analyzed() const { return loaded() == size(); }
+    bool pyramidReady() const { return m_PyramidReady.load(std::memory_order_acquire); }
+
+    const CByteIndex &byteIndex() const { return m_ByteIndex; }
+    /// classPyramid may be read once analyzed().
+    const CClassPyramid &classPyramid() const { return m_ClassPyramid; }
+    const COverviewImage &overview(int i) const { return m_Overview[i]; }
+    const std::vector<float> &entropyPreview() const { return m_EntropyPreview; }
+    int64_t entropyPreviewDone(int64_t bytes) const;
+    const CEntropyPyramid &entropyPyramid() const { return m_EntropyPyramid; }
+
+    std::shared_ptr<int> histo2D(const HistoKey_t &key) const;
+    std::shared_ptr<const SparseHisto3D_t> histo3D(const HistoKey_t &key) const;
+    void setHisto2D(const HistoKey_t &key, const std::shared_ptr<int> &histogram);
+    void setHisto3D(const HistoKey_t &key, const std::shared_ptr<const SparseHisto3D_t> &histogram);
+
+    int64_t memoryUsage() const;
+    int64_t expectedMemoryUsage(const LoadParams_t &params, const HistoKey_t &key2d, const HistoKey_t &key3d,
+                                int64_t *transient = nullptr) const;
+
+protected:
+    std::string m_Filename;
+    CMappedFile m_File;
+    LoadParams_t m_Params;
+
+    CByteIndex m_ByteIndex;
+    CClassPyramid m_ClassPyramid;
+    COverviewImage m_Overview[2];
+    std::vector<float> m_EntropyPreview;
+    CEntropyPyramid m_EntropyPyramid;
+
+    std::atomic<int64_t> m_Loaded;
+    std::atomic<bool> m_PyramidReady;
+
+    // The histograms are set by the views, or by a prefetch of the file, so they are guarded.
+    mutable std::mutex m_HistoMutex;
+    HistoKey_t m_Histo2DKey;
+    std::shared_ptr<int> m_Histo2D;
+    HistoKey_t m_Histo3DKey;
+    std::shared_ptr<const SparseHisto3D_t> m_Histo3D;
+};
+
+/// CFileCache keeps recently used files and their analyses, least recently used first to go once
+/// their total memory exceeds the budget. Files still referenced elsewhere are never evicted.
+class CFileCache {
+public:
+    CFileCache();
+
+    void setBudget(int64_t bytes);
+    int64_t budget() const { return m_Budget; }
+
+    std::shared_ptr<CLoadedFile> find(const std::string &filename);
+    void insert(const std::shared_ptr<CLoadedFile> &f);
+    void trim();
+    void clear();
+
+    int64_t memoryUsage() const;
+
+protected:
+    int64_t m_Budget;
+    // Most recently used first.
+    std::list<std::shared_ptr<CLoadedFile>> m_Files;
+};
+
+#endif
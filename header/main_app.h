@@ -22,7 +22,14 @@
 
 #define NAMEOF(s) #s
 
+#include <atomic>
+#include <memory>
+
 #include <QDialog>
+#include <QFutureWatcher>
+
+#include "loaded_file.h"
+#include "search.h"
 
 class COverallView;
 class CHistogram2D;
@@ -33,6 +40,19 @@ class CHistogram3D;
 class CPlotView;
 class QComboBox;
 class QLabel;
+class QLineEdit;
+class QProgressBar;
+class QPushButton;
+class QSpinBox;
+class QTimer;
+
+/// EntropyJob_t is the result of a background computation of the entropy plot, generation telling which request it serves.
+struct EntropyJob_t {
+    int generation = 0;
+    // len windows, null if cancelled.
+    std::shared_ptr<float> entropy;
+    int64_t len = 0;
+};
 
 class CMain : public QDialog {
 Q_OBJECT
@@ -42,6 +62,7 @@ public:
     bool loadFile(const QString &filename);
     bool loadFiles(const QStringList &filenames);
     static bool loadStyle(QString s);
+    static QString settingsFile();
 
 public slots:
     void reject() override;
@@ -54,7 +75,24 @@ private slots:
 protected slots:
     void quit();
     void rangeSelected(float, float);
+    void rangePreview();
+    void rangeSettled();
+    void hexStartChanged(qsizetype);
     void switchView(int);
+    void entropyParametersChanged();
+    void entropyPyramidReady();
+    void entropyReady();
+    void loadProgress();
+    void loadFinished();
+    void cancelLoad();
+    void prefetchFinished();
+    void histogram2DReady(const quint8 *dat, qsizetype n);
+    void histogram3DReady(const quint8 *dat, qsizetype n);
+    void startSearch();
+    void searchProgress();
+    void searchFinished();
+    void findNext();
+    void findPrevious();
 
     bool nextFile();
     bool prevFile();
@@ -70,9 +108,30 @@ protected:
     void keyPressEvent(QKeyEvent* event);
     void keyReleaseEvent(QKeyEvent* event);
 
-    void updateViews(bool update_iv1 = true, bool optimize = false);
+    void selectRange(qsizetype start, qsizetype end);
+    void updateViews(bool update_iv1 = true, bool optimize = false, bool update_iv2 = true);
+    void updateEntropy(bool approximate = false);
+    void startEntropyJob();
+    void cancelEntropy();
+    void updateCounts();
+    void updateSummary(const uint64_t counts[256]);
+    LoadParams_t loadParams() const;
+    HistoKey_t histoKey2D(int64_t start, int64_t end) const;
+    HistoKey_t histoKey3D(int64_t start, int64_t end) const;
+    void startLoading();
+    void showLoaded();
+    void unloadFile();
+    void startBackgroundJobs();
+    void stopBackgroundJobs();
+    void startPrefetch();
+    void stopPrefetch();
+    void stopSearch();
+    void clearSearch();
+    void showSearchHit(const SearchHit_t &hit);
 
     QComboBox *m_CurrentView;
+    QSpinBox *m_EntropyWindow;
+    QSpinBox *m_EntropyStep;
 
     COverallView *m_OverallPrimary;
     COverallView *m_OverallZoomed;
@@ -83,13 +142,66 @@ protected:
     CDotPlot *m_DotPlot;
     CHistogram3D *m_Histogram3D;
     QLabel *m_Filename;
+    QLabel *m_Summary;
+    QProgressBar *m_LoadProgress;
+    QPushButton *m_LoadCancel;
 
-    quint8* m_Data;
+    // The file shown, m_Data and m_Size being its contents. It stays in m_Cache once another is shown.
+    std::shared_ptr<CLoadedFile> m_Current;
+    const quint8 *m_Data;
     qsizetype m_Size;
 
     qsizetype m_Start;
     qsizetype m_End;
 
+    // While the selection is dragged, the moves are coalesced into previews from the cheap summaries at
+    // most every m_RangePreviewTimer interval, and the views are brought up to date once it settles.
+    QTimer *m_RangePreviewTimer;
+    QTimer *m_RangeSettleTimer;
+
+    CFileCache m_Cache;
+
+    // The entropy pyramid of m_Current is built by a background job once its first pass is done.
+    QFutureWatcher<bool> *m_EntropyPyramidWatcher;
+    std::atomic<bool> m_CancelBackground;
+
+    // Entropy plots the pyramid cannot give are computed in the background, one request at a time. A request
+    // made meanwhile cancels the running one and starts once it returns, results of superseded generations
+    // are dropped. Changes of the window and step are coalesced by m_EntropyParamsTimer.
+    QFutureWatcher<EntropyJob_t> *m_EntropyWatcher;
+    std::atomic<bool> m_CancelEntropy;
+    int m_EntropyGeneration;
+    bool m_EntropyPending;
+    QTimer *m_EntropyParamsTimer;
+
+    // The last search runs over m_Data in the background, the GUI thread polling the hits found so far from
+    // m_SearchTimer to show them in the hex view and the primary overview. Stepping through them starts
+    // after m_SearchCursor while the selection still starts at m_SearchCursorStart.
+    QComboBox *m_SearchMode;
+    QLineEdit *m_SearchText;
+    QLabel *m_SearchStatus;
+    QFutureWatcher<bool> *m_SearchWatcher;
+    QTimer *m_SearchTimer;
+    std::atomic<bool> m_CancelSearch;
+    std::atomic<int64_t> m_SearchDone;
+    CSearchHits m_SearchHits;
+    size_t m_SearchShown;
+    qsizetype m_SearchCursor;
+    qsizetype m_SearchCursorStart;
+
+    // The first pass over m_Current runs in the background, the GUI thread polling its progress from
+    // m_LoadTimer to show the parts completed so far.
+    bool m_Loading;
+    QFutureWatcher<bool> *m_LoadWatcher;
+    QTimer *m_LoadTimer;
+    std::atomic<bool> m_CancelLoad;
+
+    // Once m_Current is done, the files around it in m_FileList are analyzed in the background, one at a time.
+    QFutureWatcher<bool> *m_PrefetchWatcher;
+    std::atomic<bool> m_CancelPrefetch;
+    std::vector<std::shared_ptr<CLoadedFile>> m_Prefetching;
+    int m_PrefetchCount;
+
     int m_CurrentFile;
 
     bool m_Initialized;
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <string>
+#include <stdint.h>
+
+/// CMappedFile provides read-only access to the contents of a file, mapping it into memory where
+/// possible so that pages are only read as they are touched and are shared with the page cache.
+/// Regular files and block devices are mapped, others such as pipes and character devices are read onto
+/// the heap instead, as are regular files reporting a size of 0 such as those of /proc. As with any mapping, reading beyond the end of a file truncated by another process
+/// while mapped faults.
+class CMappedFile {
+public:
+    enum class Access_t {
+        NORMAL,
+        SEQUENTIAL,
+        WILL_NEED
+    };
+
+    CMappedFile();
+    ~CMappedFile();
+
+    CMappedFile(const CMappedFile &) = delete;
+    CMappedFile &operator=(const CMappedFile &) = delete;
+
+    bool open(const std::string &filename);
+    void close();
+
+    void advise(Access_t access, int64_t start = 0, int64_t len = -1) const;
+
+    const uint8_t *data() const { return m_Data; }
+    int64_t size() const { return m_Size; }
+    bool isOpen() const { return m_Data != nullptr; }
+    bool isMapped() const { return m_Mapped; }
+
+protected:
+    bool map(const std::string &filename);
+    bool read(const std::string &filename);
+
+    const uint8_t *m_Data;
+    int64_t m_Size;
+    bool m_Mapped;
+};
+
+#endif
@@ -20,10 +20,15 @@
 #ifndef _OVERALL_VIEW_H_
 #define _OVERALL_VIEW_H_
 
+#include <vector>
+
 #include <QLabel>
 #include <QImage>
 #include <QPixmap>
 
+class CClassPyramid;
+class COverviewImage;
+
 class COverallView : public QLabel {
 Q_OBJECT
 public:
@@ -35,11 +40,19 @@ public slots:
 
     void setImage(QImage &img);
     void setData(const quint8 *bin, qsizetype len, bool reset_selection = true, bool disableByteClasses = false);
+    void showOverview(const quint8 *bin, qsizetype len, const COverviewImage &img, qsizetype pixels);
+    void setPyramid(const CClassPyramid *pyramid);
 
     void enableSelection(bool);
+    void setSelection(float s, float e);
+    void setMarkers(const std::vector<float> &markers);
     void enableByteClasses(bool);
     void enableHilbertCurve(bool);
 
+public:
+    bool byteClassesEnabled() const { return m_UseByteClasses; }
+    bool hilbertCurveEnabled() const { return m_UseHilbertCurve; }
+
 protected slots:
 
 protected:
@@ -63,11 +76,22 @@ protected:
     const quint8 *m_Data;
     qsizetype m_Size;
 
+    // Summary of the whole file that m_Data lies within, if complete, otherwise null.
+    const CClassPyramid *m_Pyramid;
+
+    // Pixels of the image copied so far by showOverview().
+    qsizetype m_ShownPixels;
+
     QImage m_Image;
     QPixmap m_Pixmap;
 
+    // Positions marked along the edges, as fractions of the height.
+    std::vector<float> m_Markers;
+
 signals:
     void rangeSelected(float, float);
+    // Emitted once the selection stops moving, following its last rangeSelected().
+    void selectionFinished();
 };
 
 #endif
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _OVERVIEW_H_
+#define _OVERVIEW_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "byte_classes.h"
+#include "class_pyramid.h"
+#include "hilbert.h"
+
+/// COverviewImage draws bytes as an image of at most w x h pixels, each pixel summarizing an equal run
+/// of consecutive bytes, laid out row by row or along a Hilbert curve. The pixels can be rendered in
+/// any order and in pieces, for example as the bytes are read in.
+class COverviewImage {
+public:
+    COverviewImage();
+
+    void layout(int64_t len, int w, int h, bool byte_classes, bool hilbert);
+    void render(const uint8_t *dat, int64_t p0, int64_t p1);
+    void render(const CClassPyramid &pyramid, int64_t start, int64_t p0, int64_t p1);
+    void clear();
+
+    int width() const { return m_Width; }
+    int height() const { return m_Height; }
+
+    /// pixelCount is the number of pixels holding data, which may be less than width() * height().
+    int64_t pixelCount() const { return m_PixelCount; }
+    /// pixelBytes is the number of bytes summarized by every pixel but the last one.
+    int64_t pixelBytes() const { return m_PixelBytes; }
+    int64_t pixelsWithin(int64_t bytes) const;
+    int64_t pixelOffset(int64_t p) const;
+
+    /// pixels are the width() * height() pixels of the image, as 0xAARRGGBB.
+    const std::vector<uint32_t> &pixels() const { return m_Pixels; }
+
+    int64_t memoryUsage() const;
+    static int64_t expectedMemoryUsage(int64_t len, int w, int h, bool hilbert);
+
+protected:
+    void renderRange(const uint8_t *dat, int64_t p0, int64_t p1);
+    uint32_t pixelColor(const uint64_t class_counts[], uint64_t sum, int64_t j) const;
+
+    int64_t m_Size;
+    int m_Width;
+    int m_Height;
+    int64_t m_PixelBytes;
+    int64_t m_PixelCount;
+    bool m_ByteClasses;
+    bool m_Hilbert;
+    // Copied from byte_classes_scheme() by layout().
+    CByteClasses m_Classes;
+    // Shared with every other image of the same size.
+    std::shared_ptr<const curve_lut_t> m_Curve;
+    std::vector<uint32_t> m_Pixels;
+};
+
+void render_overview(const uint8_t *dat, int64_t len, int w, int h, bool byte_classes, bool hilbert,
+                     std::vector<uint32_t> &img, int &img_w, int &img_h);
+void render_overview(const CClassPyramid &pyramid, int64_t start, int64_t len, int w, int h, bool byte_classes,
+                     bool hilbert, std::vector<uint32_t> &img, int &img_w, int &img_h);
+
+#endif
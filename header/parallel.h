@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+/// parallel_worker_count returns the number of workers to use for n items.
+/// @param [in] n Number of items to be processed.
+/// @param [in] min_per_worker Minimum number of items worth handing to a single worker.
+/// @param [in] max_workers Upper bound on the number of workers, or 0 for no bound other than the core count.
+/// @return A worker count in [1, hardware_concurrency].
+inline int parallel_worker_count(int64_t n, int64_t min_per_worker, int max_workers = 0) {
+    int64_t hw = std::max(1u, std::thread::hardware_concurrency());
+    if (max_workers > 0) hw = std::min<int64_t>(hw, max_workers);
+    int64_t w = n / std::max<int64_t>(1, min_per_worker);
+    return int(std::max<int64_t>(1, std::min(hw, w)));
+}
+
+/// parallel_run calls fn(w) once for every worker w in [0, workers), worker 0 on the calling thread.
+template<class F>
+void parallel_run(int workers, F &&fn) {
+    std::vector<std::thread> threads;
+    threads.reserve(std::max(0, workers - 1));
+    for (int w = 1; w < workers; w++) {
+        threads.emplace_back(std::ref(fn), w);
+    }
+    fn(0);
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+/// parallel_for splits [0, n) into contiguous ranges and calls fn(begin, end) for each on its own worker.
+/// @param [in] n Number of items.
+/// @param [in] min_per_worker Minimum number of items worth handing to a single worker.
+/// @param [in] align Range boundaries are rounded to a multiple of align.
+template<class F>
+void parallel_for(int64_t n, int64_t min_per_worker, F &&fn, int64_t align = 1) {
+    if (n <= 0) return;
+
+    int workers = parallel_worker_count(n, min_per_worker);
+    int64_t chunk = (n + workers - 1) / workers;
+    chunk = (chunk + align - 1) / align * align;
+
+    parallel_run(workers, [&](int w) {
+        int64_t b = std::min(n, w * chunk);
+        int64_t e = std::min(n, b + chunk);
+        if (b < e) fn(b, e);
+    });
+}
+
+#endif
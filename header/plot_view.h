@@ -24,6 +24,8 @@
 #include <QImage>
 #include <QPixmap>
 
+#include "series_summary.h"
+
 class CPlotView : public QLabel {
 Q_OBJECT
 public:
@@ -34,6 +36,8 @@ public slots:
     void setImage(int ind, QImage &img);
     void setData(const float *bin, qsizetype len, bool normalize = true);
     void setData(int ind, const float *bin, qsizetype len, bool normalize = true);
+    void setEnvelope(int ind, const float *mean, const float *mn, const float *mx, qsizetype len,
+                     bool normalize = true);
     void enableSelection(bool);
 
 protected slots:
@@ -45,6 +49,7 @@ protected:
     void mouseMoveEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
     void update_pix();
+    void render(int ind);
 
     float m_UpperBandPos, m_LowerBandPos;
     int m_MousePosX, m_MousePosY;
@@ -57,6 +62,9 @@ protected:
     } m_SelectionType;
 
     QImage m_Images[2];
+    // Summaries of the series given to setData, rendered again at each size without rescanning the data.
+    CSeriesSummary m_Series[2];
+    bool m_Normalize[2];
     QPixmap m_Pixmap;
     bool m_AllowSelection;
 
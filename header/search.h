@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SEARCH_H_
+#define _SEARCH_H_
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/// SearchPattern_t is one pattern to search for. A byte pattern matches where every byte, masked by mask,
+/// equals bytes, a zero mask being a wildcard. A pattern with a regex matches that ECMAScript expression
+/// instead, over the bytes taken as characters.
+struct SearchPattern_t {
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> mask;
+    std::string regex;
+};
+
+bool parse_hex_pattern(const std::string &s, SearchPattern_t &pattern);
+SearchPattern_t ascii_pattern(const std::string &s);
+bool utf16_pattern(const std::string &utf8, SearchPattern_t &pattern);
+SearchPattern_t regex_pattern(const std::string &s);
+
+struct SearchHit_t {
+    int64_t offset;
+    int32_t length;
+    // Index of the pattern matched.
+    int32_t pattern;
+};
+
+/// CSearchHits is the list of hits of a search, indexed by offset. Searches add the hits of each chunk as
+/// it completes, in any order, while the views read those found so far.
+class CSearchHits {
+public:
+    // Hits beyond this many are dropped, those of the highest offsets first, and the list marked truncated.
+    static const size_t s_MaxHits = size_t(1) << 22;
+
+    CSearchHits();
+
+    void clear();
+    void add(int64_t start, const std::vector<SearchHit_t> &hits);
+    bool accepts(int64_t offset) const;
+
+    size_t size() const;
+    bool truncated() const;
+
+    void within(int64_t start, int64_t end, std::vector<SearchHit_t> &out) const;
+    bool next(int64_t offset, SearchHit_t &hit) const;
+    bool previous(int64_t offset, SearchHit_t &hit) const;
+    size_t rank(int64_t offset) const;
+    void density(int64_t start, int64_t end, int n_out, uint32_t *counts) const;
+
+protected:
+    mutable std::mutex m_Mutex;
+    // Hits of each chunk searched, sorted by offset, keyed by the chunk's start.
+    std::map<int64_t, std::vector<SearchHit_t>> m_Chunks;
+    size_t m_Count;
+    int32_t m_MaxLength;
+    // Hits starting at or after this offset were dropped, INT64_MAX while none were.
+    int64_t m_Limit;
+};
+
+/// CSearch finds a set of patterns. A single byte pattern is found by comparing its first and last exactly
+/// given bytes at every position with SIMD, and checking the whole pattern only where both match. Several
+/// are found with an Aho-Corasick automaton over the longest exactly given run of each, checked likewise.
+/// Regular expressions are matched separately, a bounded window at a time, matches beyond 512 bytes being cut.
+class CSearch {
+public:
+    CSearch();
+
+    bool compile(const std::vector<SearchPattern_t> &patterns, std::string &error);
+    bool run(const uint8_t *dat, int64_t n, CSearchHits &hits, const std::atomic<bool> *cancel = nullptr,
+             std::atomic<int64_t> *done = nullptr) const;
+    void find(const uint8_t *dat, int64_t n, int64_t start, int64_t end, std::vector<SearchHit_t> &hits,
+              const std::atomic<bool> *cancel = nullptr) const;
+
+    const char *kernelName() const;
+
+protected:
+    struct Pattern_t {
+        std::vector<uint8_t> bytes;
+        std::vector<uint8_t> mask;
+        // Longest run of exactly given bytes, empty for patterns of wildcards only.
+        int anchor_offset;
+        int anchor_length;
+        int index;
+    };
+
+    struct Regex_t {
+        std::regex re;
+        int index;
+    };
+
+    bool matches(const Pattern_t &p, const uint8_t *dat) const;
+    void findFiltered(const uint8_t *dat, int64_t n, int64_t start, int64_t end, std::vector<SearchHit_t> &hits) const;
+    void findAutomaton(const uint8_t *dat, int64_t n, int64_t start, int64_t end, std::vector<SearchHit_t> &hits) const;
+    void findEverywhere(const Pattern_t &p, const uint8_t *dat, int64_t n, int64_t start, int64_t end,
+                        std::vector<SearchHit_t> &hits) const;
+    void findRegex(const Regex_t &r, const uint8_t *dat, int64_t n, int64_t start, int64_t end,
+                   std::vector<SearchHit_t> &hits, const std::atomic<bool> *cancel) const;
+
+    std::vector<Pattern_t> m_Patterns;
+    std::vector<Regex_t> m_Regexes;
+    int m_MaxLength;
+
+    // The filter of a single anchored pattern, comparing the bytes at m_FilterOffset[i] with m_FilterByte[i].
+    bool m_Filtered;
+    int m_FilterOffset[2];
+    uint8_t m_FilterByte[2];
+
+    // The automaton over the anchors of the other patterns, on classes of bytes. m_Next[r + m_ByteClass[c]]
+    // is the transition from the state whose row starts at r on byte c, holding the row of the next state
+    // shifted left by one, and whether any anchor ends there in the low bit. m_Anchors[s] are the patterns
+    // whose anchor ends in state s, m_Suffix[s] the longest proper suffix state of s with any, and
+    // m_Starts[c] whether byte c leaves the root.
+    uint8_t m_ByteClass[256];
+    int m_Classes;
+    std::vector<int32_t> m_Next;
+    std::vector<std::vector<int>> m_Anchors;
+    std::vector<int32_t> m_Suffix;
+    std::vector<uint8_t> m_Starts;
+    // The bytes leaving the root when there are at most 4, padded by repeating the first.
+    int m_SkipCount;
+    uint8_t m_SkipBytes[4];
+    std::vector<int> m_Unanchored;
+};
+
+#endif
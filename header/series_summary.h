@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SERIES_SUMMARY_H_
+#define _SERIES_SUMMARY_H_
+
+#include <vector>
+#include <stdint.h>
+
+/// CSeriesSummary holds a series of values together with the minimum, maximum and sum of successive groups
+/// of s_Fanout, s_Fanout^2, ... values, so that the envelope and mean of any range are read from a few
+/// entries of each level instead of every value. Plots rebuild it when their data changes and then draw
+/// any number of rows, at any size, in time proportional to the rows.
+class CSeriesSummary {
+public:
+    static const int s_Fanout = 16;
+
+    CSeriesSummary();
+
+    void build(const float *dat, int64_t n);
+    void build(const float *mean, const float *mn, const float *mx, int64_t n);
+    void clear();
+
+    bool empty() const { return m_Values.empty(); }
+    int64_t size() const { return int64_t(m_Values.size()); }
+    float minimum() const { return m_Min; }
+    float maximum() const { return m_Max; }
+    int64_t memoryUsage() const;
+
+    void summarize(int64_t start, int64_t end, float &mn, float &mx, double &sum) const;
+    void sample(int n_out, float *mean, float *mn, float *mx) const;
+
+protected:
+    struct Level_t {
+        std::vector<float> min;
+        std::vector<float> max;
+        std::vector<double> sum;
+    };
+
+    float valueMin(int64_t i) const { return m_ValueMin.empty() ? m_Values[i] : m_ValueMin[i]; }
+    float valueMax(int64_t i) const { return m_ValueMax.empty() ? m_Values[i] : m_ValueMax[i]; }
+
+    std::vector<float> m_Values;
+    // Minimum and maximum of each value when built from an envelope, empty when the values are single.
+    std::vector<float> m_ValueMin;
+    std::vector<float> m_ValueMax;
+    // Level k summarizes groups of s_Fanout^(k + 1) values.
+    std::vector<Level_t> m_Levels;
+    float m_Min;
+    float m_Max;
+};
+
+#endif
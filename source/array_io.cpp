@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Writers for the analysis results, kept free of any image or compression library. NumPy's .npy
+// format is a short text header followed by the raw little-endian array. PNG images are written
+// with uncompressed (stored) deflate blocks, which every decoder must accept.
+
+#include <algorithm>
+
+#include <cstdio>
+#include <cstring>
+
+#include "array_io.h"
+
+/// write_file writes the n bytes of dat to filename, replacing it.
+static bool write_file(const std::string &filename, const std::vector<uint8_t> &dat) {
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        fprintf(stderr, "Unable to open '%s' for writing\n", filename.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(dat.data(), 1, dat.size(), f) == dat.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Unable to write '%s'\n", filename.c_str());
+    }
+    return ok;
+}
+
+/// npy_write writes a C ordered array of elements described by descr, e.g. "<f4".
+template<class T>
+static bool npy_write(const std::string &filename, const char *descr, const T *dat, const std::vector<int64_t> &shape) {
+    std::string dims;
+    int64_t n = 1;
+    for (int64_t d : shape) {
+        dims += std::to_string(d) + ",";
+        if (shape.size() > 1) dims += " ";
+        n *= d;
+    }
+    if (shape.size() > 1) dims.resize(dims.size() - 2);
+
+    std::string header = std::string("{'descr': '") + descr + "', 'fortran_order': False, 'shape': (" + dims + "), }";
+
+    // The magic, version, header length and header are padded to a multiple of 64 bytes, ending with a newline.
+    size_t total = 10 + header.size() + 1;
+    header.append((64 - total % 64) % 64, ' ');
+    header += '\n';
+
+    std::vector<uint8_t> out;
+    out.reserve(10 + header.size() + n * sizeof(T));
+    const uint8_t magic[] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0};
+    out.insert(out.end(), magic, magic + sizeof(magic));
+    out.push_back(header.size() & 0xff);
+    out.push_back((header.size() >> 8) & 0xff);
+    out.insert(out.end(), header.begin(), header.end());
+
+    // Every supported host is little endian, matching the descriptors.
+    auto p = (const uint8_t *) dat;
+    out.insert(out.end(), p, p + n * sizeof(T));
+
+    return write_file(filename, out);
+}
+
+/// write_npy writes dat, an array of the given shape in C order, to filename as a NumPy .npy file.
+bool write_npy(const std::string &filename, const float *dat, const std::vector<int64_t> &shape) {
+    return npy_write(filename, "<f4", dat, shape);
+}
+
+bool write_npy(const std::string &filename, const int32_t *dat, const std::vector<int64_t> &shape) {
+    return npy_write(filename, "<i4", dat, shape);
+}
+
+bool write_npy(const std::string &filename, const uint32_t *dat, const std::vector<int64_t> &shape) {
+    return npy_write(filename, "<u4", dat, shape);
+}
+
+bool write_npy(const std::string &filename, const uint64_t *dat, const std::vector<int64_t> &shape) {
+    return npy_write(filename, "<u8", dat, shape);
+}
+
+bool write_npy(const std::string &filename, const uint8_t *dat, const std::vector<int64_t> &shape) {
+    return npy_write(filename, "|u1", dat, shape);
+}
+
+/// csv_write writes rows lines of cols comma separated values.
+template<class T>
+static bool csv_write(const std::string &filename, const char *fmt, const T *dat, int64_t rows, int64_t cols) {
+    FILE *f = fopen(filename.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "Unable to open '%s' for writing\n", filename.c_str());
+        return false;
+    }
+
+    for (int64_t r = 0; r < rows; r++) {
+        for (int64_t c = 0; c < cols; c++) {
+            if (c > 0) fputc(',', f);
+            fprintf(f, fmt, dat[r * cols + c]);
+        }
+        fputc('\n', f);
+    }
+
+    bool ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Unable to write '%s'\n", filename.c_str());
+    }
+    return ok;
+}
+
+/// write_csv writes dat, a matrix of rows x cols values in row order, to filename as comma separated values.
+bool write_csv(const std::string &filename, const float *dat, int64_t rows, int64_t cols) {
+    return csv_write(filename, "%g", dat, rows, cols);
+}
+
+bool write_csv(const std::string &filename, const int32_t *dat, int64_t rows, int64_t cols) {
+    return csv_write(filename, "%d", dat, rows, cols);
+}
+
+bool write_csv(const std::string &filename, const uint32_t *dat, int64_t rows, int64_t cols) {
+    return csv_write(filename, "%u", dat, rows, cols);
+}
+
+bool write_csv(const std::string &filename, const uint64_t *dat, int64_t rows, int64_t cols) {
+    return csv_write(filename, "%llu", (const unsigned long long *) dat, rows, cols);
+}
+
+struct Crc32Table_t {
+    uint32_t t[256];
+
+    Crc32Table_t() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+    }
+};
+
+static uint32_t crc32(const uint8_t *p, size_t n, uint32_t crc = 0) {
+    static const Crc32Table_t table;
+
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) {
+        crc = table.t[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put_u32_be(std::vector<uint8_t> &out, uint32_t v) {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v >> 0);
+}
+
+static void put_chunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &dat) {
+    put_u32_be(out, uint32_t(dat.size()));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), dat.begin(), dat.end());
+    put_u32_be(out, crc32(out.data() + start, out.size() - start));
+}
+
+/// write_png writes an image of w x h pixels of 0xAARRGGBB, alpha being ignored, to filename as an RGB PNG.
+bool write_png(const std::string &filename, const uint32_t *argb, int w, int h) {
+    if (w <= 0 || h <= 0) {
+        fprintf(stderr, "Unable to write an empty image to '%s'\n", filename.c_str());
+        return false;
+    }
+
+    // Each row is preceded by its filter type, 0 for none.
+    std::vector<uint8_t> raw;
+    raw.reserve((size_t(w) * 3 + 1) * h);
+    for (int y = 0; y < h; y++) {
+        raw.push_back(0);
+        for (int x = 0; x < w; x++) {
+            uint32_t v = argb[int64_t(y) * w + x];
+            raw.push_back(v >> 16);
+            raw.push_back(v >> 8);
+            raw.push_back(v >> 0);
+        }
+    }
+
+    // zlib stream of stored blocks of at most 65535 bytes, followed by the adler-32 of the raw data.
+    std::vector<uint8_t> z;
+    z.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    z.push_back(0x78);
+    z.push_back(0x01);
+    size_t off = 0;
+    do {
+        size_t n = std::min<size_t>(65535, raw.size() - off);
+        z.push_back(off + n == raw.size() ? 1 : 0);
+        z.push_back(n & 0xff);
+        z.push_back(n >> 8);
+        z.push_back(~n & 0xff);
+        z.push_back((~n >> 8) & 0xff);
+        z.insert(z.end(), raw.begin() + off, raw.begin() + off + n);
+        off += n;
+    } while (off < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (uint8_t c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_u32_be(z, (b << 16) | a);
+
+    std::vector<uint8_t> ihdr;
+    put_u32_be(ihdr, w);
+    put_u32_be(ihdr, h);
+    ihdr.push_back(8); // bit depth
+    ihdr.push_back(2); // truecolor
+    ihdr.push_back(0); // deflate
+    ihdr.push_back(0); // adaptive filtering
+    ihdr.push_back(0); // no interlace
+
+    std::vector<uint8_t> out;
+    const uint8_t sig[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.insert(out.end(), sig, sig + sizeof(sig));
+    put_chunk(out, "IHDR", ihdr);
+    put_chunk(out, "IDAT", z);
+    put_chunk(out, "IEND", {});
+
+    return write_file(filename, out);
+}
@@ -0,0 +1,440 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// binvis-bench times the core kernels over deterministic synthetic inputs, so that the effect of a
+// change can be measured by comparing the JSON written by two runs. Each kernel runs repeatedly
+// until a minimum time has elapsed, and the fastest run is reported.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "bayer.h"
+#include "byte_count.h"
+#include "class_pyramid.h"
+#include "hilbert.h"
+#include "histogram_calc.h"
+#include "overview.h"
+#include "search.h"
+#include "series_summary.h"
+
+using std::max;
+using std::min;
+using std::string;
+using std::vector;
+
+struct BenchOptions_t {
+    int64_t minSize = 4 << 10;
+    int64_t maxSize = 16 << 20;
+    double minTime = .25;
+    string filter;
+    string jsonFile = "bench.json";
+};
+
+struct BenchResult_t {
+    string kernel;
+    string dtype;
+    string corpus;
+    int64_t bytes;
+    int64_t elements;
+    int runs;
+    double seconds;
+    int64_t peakRss;
+};
+
+static const char *s_Corpora[] = {"zeros", "text", "random", "structured", "image"};
+
+/// CRandom is a xorshift64* generator, giving the same corpora on every platform.
+class CRandom {
+public:
+    explicit CRandom(uint64_t seed) : m_State(seed ? seed : 1) {}
+
+    uint64_t next() {
+        m_State ^= m_State >> 12;
+        m_State ^= m_State << 25;
+        m_State ^= m_State >> 27;
+        return m_State * 0x2545f4914f6cdd1dull;
+    }
+
+protected:
+    uint64_t m_State;
+};
+
+/// make_corpus fills dat with n bytes of the named kind of content.
+static void make_corpus(const string &kind, vector<uint8_t> &dat, int64_t n) {
+    dat.assign(n, 0);
+    CRandom rng(0x9e3779b97f4a7c15ull ^ std::hash<string>()(kind));
+
+    if (kind == "text") {
+        static const char *words[] = {"the", "binary", "of", "visualizer", "entropy", "a", "histogram", "file",
+                                      "data", "and", "section", "header", "to", "is", "offset", "value"};
+        int64_t i = 0;
+        int col = 0;
+        while (i < n) {
+            const char *w = words[rng.next() % 16];
+            for (const char *c = w; *c && i < n; c++) dat[i++] = *c;
+            col += int(strlen(w)) + 1;
+            if (i < n) dat[i++] = col > 72 ? '\n' : ' ';
+            if (col > 72) col = 0;
+        }
+    } else if (kind == "random") {
+        int64_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t v = rng.next();
+            memcpy(&dat[i], &v, 8);
+        }
+        for (; i < n; i++) dat[i] = uint8_t(rng.next());
+    } else if (kind == "structured") {
+        // An array of 64 byte records with a counter, a float, a small enum, a name and padding,
+        // interleaved with a little code-like noise, much like the tables of an executable.
+        for (int64_t i = 0, rec = 0; i < n; i += 64, rec++) {
+            uint8_t r[64] = {0};
+            uint32_t id = uint32_t(rec);
+            float f = float(rec) * .5f;
+            memcpy(r + 0, &id, 4);
+            memcpy(r + 4, &f, 4);
+            r[8] = uint8_t(rng.next() % 4);
+            snprintf((char *) r + 16, 24, "item_%u", id);
+            if (rec % 8 == 7) {
+                for (int k = 40; k < 64; k++) r[k] = uint8_t(rng.next());
+            }
+            memcpy(&dat[i], r, min<int64_t>(64, n - i));
+        }
+    } else if (kind == "image") {
+        // An 8-bit Bayer mosaic of a smooth gradient with noise, 4096 pixels per row.
+        const int64_t w = 4096;
+        for (int64_t i = 0; i < n; i++) {
+            int64_t x = i % w, y = i / w;
+            int v = int(128 + 100 * std::sin(x * .01) * std::cos(y * .013)) + int(rng.next() % 9) - 4;
+            if ((x & 1) != (y & 1)) v = v * 3 / 4;
+            dat[i] = uint8_t(min(255, max(0, v)));
+        }
+    }
+}
+
+/// reset_peak_rss lowers the resident set size high-water mark to the current size, so that peak_rss
+/// measures the kernel run next rather than everything before it. Only Linux allows this; elsewhere the
+/// peak stays that of the whole process so far.
+static void reset_peak_rss() {
+#if defined(__linux__)
+#if defined(__GLIBC__)
+    // Hand the memory freed by the previous kernels back, it would otherwise count as resident.
+    malloc_trim(0);
+#endif
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f) {
+        fputs("5", f);
+        fclose(f);
+    }
+#endif
+}
+
+/// peak_rss returns the resident set size high-water mark of the process in bytes, including the input
+/// of the kernel.
+static int64_t peak_rss() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return int64_t(pmc.PeakWorkingSetSize);
+    return 0;
+#else
+#if defined(__linux__)
+    // Unlike ru_maxrss, VmHWM follows the resets of reset_peak_rss.
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long long kb = -1;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "VmHWM: %lld kB", &kb) == 1) break;
+        }
+        fclose(f);
+        if (kb >= 0) return int64_t(kb) * 1024;
+    }
+#endif
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+    return int64_t(ru.ru_maxrss);
+#else
+    return int64_t(ru.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+/// CBench runs and records the benchmarks.
+class CBench {
+public:
+    explicit CBench(const BenchOptions_t &opt) : m_Options(opt) {}
+
+    /// run times fn, a kernel processing bytes bytes or elements elements, unless filtered out.
+    template<class F>
+    void run(const string &kernel, const string &dtype, const string &corpus, int64_t bytes, int64_t elements, F &&fn) {
+        string name = kernel + "/" + dtype + "/" + corpus;
+        if (!m_Options.filter.empty() && name.find(m_Options.filter) == string::npos) return;
+
+        reset_peak_rss();
+
+        double best = 1e300, total = 0.;
+        int runs = 0;
+        while (runs == 0 || total < m_Options.minTime) {
+            auto t0 = std::chrono::steady_clock::now();
+            fn();
+            double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            best = min(best, dt);
+            total += dt;
+            runs++;
+        }
+
+        BenchResult_t r = {kernel, dtype, corpus, bytes, elements, runs, best, peak_rss()};
+        m_Results.push_back(r);
+
+        printf("%-12s %-12s %-11s %12lld B %10.1f MB/s %9.3f ns/elem %8.1f MiB rss\n", kernel.c_str(), dtype.c_str(),
+               corpus.c_str(), (long long) bytes, bytes / best / 1e6, best * 1e9 / max<int64_t>(1, elements),
+               r.peakRss / double(1 << 20));
+        fflush(stdout);
+    }
+
+    bool writeJson() const;
+
+protected:
+    const BenchOptions_t &m_Options;
+    vector<BenchResult_t> m_Results;
+};
+
+bool CBench::writeJson() const {
+    FILE *f = fopen(m_Options.jsonFile.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "Unable to open '%s' for writing\n", m_Options.jsonFile.c_str());
+        return false;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"threads\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(f, "  \"count_bytes_kernel\": \"%s\",\n", count_bytes_kernel_name());
+    fprintf(f, "  \"results\": [\n");
+    for (size_t i = 0; i < m_Results.size(); i++) {
+        const auto &r = m_Results[i];
+        fprintf(f, "    {\"kernel\": \"%s\", \"dtype\": \"%s\", \"corpus\": \"%s\", \"bytes\": %lld, \"elements\": %lld, "
+                   "\"runs\": %d, \"seconds\": %.9g, \"bytes_per_s\": %.6g, \"ns_per_element\": %.6g, \"peak_rss_bytes\": %lld}%s\n",
+                r.kernel.c_str(), r.dtype.c_str(), r.corpus.c_str(), (long long) r.bytes, (long long) r.elements,
+                r.runs, r.seconds, r.bytes / r.seconds, r.seconds * 1e9 / max<int64_t>(1, r.elements),
+                (long long) r.peakRss, i + 1 < m_Results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    bool ok = fclose(f) == 0;
+    if (ok) printf("Results written to '%s'\n", m_Options.jsonFile.c_str());
+    return ok;
+}
+
+static void bench_corpus(CBench &bench, const string &corpus, const vector<uint8_t> &dat) {
+    static const char *dtypes[] = {"U8", "U12", "U16", "U32", "U64", "F32", "F64", "F32 Bits", "F64 Bits"};
+
+    const uint8_t *p = dat.data();
+    int64_t n = dat.size();
+
+    bench.run("count_bytes", "U8", corpus, n, n, [&]() {
+        uint64_t counts[256] = {0};
+        count_bytes(p, n, counts);
+    });
+
+    for (const char *name : dtypes) {
+        HistoDtype_t t = string_to_histo_dtype(name);
+        int64_t ne = n / histo_dtype_size(t);
+
+        bench.run("histo", name, corpus, n, ne, [&]() {
+            delete[] generate_histo(p, n, t);
+        });
+        bench.run("histo_2d", name, corpus, n, ne, [&]() {
+            delete[] generate_histo_2d(p, n, t);
+        });
+        bench.run("histo_3d", name, corpus, n, ne, [&]() {
+            SparseHisto3D_t hist;
+            generate_histo_3d(p, n, t, hist);
+        });
+    }
+
+    bench.run("entropy", "bs256", corpus, n, n, [&]() {
+        int64_t len;
+        delete[] generate_entropy(p, n, len, 256);
+    });
+    bench.run("entropy", "bs256/64", corpus, n, n, [&]() {
+        int64_t len;
+        delete[] generate_entropy(p, n, len, 256, 64);
+    });
+
+    for (int classes = 0; classes < 2; classes++) {
+        for (int hilbert = 0; hilbert < 2; hilbert++) {
+            string mode = string(classes ? "classes" : "grey") + (hilbert ? "/hil" : "/rows");
+            bench.run("overview", mode, corpus, n, n, [&]() {
+                vector<uint32_t> img;
+                int w, h;
+                render_overview(p, n, 512, 1024, classes, hilbert, img, w, h);
+            });
+        }
+    }
+
+    // A single pattern with a wildcard, and a set of words.
+    {
+        std::vector<SearchPattern_t> single(1), words;
+        parse_hex_pattern("4d 5a ?? 00 03", single[0]);
+        for (const char *w : {"error", "warning", "password", "http://", "https://", "0x", "GET ", "POST ",
+                              "<html", "PK", "ELF", "MZ", "%PDF", "\x89PNG", "root", "admin"}) {
+            words.push_back(ascii_pattern(w));
+        }
+
+        std::string error;
+        CSearch search;
+        for (int i = 0; i < 2; i++) {
+            search.compile(i == 0 ? single : words, error);
+            bench.run("search", string(i == 0 ? "hex/" : "words/") + search.kernelName(), corpus, n, n, [&]() {
+                CSearchHits hits;
+                search.run(p, n, hits);
+            });
+        }
+    }
+
+    CClassPyramid pyramid;
+    bench.run("class_pyramid", "build", corpus, n, n, [&]() {
+        pyramid.build(p, n, byte_classes_scheme());
+    });
+    for (int classes = 0; classes < 2; classes++) {
+        string mode = string(classes ? "classes" : "grey") + "/rows";
+        bench.run("overview_pyramid", mode, corpus, n, n, [&]() {
+            vector<uint32_t> img;
+            int w, h;
+            render_overview(pyramid, 0, n, 128, 1024, classes, false, img, w, h);
+        });
+    }
+}
+
+/// bench_images times the kernels whose cost depends on the image size only.
+static void bench_images(CBench &bench, int64_t n, const vector<uint8_t> &image) {
+    int w = 1;
+    while (int64_t(w) * w * 4 <= n) w *= 2;
+    int h = int(n / w);
+
+    bench.run("gilbert2d", std::to_string(w) + "x" + std::to_string(h), "none", n, int64_t(w) * h, [&]() {
+        curve_t curve;
+        gilbert2d(w, h, curve);
+    });
+
+    vector<uint32_t> lut(int64_t(w) * h);
+    bench.run("gilbert2d_fill", std::to_string(w) + "x" + std::to_string(h), "none", n, int64_t(w) * h, [&]() {
+        gilbert2d_fill(w, h, 0, int64_t(w) * h, lut.data());
+    });
+
+    vector<uint8_t> rgb(int64_t(w) * h * 3);
+    bench.run("bayerBG", std::to_string(w) + "x" + std::to_string(h), "image", n, int64_t(w) * h, [&]() {
+        bayerBG(image.data(), h, w, 0, rgb.data());
+    });
+
+    // A series of one float per 4 bytes, as a plot of n bytes of input would hold.
+    vector<float> series(std::max<int64_t>(1, n / 4));
+    for (size_t i = 0; i < series.size(); i++) series[i] = image[i % image.size()];
+    CSeriesSummary summary;
+    bench.run("series_summary", "build", "image", n, int64_t(series.size()), [&]() {
+        summary.build(series.data(), int64_t(series.size()));
+    });
+    vector<float> mean(1024), lo(1024), hi(1024);
+    bench.run("series_summary", "sample/1024", "image", n, int64_t(series.size()), [&]() {
+        summary.sample(1024, mean.data(), lo.data(), hi.data());
+    });
+}
+
+static bool parse_size(const char *s, int64_t &v) {
+    char *end = nullptr;
+    double x = strtod(s, &end);
+    if (end == s || x <= 0) return false;
+    int64_t m = 1;
+    if (*end == 'K' || *end == 'k') m = int64_t(1) << 10, end++;
+    else if (*end == 'M' || *end == 'm') m = int64_t(1) << 20, end++;
+    else if (*end == 'G' || *end == 'g') m = int64_t(1) << 30, end++;
+    if (*end != '\0') return false;
+    v = int64_t(x * m);
+    return true;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --min-size <n>    smallest input, default 4K\n"
+            "  --max-size <n>    largest input, default 16M; sizes grow by 4x and accept K, M and G suffixes\n"
+            "  --min-time <s>    minimum time spent on each benchmark, default 0.25\n"
+            "  --filter <s>      only run benchmarks whose kernel/dtype/corpus name contains s\n"
+            "  --json <file>     file the results are written to, default bench.json\n",
+            argv0);
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions_t opt;
+
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        const char *v = argv[++i];
+        bool ok = true;
+        if (a == "--min-size") ok = parse_size(v, opt.minSize);
+        else if (a == "--max-size") ok = parse_size(v, opt.maxSize);
+        else if (a == "--min-time") opt.minTime = atof(v);
+        else if (a == "--filter") opt.filter = v;
+        else if (a == "--json") opt.jsonFile = v;
+        else ok = false;
+        if (!ok) {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("%u threads, count_bytes kernel: %s\n", std::thread::hardware_concurrency(), count_bytes_kernel_name());
+
+    CBench bench(opt);
+    vector<uint8_t> dat, image;
+
+    for (int64_t n = opt.minSize; n <= opt.maxSize; n *= 4) {
+        for (const char *corpus : s_Corpora) {
+            make_corpus(corpus, dat, n);
+            bench_corpus(bench, corpus, dat);
+            if (string(corpus) == "image") image.swap(dat);
+        }
+        bench_images(bench, n, image);
+    }
+
+    return bench.writeJson() ? 0 : EXIT_FAILURE;
+}
@@ -17,17 +17,40 @@
  *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include <QtGui>
+#include <QApplication>
 #include <QGridLayout>
 #include <QComboBox>
+#include <QInputDialog>
 #include <QScrollBar>
+#include <QShortcut>
 
 #include "binary_viewer.h"
-
+#include "byte_classes.h"
+
+// Largest range given to the scroll bar, past this many rows each step covers several.
+static const qsizetype s_MaxScrollSteps = 1 << 30;
+
+/// byte_text_color returns the color of the text of byte c, the color of its class in the byte class
+/// scheme lightened where too dark to read, with unclassified bytes drawn gray.
+static QRgb byte_text_color(const CByteClasses &classes, uint8_t c) {
+    if (classes.byteClass(c) == 0) return qRgb(0x55, 0x55, 0x55);
+
+    uint32_t v = classes.byteColor(c);
+    int r = (v >> 16) & 0xff, g = (v >> 8) & 0xff, b = (v >> 0) & 0xff;
+    if (qGray(r, g, b) < 0x40) {
+        r = std::max(r, 0x60);
+        g = std::max(g, 0x60);
+        b = std::max(b, 0x60);
+    }
+    return qRgb(r, g, b);
+}
 
 CHexLogic::CHexLogic(QWidget *p)
         : QWidget(p),
-          m_Data(nullptr), m_Size(0), m_Offset(0) {
+          m_Data(nullptr), m_Size(0), m_Offset(0), m_Hits(nullptr), m_RowsStart(0), m_RowsValid(false) {
 }
 
 int CHexLogic::rowHeight() const {
@@ -69,101 +92,179 @@ int CHexLogic::columnStart(int c, int fw) const {
 void CHexLogic::paintEvent(QPaintEvent *e) {
     QWidget::paintEvent(e);
 
+    QFontMetrics fm(m_Font);
+
+    int fh = fm.height();
+
+    int nvis_rows = height() / fh;
+
+    QRgb default_color = palette().color(foregroundRole()).rgba();
+
+    QRgb hex_colors[256];
+    QRgb ascii_colors[256];
+    for (int c = 0; c < 256; c++) {
+        hex_colors[c] = byte_text_color(byte_classes_scheme(), uint8_t(c));
+        ascii_colors[c] = (0x20 <= c && c <= 0x7e) ? default_color : 0xff606060;
+    }
+    qreal dpr = devicePixelRatioF();
+    if (m_Atlas.update(m_Font, dpr, default_color, hex_colors, ascii_colors)) {
+        invalidateRows();
+    }
+
+    QSize size = this->size() * dpr;
+    if (m_Rows.size() != size || m_Rows.devicePixelRatio() != dpr) {
+        m_Rows = QPixmap(size);
+        m_Rows.setDevicePixelRatio(dpr);
+        invalidateRows();
+    }
+
+    // Rows can be shifted when they are a whole number of device pixels high.
+    qsizetype d = m_Offset - m_RowsStart;
+    qreal dy = fh * dpr;
+    if (!m_RowsValid || d <= -nvis_rows || d >= nvis_rows || dy != qRound(dy)) {
+        m_Rows.fill(Qt::transparent);
+
+        QPainter p(&m_Rows);
+        renderRows(p, 0, nvis_rows);
+    } else if (d != 0) {
+        m_Rows.scroll(0, -int(d * qRound(dy)), m_Rows.rect());
+
+        // Only the area of each row's cells is rendered, the margins above the first and below the last
+        // are cleared of what the scroll moved into them.
+        QPainter p(&m_Rows);
+        int top = fh - m_Atlas.ascent();
+        p.setCompositionMode(QPainter::CompositionMode_Source);
+        p.fillRect(0, 0, width(), top, Qt::transparent);
+        p.fillRect(0, nvis_rows * fh + top, width(), height(), Qt::transparent);
+        p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+
+        if (d > 0) {
+            renderRows(p, int(nvis_rows - d), nvis_rows);
+        } else {
+            renderRows(p, 0, int(-d));
+        }
+    }
+    m_RowsStart = m_Offset;
+    m_RowsValid = true;
+
     QPainter p(this);
+    p.drawPixmap(0, 0, m_Rows);
 
-    int w = width();
-    int h = height();
+    // a border around the image helps to see the border of a dark image
+    p.setPen(Qt::darkGray);
+    p.drawRect(0, 0, width() - 1, height() - 1);
+}
 
-    p.setFont(m_Font);
+/// renderRows clears and renders the visible rows [first, last) into p. Each row is drawn within its cells,
+/// which start at its text's ascent above the baseline and are a row high, so the descenders of one row are
+/// kept when the next is rendered.
+void CHexLogic::renderRows(QPainter &p, int first, int last) {
     QFontMetrics fm(m_Font);
 
     int fh = fm.height();
     int fw = fm.maxWidth();
 
-    int nvis_rows = h / fh;
+    QRect area(0, (first + 1) * fh - m_Atlas.ascent(), width(), (last - first) * fh);
+    p.setCompositionMode(QPainter::CompositionMode_Source);
+    p.fillRect(area, Qt::transparent);
+    p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+
+    int hex_x[16];
+    int ascii_x[16];
+    {
+        int x = columnStart(1, fw);
+        for (int j = 0; j < 16; j++) {
+            if (j > 0) x += 1.2 * fw + 2 * fw;
+            if (j == 16 / 2) x += 2 * fw;
+            hex_x[j] = x;
+        }
+
+        x = columnStart(2, fw);
+        for (int j = 0; j < 16; j++) {
+            if (j > 0) x += 1.2 * fw + 1 * fw;
+            if (j == 16 / 2) x += 2 * fw;
+            ascii_x[j] = x;
+        }
+    }
 
-    QPen default_pen = p.pen();
+    p.save();
+    p.setClipRect(area);
+
+    // Search hits are highlighted behind the cells of their bytes.
+    if (m_Hits) {
+        qsizetype first_pos = (m_Offset + first) * 16;
+        qsizetype last_pos = std::min(m_Size, (m_Offset + last) * 16);
+        m_Hits->within(first_pos, last_pos, m_VisibleHits);
+
+        QColor highlight(255, 200, 0, 96);
+        for (const auto &hit : m_VisibleHits) {
+            qsizetype b = std::max<qsizetype>(hit.offset, first_pos);
+            qsizetype e = std::min<qsizetype>(hit.offset + hit.length, last_pos);
+            for (qsizetype pos = b; pos < e; pos++) {
+                int i = int(pos / 16 - m_Offset);
+                int j = int(pos % 16);
+                int top = (i + 1) * fh - m_Atlas.ascent();
+                p.fillRect(hex_x[j], top, 2 * fw, fh, highlight);
+                p.fillRect(ascii_x[j], top, fw, fh, highlight);
+            }
+        }
+    }
 
-    for (int i = 0; i < nvis_rows; i++) {
+    // Every cell of the rows is copied from the atlas in a single call.
+    m_Fragments.clear();
+    for (int i = first; i < last; i++) {
         int x = columnStart(0, fw);
         int y = (i + 1) * fh;
 
         qsizetype pos = (m_Offset + i) * 16;
-
-        QString s1("0x");
-        s1.append(QString("%1").arg(pos, 8, 16, QChar('0')).toUpper());
-        p.setPen(default_pen);
-        p.drawText(x, y, s1);
-
-        x = columnStart(1, fw);
+        if (pos >= m_Size) break;
+
+        // The offset, upper case and at least 8 digits.
+        int ndigits = 8;
+        while (ndigits < 16 && (quint64(pos) >> (4 * ndigits)) != 0) ndigits++;
+        qreal lx = x;
+        m_Fragments.push_back(m_Atlas.fragment(CGlyphAtlas::LABEL, 0, lx, y));
+        lx += m_Atlas.labelAdvance();
+        m_Fragments.push_back(m_Atlas.fragment(CGlyphAtlas::LABEL, CGlyphAtlas::s_LabelX, lx, y));
+        for (int d = ndigits - 1; d >= 0; d--) {
+            lx += m_Atlas.labelAdvance();
+            m_Fragments.push_back(m_Atlas.fragment(CGlyphAtlas::LABEL, int((quint64(pos) >> (4 * d)) & 15), lx, y));
+        }
 
         for (int j = 0; j < 16; j++) {
             if (pos + j >= m_Size) break;
 
-            if (j > 0) x += 1.2 * fw + 2 * fw;
-            if (j == 16 / 2) x += 2 * fw;
-
-            unsigned char c = m_Data[pos + j];
-
-            int r, g, b;
-            if (c == 0x00) {
-                r = 0x55;
-                g = 0x55;
-                b = 0x55;
-            } else if (0x00 < c && c <= 0x1f) {
-                r = 0x60;
-                g = 0x60;
-                b = 0xf0;
-            } else if (0x1f < c && c <= 0x7f) {
-                r = 0x00;
-                g = 0xf0;
-                b = 0x00;
-            } else if (0x7f < c && c < 0xff) {
-                r = 0xf0;
-                g = 0x00;
-                b = 0x00;
-            } else if (c == 0xff) {
-                r = 0xff;
-                g = 0xff;
-                b = 0xff;
-            }
-            unsigned int v = (0xff << 24) | (r << 16) | (g << 8) | (b << 0);
-            p.setPen(QPen(QRgb(v)));
-
-            QString s2;
-            s2 = QString("%1").arg(c, 2, 16, QChar('0'));
-            p.drawText(x, y, s2);
+            m_Fragments.push_back(m_Atlas.fragment(CGlyphAtlas::HEX, m_Data[pos + j], hex_x[j], y));
         }
 
-        x = columnStart(2, fw);
-
-        p.setPen(default_pen);
         for (int j = 0; j < 16; j++) {
             if (pos + j >= m_Size) break;
 
-            if (j > 0) x += 1.2 * fw + 1 * fw;
-            if (j == 16 / 2) x += 2 * fw;
-
-            unsigned char c = m_Data[pos + j];
+            m_Fragments.push_back(m_Atlas.fragment(CGlyphAtlas::ASCII, m_Data[pos + j], ascii_x[j], y));
+        }
+    }
+    if (!m_Fragments.empty()) {
+        p.drawPixmapFragments(m_Fragments.data(), int(m_Fragments.size()), m_Atlas.pixmap());
+    }
 
-            if (!(0x20 <= c && c <= 0x7e)) {
-                p.setPen(QPen(0xff606060));
-                c = '.';
-            } else {
-                p.setPen(default_pen);
-            }
+    p.restore();
+}
 
-            QString s2;
-            s2 = QString("%1").arg(char(c));
-            p.drawText(x, y, s2);
-        }
+/// invalidateRows has the next paint render every row again, after the font, size, colors or data change.
+void CHexLogic::invalidateRows() {
+    m_RowsValid = false;
+}
 
-//        x = px + int(1.2 * fw + 1 * fw) * 16 + 2 * fw;
-    }
+/// setHits highlights the hits of a search, which may still be adding to them, or none if null.
+void CHexLogic::setHits(const CSearchHits *hits) {
+    m_Hits = hits;
+    hitsChanged();
+}
 
-    // a border around the image helps to see the border of a dark image
-    p.setPen(Qt::darkGray);
-    p.drawRect(0, 0, width() - 1, height() - 1);
+/// hitsChanged shows the hits added since the last call.
+void CHexLogic::hitsChanged() {
+    invalidateRows();
+    update();
 }
 
 void CHexLogic::resizeEvent(QResizeEvent *e) {
@@ -178,24 +279,30 @@ void CHexLogic::resizeEvent(QResizeEvent *e) {
         if (mw < width()) break;
     }
     m_Font = font;
+    invalidateRows();
 }
 
 void CHexLogic::setData(const quint8 *dat, qsizetype n) {
+    if (dat == m_Data && n == m_Size) return;
+
     m_Data = dat;
     m_Size = n;
     m_Offset = 0;
+    invalidateRows();
     update();
 }
 
-void CHexLogic::setStart(int off) {
-    m_Offset = off;
+void CHexLogic::setStart(qsizetype row) {
+    if (row == m_Offset) return;
+
+    m_Offset = row;
     update();
 }
 
 
 CHexView::CHexView(QWidget *p)
-        : QWidget(p)
-//          hist_(nullptr), dat_(nullptr), dat_n_(0)
+        : QWidget(p),
+          m_Data(nullptr), m_Size(0), m_Row(0), m_RowsPerStep(1), m_WheelDelta(0)
 {
     auto layout = new QHBoxLayout(this);
 
@@ -205,11 +312,15 @@ CHexView::CHexView(QWidget *p)
     layout->addWidget(m_HexLogic);
     layout->addWidget(m_ScrollBar);
 
+    // The keys are handled by the view, whose steps are exact rows, rather than the scroll bar.
     m_ScrollBar->setRange(0, 0);
-    m_ScrollBar->setFocus();
-    m_ScrollBar->setFocusPolicy(Qt::StrongFocus);
+    m_ScrollBar->setFocusPolicy(Qt::NoFocus);
+    setFocusPolicy(Qt::StrongFocus);
+
+    connect(m_ScrollBar, SIGNAL(valueChanged(int)), SLOT(scrolled(int)));
 
-    connect(m_ScrollBar, SIGNAL(valueChanged(int)), m_HexLogic, SLOT(setStart(int)));
+    auto jump = new QShortcut(QKeySequence(Qt::CTRL + Qt::Key_G), this, SLOT(askJump()));
+    jump->setContext(Qt::WidgetWithChildrenShortcut);
 
     setLayout(layout);
 }
@@ -224,31 +335,148 @@ void CHexView::paintEvent(QPaintEvent *e) {
 void CHexView::resizeEvent(QResizeEvent *e) {
     QWidget::resizeEvent(e);
 
-    int nvis_rows = height() / m_HexLogic->rowHeight();
-    int page_step = std::max(16, nvis_rows - 2);
-    m_ScrollBar->setRange(0, int(ceil(m_Size / 16.)) - nvis_rows + 1);
-    m_ScrollBar->setPageStep(page_step);
+    updateScrollRange();
+}
+
+int CHexView::visibleRows() const {
+    return height() / m_HexLogic->rowHeight();
+}
+
+/// lastRow returns the largest first row, the one showing the end of the data.
+qsizetype CHexView::lastRow() const {
+    return std::max<qsizetype>(0, (m_Size + 15) / 16 - visibleRows() + 1);
+}
+
+void CHexView::updateScrollRange() {
+    qsizetype rows = lastRow();
+    m_RowsPerStep = rows / s_MaxScrollSteps + 1;
+
+    int page_step = std::max(16, visibleRows() - 2);
+    m_ScrollBar->blockSignals(true);
+    m_ScrollBar->setRange(0, int(rows / m_RowsPerStep));
+    m_ScrollBar->setPageStep(int(std::max<qsizetype>(1, page_step / m_RowsPerStep)));
+    m_ScrollBar->blockSignals(false);
+
+    updateScrollBar();
+}
+
+/// updateScrollBar moves the scroll bar to the step nearest m_Row, its last step meaning the last row.
+void CHexView::updateScrollBar() {
+    int v = m_Row >= lastRow() ? m_ScrollBar->maximum() : int(m_Row / m_RowsPerStep);
+
+    m_ScrollBar->blockSignals(true);
+    m_ScrollBar->setValue(v);
+    m_ScrollBar->blockSignals(false);
 }
 
 void CHexView::setData(const quint8 *dat, qsizetype n) {
+    if (dat == m_Data && n == m_Size) return;
+
     m_Data = dat;
     m_Size = n;
+    m_Row = 0;
 
     m_HexLogic->setData(dat, n);
-    int nvis_rows = height() / m_HexLogic->rowHeight();
-    m_ScrollBar->setRange(0, int(ceil(m_Size / 16.)) - nvis_rows + 1);
+    updateScrollRange();
+}
+
+/// setStart scrolls to show row, of 16 bytes, at the top.
+void CHexView::setStart(qsizetype row) {
+    m_Row = std::max<qsizetype>(0, std::min(row, lastRow()));
+    updateScrollBar();
+
+    m_HexLogic->setStart(m_Row);
+}
+
+/// moveTo scrolls to row as setStart does, for moves made by the user, which are signalled.
+void CHexView::moveTo(qsizetype row) {
+    row = std::max<qsizetype>(0, std::min(row, lastRow()));
+    if (row == m_Row) return;
+
+    setStart(row);
+
+    emit(startChanged(m_Row * 16));
+}
+
+/// jumpTo scrolls to show the row holding offset at the top.
+void CHexView::jumpTo(qsizetype offset) {
+    moveTo(std::max<qsizetype>(0, offset) / 16);
+}
+
+/// askJump asks for an offset, in decimal or hexadecimal with a 0x prefix, and jumps to it.
+void CHexView::askJump() {
+    if (m_Data == nullptr) return;
+
+    bool ok = false;
+    QString text = QInputDialog::getText(this, "Go to Offset", "Offset (decimal, or hexadecimal with 0x):",
+                                         QLineEdit::Normal, QString("0x%1").arg(m_Row * 16, 0, 16), &ok).trimmed();
+    if (!ok || text.isEmpty()) return;
+
+    qlonglong offset;
+    if (text.startsWith("0x", Qt::CaseInsensitive)) {
+        offset = text.mid(2).toLongLong(&ok, 16);
+    } else {
+        offset = text.toLongLong(&ok, 10);
+    }
+    if (!ok || offset < 0) return;
+
+    jumpTo(qsizetype(offset));
+}
+
+void CHexView::setHits(const CSearchHits *hits) {
+    m_HexLogic->setHits(hits);
+}
+
+void CHexView::hitsChanged() {
+    m_HexLogic->hitsChanged();
 }
 
-void CHexView::setStart(int s) {
-    m_ScrollBar->setValue(s);
+void CHexView::scrolled(int v) {
+    moveTo(v >= m_ScrollBar->maximum() ? lastRow() : qsizetype(v) * m_RowsPerStep);
 }
 
 void CHexView::enterEvent(QEvent *e) {
     QWidget::enterEvent(e);
-    m_ScrollBar->setFocus();
+    setFocus();
 }
 
 void CHexView::wheelEvent(QWheelEvent *e) {
-    m_ScrollBar->event(e);
+    e->accept();
+
+    // High resolution wheels send fractions of a step, which are collected until they make one.
+    m_WheelDelta += e->angleDelta().y();
+    int steps = m_WheelDelta / 120;
+    m_WheelDelta -= steps * 120;
+    if (steps != 0) {
+        moveTo(m_Row - qsizetype(steps) * QApplication::wheelScrollLines());
+    }
+}
+
+void CHexView::keyPressEvent(QKeyEvent *e) {
+    qsizetype page = std::max(1, visibleRows() - 1);
+
+    switch (e->key()) {
+        case Qt::Key_Up:
+            moveTo(m_Row - 1);
+            break;
+        case Qt::Key_Down:
+            moveTo(m_Row + 1);
+            break;
+        case Qt::Key_PageUp:
+            moveTo(m_Row - page);
+            break;
+        case Qt::Key_PageDown:
+            moveTo(m_Row + page);
+            break;
+        case Qt::Key_Home:
+            moveTo(0);
+            break;
+        case Qt::Key_End:
+            moveTo(lastRow());
+            break;
+        default:
+            QWidget::keyPressEvent(e);
+            return;
+    }
     e->accept();
 }
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "byte_classes.h"
+
+// Each of the classes 1..8 is tallied in its own 8-bit lane of a 64-bit word, with four words taking
+// turns, so every lane is flushed before it wraps after 4 * 255 bytes.
+static const int64_t s_LaneFlushBytes = 4 * 255;
+
+const char *const CByteClasses::s_DefaultScheme = "01-1f=0000f0;20-7f=00f000;80-fe=f00000;ff=ffffff";
+
+CByteClasses::CByteClasses() {
+    parse(s_DefaultScheme);
+}
+
+/// parse_hex reads the hex number of at most max_digits digits starting at s[i], advancing i past it.
+static bool parse_hex(const std::string &s, size_t &i, int max_digits, uint32_t &v) {
+    size_t b = i;
+    v = 0;
+    while (i < s.size() && i - b < size_t(max_digits) && isxdigit((unsigned char) s[i])) {
+        char c = char(tolower((unsigned char) s[i]));
+        v = v * 16 + uint32_t(c <= '9' ? c - '0' : c - 'a' + 10);
+        i++;
+    }
+    return i > b;
+}
+
+/// parse replaces the classes with those of scheme, see the class description for its format.
+/// @return False, leaving the classes unchanged, if scheme is malformed or has too many classes.
+bool CByteClasses::parse(const std::string &scheme) {
+    int count = 0;
+    uint8_t cls[256] = {0};
+    uint32_t color[s_MaxClasses + 1] = {0};
+
+    size_t i = 0;
+    while (i < scheme.size()) {
+        if (count == s_MaxClasses) {
+            fprintf(stderr, "Byte class scheme '%s' has more than %d classes\n", scheme.c_str(), s_MaxClasses);
+            return false;
+        }
+        count++;
+
+        // Byte values and ranges, up to the color.
+        for (;;) {
+            uint32_t lo, hi;
+            if (!parse_hex(scheme, i, 2, lo)) break;
+            hi = lo;
+            if (i < scheme.size() && scheme[i] == '-') {
+                i++;
+                if (!parse_hex(scheme, i, 2, hi) || hi < lo) break;
+            }
+            for (uint32_t c = lo; c <= hi; c++) {
+                cls[c] = uint8_t(count);
+            }
+            if (i < scheme.size() && scheme[i] == ',') {
+                i++;
+                continue;
+            }
+            break;
+        }
+
+        uint32_t rgb;
+        size_t b = i + 1;
+        if (i >= scheme.size() || scheme[i] != '=' || !parse_hex(scheme, ++i, 6, rgb) || i - b != 6 ||
+            (i < scheme.size() && scheme[i] != ';')) {
+            fprintf(stderr, "Malformed byte class scheme '%s' at position %d\n", scheme.c_str(), int(i));
+            return false;
+        }
+        color[count] = rgb;
+
+        if (i < scheme.size()) i++;
+    }
+
+    m_Count = count;
+    memcpy(m_Class, cls, sizeof(m_Class));
+    memcpy(m_Color, color, sizeof(m_Color));
+    for (int c = 0; c < 256; c++) {
+        m_Lanes[c] = m_Class[c] > 0 ? uint64_t(1) << (8 * (m_Class[c] - 1)) : 0;
+    }
+    return true;
+}
+
+/// count adds the number of bytes of dat within each class to class_counts[1..classCount()]. Class 0,
+/// the unassigned bytes, is not counted.
+/// @param [in] dat Byte data to be counted.
+/// @param [in] n Length of dat in bytes.
+/// @param [in,out] class_counts Table of s_MaxClasses + 1 counters, one per class.
+void CByteClasses::count(const uint8_t *dat, int64_t n, uint64_t class_counts[]) const {
+    for (int64_t off = 0; off < n; off += s_LaneFlushBytes) {
+        int64_t e = std::min(n, off + s_LaneFlushBytes);
+        uint64_t a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+        int64_t i = off;
+        for (; i + 4 <= e; i += 4) {
+            a0 += m_Lanes[dat[i + 0]];
+            a1 += m_Lanes[dat[i + 1]];
+            a2 += m_Lanes[dat[i + 2]];
+            a3 += m_Lanes[dat[i + 3]];
+        }
+        if (i < e) a0 += m_Lanes[dat[i++]];
+        if (i < e) a1 += m_Lanes[dat[i++]];
+        if (i < e) a2 += m_Lanes[dat[i++]];
+
+        for (int k = 1; k <= m_Count; k++) {
+            int s = 8 * (k - 1);
+            class_counts[k] += ((a0 >> s) & 0xff) + ((a1 >> s) & 0xff) + ((a2 >> s) & 0xff) + ((a3 >> s) & 0xff);
+        }
+    }
+}
+
+/// toString returns the scheme in the format read by parse.
+std::string CByteClasses::toString() const {
+    std::string s;
+    char buf[16];
+
+    for (int k = 1; k <= m_Count; k++) {
+        if (!s.empty()) s += ';';
+
+        bool first = true;
+        for (int c = 0; c < 256;) {
+            if (m_Class[c] != k) {
+                c++;
+                continue;
+            }
+            int e = c;
+            while (e + 1 < 256 && m_Class[e + 1] == k) e++;
+
+            if (!first) s += ',';
+            first = false;
+            if (e == c) snprintf(buf, sizeof(buf), "%02x", c);
+            else snprintf(buf, sizeof(buf), "%02x-%02x", c, e);
+            s += buf;
+            c = e + 1;
+        }
+
+        snprintf(buf, sizeof(buf), "=%06x", m_Color[k]);
+        s += buf;
+    }
+
+    return s;
+}
+
+static CByteClasses &scheme() {
+    static CByteClasses s;
+    return s;
+}
+
+/// byte_classes_scheme returns the scheme used to draw byte classes, by default CByteClasses::s_DefaultScheme.
+const CByteClasses &byte_classes_scheme() {
+    return scheme();
+}
+
+/// set_byte_classes_scheme replaces the scheme used to draw byte classes. Images already laid out keep the
+/// previous one, it must not be called while others are being laid out.
+void set_byte_classes_scheme(const CByteClasses &s) {
+    scheme() = s;
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Byte counting is limited by the store-to-load dependency when the same bin is incremented
+// repeatedly, as happens for runs of zeros. Spreading consecutive bytes over several
+// interleaved sub-histograms breaks that dependency chain; the sub-histograms are summed at
+// the end. The vector variants only widen the loads, the increments themselves stay scalar.
+
+#include <algorithm>
+#include <cstring>
+
+#include "byte_count.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BYTE_COUNT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BYTE_COUNT_TARGET(t) __attribute__((target(t)))
+#else
+#define BYTE_COUNT_TARGET(t)
+#endif
+
+using std::min;
+
+// Inputs shorter than this are counted directly, the sub-histograms are not worth clearing.
+static const int64_t s_MinInterleaved = 4096;
+
+// The 32-bit sub-histogram counters are flushed before they can overflow.
+static const int64_t s_FlushBytes = int64_t(1) << 30;
+
+typedef void (*count_fn_t)(const uint8_t *, int64_t, uint32_t (*)[256]);
+typedef uint64_t (*sum_fn_t)(const uint8_t *, int64_t);
+
+static inline void count_word(uint64_t v, uint32_t (*sub)[256]) {
+    sub[0][(v >> 0) & 0xff]++;
+    sub[1][(v >> 8) & 0xff]++;
+    sub[2][(v >> 16) & 0xff]++;
+    sub[3][(v >> 24) & 0xff]++;
+    sub[4][(v >> 32) & 0xff]++;
+    sub[5][(v >> 40) & 0xff]++;
+    sub[6][(v >> 48) & 0xff]++;
+    sub[7][(v >> 56) & 0xff]++;
+}
+
+static void count_scalar(const uint8_t *dat_u8, int64_t n, uint32_t (*sub)[256]) {
+    int64_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint64_t v1, v2;
+        memcpy(&v1, dat_u8 + i + 0, sizeof(v1));
+        memcpy(&v2, dat_u8 + i + 8, sizeof(v2));
+        count_word(v1, sub);
+        count_word(v2, sub);
+    }
+    for (; i < n; i++) {
+        sub[i & 7][dat_u8[i]]++;
+    }
+}
+
+static uint64_t sum_scalar(const uint8_t *dat_u8, int64_t n) {
+    uint64_t s = 0;
+    for (int64_t i = 0; i < n; i++) {
+        s += dat_u8[i];
+    }
+    return s;
+}
+
+#ifdef BYTE_COUNT_X86
+// The sums use psadbw against zero, which adds each 8 bytes into a 64-bit lane.
+BYTE_COUNT_TARGET("sse2")
+static uint64_t sum_sse2(const uint8_t *dat_u8, int64_t n) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    int64_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (dat_u8 + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(a, zero));
+    }
+
+    alignas(16) uint64_t lanes[2];
+    _mm_store_si128((__m128i *) lanes, acc);
+    return lanes[0] + lanes[1] + sum_scalar(dat_u8 + i, n - i);
+}
+
+BYTE_COUNT_TARGET("avx2")
+static uint64_t sum_avx2(const uint8_t *dat_u8, int64_t n) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    int64_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (dat_u8 + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(a, zero));
+    }
+
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256((__m256i *) lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar(dat_u8 + i, n - i);
+}
+
+BYTE_COUNT_TARGET("sse2")
+static void count_sse2(const uint8_t *dat_u8, int64_t n, uint32_t (*sub)[256]) {
+    int64_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (dat_u8 + i + 0));
+        __m128i b = _mm_loadu_si128((const __m128i *) (dat_u8 + i + 16));
+
+        alignas(16) uint64_t w[4];
+        _mm_store_si128((__m128i *) (w + 0), a);
+        _mm_store_si128((__m128i *) (w + 2), b);
+
+        count_word(w[0], sub);
+        count_word(w[1], sub);
+        count_word(w[2], sub);
+        count_word(w[3], sub);
+    }
+    count_scalar(dat_u8 + i, n - i, sub);
+}
+
+BYTE_COUNT_TARGET("avx2")
+static void count_avx2(const uint8_t *dat_u8, int64_t n, uint32_t (*sub)[256]) {
+    int64_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (dat_u8 + i + 0));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (dat_u8 + i + 32));
+
+        alignas(32) uint64_t w[8];
+        _mm256_store_si256((__m256i *) (w + 0), a);
+        _mm256_store_si256((__m256i *) (w + 4), b);
+
+        count_word(w[0], sub);
+        count_word(w[1], sub);
+        count_word(w[2], sub);
+        count_word(w[3], sub);
+        count_word(w[4], sub);
+        count_word(w[5], sub);
+        count_word(w[6], sub);
+        count_word(w[7], sub);
+    }
+    count_scalar(dat_u8 + i, n - i, sub);
+}
+
+static bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+static bool cpu_has_sse2() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#else
+    return false;
+#endif
+}
+#endif
+
+struct CountKernel_t {
+    count_fn_t fn;
+    sum_fn_t sum;
+    const char *name;
+};
+
+static CountKernel_t select_kernel() {
+#ifdef BYTE_COUNT_X86
+    if (cpu_has_avx2()) return {count_avx2, sum_avx2, "avx2"};
+    if (cpu_has_sse2()) return {count_sse2, sum_sse2, "sse2"};
+#endif
+    return {count_scalar, sum_scalar, "scalar"};
+}
+
+static const CountKernel_t &kernel() {
+    static const CountKernel_t k = select_kernel();
+    return k;
+}
+
+/// count_bytes_kernel_name returns the name of the byte counting kernel selected for this CPU.
+const char *count_bytes_kernel_name() {
+    return kernel().name;
+}
+
+/// count_bytes adds the number of occurrences of each byte value within dat_u8 to counts.
+/// counts is not cleared, which allows several ranges to be accumulated into the same table.
+/// @param [in] dat_u8 Byte data to be analyzed.
+/// @param [in] n Length of dat_u8 in bytes.
+/// @param [in,out] counts Table of 256 counters, one per byte value.
+void count_bytes(const uint8_t *dat_u8, int64_t n, uint64_t counts[256]) {
+    if (n <= 0) return;
+
+    if (n < s_MinInterleaved) {
+        for (int64_t i = 0; i < n; i++) {
+            counts[dat_u8[i]]++;
+        }
+        return;
+    }
+
+    count_fn_t fn = kernel().fn;
+
+    alignas(64) uint32_t sub[8][256];
+    for (int64_t off = 0; off < n; off += s_FlushBytes) {
+        memset(sub, 0, sizeof(sub));
+
+        fn(dat_u8 + off, min(s_FlushBytes, n - off), sub);
+
+        for (int i = 0; i < 256; i++) {
+            counts[i] += uint64_t(sub[0][i]) + sub[1][i] + sub[2][i] + sub[3][i] +
+                         uint64_t(sub[4][i]) + sub[5][i] + sub[6][i] + sub[7][i];
+        }
+    }
+}
+
+/// sum_bytes returns the sum of the n bytes of dat_u8.
+uint64_t sum_bytes(const uint8_t *dat_u8, int64_t n) {
+    if (n <= 0) return 0;
+    return kernel().sum(dat_u8, n);
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "byte_count.h"
+#include "byte_index.h"
+#include "parallel.h"
+
+using std::min;
+using std::max;
+
+// The block size grows with the input until the index reaches s_MaxBlocks rows, and past s_MaxBlockSize
+// it is the number of blocks that grows instead, by 1 kB of index per block. Blocks are gathered into
+// groups of s_GroupBlocks, small enough for the counts within a group to fit in 32 bits.
+static const int64_t s_MinBlockSize = 64 * 1024;
+static const int64_t s_MaxBlockSize = 4 * 1024 * 1024;
+static const int64_t s_MaxBlocks = 8192;
+static const int64_t s_GroupBlocks = 1024;
+
+/// index_block_size returns the block size picked for an index of n bytes.
+static int64_t index_block_size(int64_t n) {
+    int64_t block_size = s_MinBlockSize;
+    while ((n + block_size - 1) / block_size > s_MaxBlocks && block_size < s_MaxBlockSize) {
+        block_size *= 2;
+    }
+    return block_size;
+}
+
+CByteIndex::CByteIndex()
+        : m_Data(nullptr), m_Size(0), m_BlockSize(s_MinBlockSize), m_BlockCount(0), m_BlocksBuilt(0) {
+}
+
+/// build computes the cumulative counts of dat.
+/// @param [in] dat Byte data to be indexed, which must outlive the index.
+/// @param [in] n Length of dat in bytes.
+/// @param [in] block_size Distance between the indexed positions, or 0 to pick one based on n.
+void CByteIndex::build(const uint8_t *dat, int64_t n, int64_t block_size) {
+    begin(dat, n, block_size);
+    extend(n);
+}
+
+/// begin prepares an index of dat that is then computed incrementally by extend(), for example while
+/// the data is being read in. The index may only be queried once extend() has reached n.
+/// @param [in] dat Byte data to be indexed, which must outlive the index.
+/// @param [in] n Length of dat in bytes.
+/// @param [in] block_size Distance between the indexed positions, or 0 to pick one based on n. It is
+/// limited to the largest block size that would be picked.
+void CByteIndex::begin(const uint8_t *dat, int64_t n, int64_t block_size) {
+    clear();
+
+    if (dat == nullptr || n <= 0) {
+        return;
+    }
+
+    if (block_size <= 0) {
+        block_size = index_block_size(n);
+    }
+
+    m_Data = dat;
+    m_Size = n;
+    m_BlockSize = min(block_size, s_MaxBlockSize);
+    m_BlockCount = n / m_BlockSize;
+    m_Groups.assign((m_BlockCount / s_GroupBlocks + 1) * 256, 0);
+    m_Blocks.assign((m_BlockCount + 1) * 256, 0);
+}
+
+/// extend indexes the blocks lying entirely within the first end bytes that are not indexed yet.
+/// @param [in] end Number of leading bytes of the data that may be read.
+/// @return Number of leading bytes covered by the index, the size of the data once complete.
+int64_t CByteIndex::extend(int64_t end) {
+    if (m_Data == nullptr) {
+        return 0;
+    }
+
+    int64_t b0 = m_BlocksBuilt;
+    int64_t b1 = min(m_BlockCount, max<int64_t>(0, end) / m_BlockSize);
+
+    // Count every block into its own row, then turn the rows into a running sum that restarts at every
+    // group, carrying the group totals over to the next group row.
+    parallel_for(b1 - b0, 16, [&](int64_t b, int64_t e) {
+        for (int64_t i = b0 + b; i < b0 + e; i++) {
+            uint64_t c[256] = {0};
+            count_bytes(m_Data + i * m_BlockSize, m_BlockSize, c);
+            std::copy(c, c + 256, &m_Blocks[(i + 1) * 256]);
+        }
+    });
+
+    for (int64_t i = b0 + 1; i <= b1; i++) {
+        const uint32_t *p = &m_Blocks[(i - 1) * 256];
+        uint32_t *q = &m_Blocks[i * 256];
+        for (int j = 0; j < 256; j++) {
+            q[j] += p[j];
+        }
+
+        if (i % s_GroupBlocks == 0) {
+            const uint64_t *g = &m_Groups[(i / s_GroupBlocks - 1) * 256];
+            uint64_t *h = &m_Groups[i / s_GroupBlocks * 256];
+            for (int j = 0; j < 256; j++) {
+                h[j] = g[j] + q[j];
+                q[j] = 0;
+            }
+        }
+    }
+
+    m_BlocksBuilt = max(b0, b1);
+    return m_BlocksBuilt == m_BlockCount && end >= m_Size ? m_Size : m_BlocksBuilt * m_BlockSize;
+}
+
+void CByteIndex::clear() {
+    m_Data = nullptr;
+    m_Size = 0;
+    m_BlockCount = 0;
+    m_BlocksBuilt = 0;
+    m_Groups.clear();
+    m_Groups.shrink_to_fit();
+    m_Blocks.clear();
+    m_Blocks.shrink_to_fit();
+}
+
+bool CByteIndex::empty() const {
+    return m_Data == nullptr;
+}
+
+int64_t CByteIndex::size() const {
+    return m_Size;
+}
+
+int64_t CByteIndex::blockSize() const {
+    return m_BlockSize;
+}
+
+/// memoryUsage returns the number of bytes held by the index.
+int64_t CByteIndex::memoryUsage() const {
+    return int64_t(m_Groups.capacity() * sizeof(uint64_t) + m_Blocks.capacity() * sizeof(uint32_t));
+}
+
+/// expectedMemoryUsage returns the number of bytes held by an index of n bytes with the block size picked for it.
+int64_t CByteIndex::expectedMemoryUsage(int64_t n) {
+    if (n <= 0) return 0;
+
+    int64_t count = n / index_block_size(n);
+    return int64_t((count / s_GroupBlocks + 1) * 256 * sizeof(uint64_t) + (count + 1) * 256 * sizeof(uint32_t));
+}
+
+/// counts computes the byte histogram of [start, end) of the indexed data.
+/// @param [in] start First byte of the range.
+/// @param [in] end One past the last byte of the range.
+/// @param [out] counts Table of 256 counters, one per byte value; overwritten.
+void CByteIndex::counts(int64_t start, int64_t end, uint64_t counts[256]) const {
+    std::fill(counts, counts + 256, 0);
+
+    start = max<int64_t>(0, start);
+    end = min(m_Size, end);
+    if (start >= end) {
+        return;
+    }
+
+    int64_t b1 = (start + m_BlockSize - 1) / m_BlockSize;
+    int64_t b2 = min(m_BlockCount, end / m_BlockSize);
+
+    if (b1 >= b2) {
+        count_bytes(m_Data + start, end - start, counts);
+        return;
+    }
+
+    uint64_t p[256];
+    prefix(b1, p);
+    prefix(b2, counts);
+    for (int j = 0; j < 256; j++) {
+        counts[j] -= p[j];
+    }
+
+    count_bytes(m_Data + start, b1 * m_BlockSize - start, counts);
+    count_bytes(m_Data + b2 * m_BlockSize, end - b2 * m_BlockSize, counts);
+}
+
+/// prefix computes the byte histogram of the first block blocks of the data.
+/// @param [in] block Number of leading blocks, at most the number of blocks indexed.
+/// @param [out] counts Table of 256 counters, one per byte value; overwritten.
+void CByteIndex::prefix(int64_t block, uint64_t counts[256]) const {
+    const uint64_t *g = &m_Groups[block / s_GroupBlocks * 256];
+    const uint32_t *b = &m_Blocks[block * 256];
+    for (int j = 0; j < 256; j++) {
+        counts[j] = g[j] + b[j];
+    }
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "byte_count.h"
+#include "class_pyramid.h"
+#include "parallel.h"
+
+using std::min;
+using std::max;
+
+// Block size of the base level. The partial blocks at the ends of a range are counted from the bytes.
+static const int64_t s_BlockSize = 4096;
+
+// The levels stop at blocks of this size, whose byte sums still fit the 32-bit entries.
+static const int64_t s_MaxBlockSize = 8 << 20;
+
+// Number of base blocks worth handing to a single worker.
+static const int64_t s_MinBlocksPerWorker = 256;
+
+CClassPyramid::CClassPyramid()
+        : m_Data(nullptr), m_Size(0), m_Stride(1) {
+}
+
+/// build computes the pyramid of dat.
+/// @param [in] dat Byte data to be summarized, which must outlive the pyramid.
+/// @param [in] n Length of dat in bytes.
+/// @param [in] classes The byte classes to count.
+void CClassPyramid::build(const uint8_t *dat, int64_t n, const CByteClasses &classes) {
+    begin(dat, n, classes);
+    extend(n);
+}
+
+/// begin prepares a pyramid of dat that is then computed incrementally by extend(), for example while
+/// the data is being read in. The pyramid may only be queried once complete().
+/// @param [in] dat Byte data to be summarized, which must outlive the pyramid.
+/// @param [in] n Length of dat in bytes.
+/// @param [in] classes The byte classes to count.
+void CClassPyramid::begin(const uint8_t *dat, int64_t n, const CByteClasses &classes) {
+    clear();
+
+    if (dat == nullptr || n <= 0) {
+        return;
+    }
+
+    m_Data = dat;
+    m_Size = n;
+    m_Classes = classes;
+    m_Stride = classes.classCount() + 1;
+
+    int64_t count = (n + s_BlockSize - 1) / s_BlockSize;
+    for (int64_t bs = s_BlockSize; bs <= s_MaxBlockSize; bs *= 2) {
+        Level_t l;
+        l.count = count;
+        l.entries.assign(count * m_Stride, 0);
+        m_Levels.emplace_back(std::move(l));
+
+        if (count == 1) break;
+        count = (count + 1) / 2;
+    }
+}
+
+/// extend summarizes the blocks lying entirely within the first end bytes that are not summarized yet,
+/// and the entries of the upper levels whose blocks are then complete.
+/// @param [in] end Number of leading bytes of the data that may be read.
+/// @return Number of leading bytes covered by the pyramid, the size of the data once complete.
+int64_t CClassPyramid::extend(int64_t end) {
+    if (empty()) {
+        return 0;
+    }
+
+    Level_t &base = m_Levels[0];
+    int64_t b0 = base.built;
+    int64_t b1 = end >= m_Size ? base.count : min(base.count, max<int64_t>(0, end) / s_BlockSize);
+
+    parallel_for(b1 - b0, s_MinBlocksPerWorker, [&](int64_t b, int64_t e) {
+        for (int64_t i = b0 + b; i < b0 + e; i++) {
+            int64_t s = i * s_BlockSize;
+            int64_t len = min(s_BlockSize, m_Size - s);
+
+            uint64_t class_counts[CByteClasses::s_MaxClasses + 1] = {0};
+            m_Classes.count(m_Data + s, len, class_counts);
+
+            uint32_t *q = &base.entries[i * m_Stride];
+            q[0] = uint32_t(sum_bytes(m_Data + s, len));
+            for (int k = 1; k < m_Stride; k++) {
+                q[k] = uint32_t(class_counts[k]);
+            }
+        }
+    });
+    base.built = max(b0, b1);
+
+    // An entry is complete once both of its children are, or its only child at the end of a level.
+    for (size_t li = 1; li < m_Levels.size(); li++) {
+        const Level_t &src = m_Levels[li - 1];
+        Level_t &dst = m_Levels[li];
+
+        int64_t e = src.built == src.count ? dst.count : src.built / 2;
+        for (int64_t i = dst.built; i < e; i++) {
+            const uint32_t *a = &src.entries[(i * 2) * m_Stride];
+            uint32_t *q = &dst.entries[i * m_Stride];
+            for (int k = 0; k < m_Stride; k++) {
+                q[k] = a[k];
+            }
+            if (i * 2 + 1 < src.count) {
+                for (int k = 0; k < m_Stride; k++) {
+                    q[k] += a[m_Stride + k];
+                }
+            }
+        }
+        dst.built = max(dst.built, e);
+    }
+
+    return complete() ? m_Size : base.built * s_BlockSize;
+}
+
+void CClassPyramid::clear() {
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Stride = 1;
+    m_Levels.clear();
+}
+
+bool CClassPyramid::empty() const {
+    return m_Levels.empty();
+}
+
+/// complete returns whether every block has been summarized and the pyramid may be queried.
+bool CClassPyramid::complete() const {
+    return !empty() && m_Levels.back().built == m_Levels.back().count;
+}
+
+int64_t CClassPyramid::blockSize() const {
+    return s_BlockSize;
+}
+
+/// memoryUsage returns the number of bytes held by all levels.
+int64_t CClassPyramid::memoryUsage() const {
+    int64_t rv = 0;
+    for (const auto &l : m_Levels) {
+        rv += int64_t(l.entries.capacity() * sizeof(uint32_t));
+    }
+    return rv;
+}
+
+/// expectedMemoryUsage returns the number of bytes held by all levels of a pyramid of n bytes.
+int64_t CClassPyramid::expectedMemoryUsage(int64_t n, const CByteClasses &classes) {
+    if (n <= 0) return 0;
+
+    int64_t rv = 0;
+    int64_t count = (n + s_BlockSize - 1) / s_BlockSize;
+    for (int64_t bs = s_BlockSize; bs <= s_MaxBlockSize; bs *= 2) {
+        rv += int64_t(count * (classes.classCount() + 1) * sizeof(uint32_t));
+
+        if (count == 1) break;
+        count = (count + 1) / 2;
+    }
+    return rv;
+}
+
+/// counts computes the class counts and the byte sum of [start, end) of the data. Whole blocks are read
+/// from the coarsest levels covering them, the partial blocks at the ends are counted from the bytes.
+/// @param [in] start First byte of the range.
+/// @param [in] end One past the last byte of the range.
+/// @param [out] class_counts Optional table of CByteClasses::s_MaxClasses + 1 counters, overwritten with the
+///                           counts of classes 1..classes().classCount(). Class 0 is left at zero.
+/// @param [out] sum Optional sum of the bytes of the range.
+void CClassPyramid::counts(int64_t start, int64_t end, uint64_t *class_counts, uint64_t *sum) const {
+    if (class_counts) std::fill(class_counts, class_counts + CByteClasses::s_MaxClasses + 1, 0);
+    if (sum) *sum = 0;
+
+    start = max<int64_t>(0, start);
+    end = min(m_Size, end);
+    if (start >= end || empty()) {
+        return;
+    }
+
+    bool want_classes = class_counts != nullptr;
+    bool want_sum = sum != nullptr;
+    uint64_t acc[CByteClasses::s_MaxClasses + 1] = {0};
+
+    // The last block may be short, it is whole as soon as the range reaches the end of the data.
+    int64_t b0 = (start + s_BlockSize - 1) / s_BlockSize;
+    int64_t b1 = end == m_Size ? m_Levels[0].count : end / s_BlockSize;
+
+    if (b0 >= b1) {
+        countBytes(start, end, want_classes, want_sum, acc);
+    } else {
+        if (start < b0 * s_BlockSize) countPartial(b0 - 1, start, b0 * s_BlockSize, want_classes, want_sum, acc);
+        if (b1 * s_BlockSize < end) countPartial(b1, b1 * s_BlockSize, end, want_classes, want_sum, acc);
+
+        // Entries are taken singly at the ends where their siblings lie outside the range, the rest
+        // pair up into the level above.
+        for (size_t li = 0; b0 < b1; li++) {
+            const Level_t &l = m_Levels[li];
+            if (li + 1 == m_Levels.size()) {
+                for (int64_t i = b0; i < b1; i++) {
+                    addEntry(l, i, acc);
+                }
+                break;
+            }
+
+            if (b0 & 1) addEntry(l, b0++, acc);
+            if (b0 < b1 && (b1 & 1)) addEntry(l, --b1, acc);
+            b0 /= 2;
+            b1 /= 2;
+        }
+    }
+
+    if (sum) *sum = acc[0];
+    if (class_counts) {
+        for (int k = 1; k < m_Stride; k++) {
+            class_counts[k] = acc[k];
+        }
+    }
+}
+
+/// addEntry adds entry i of level l to acc, laid out as the entries are.
+void CClassPyramid::addEntry(const Level_t &l, int64_t i, uint64_t acc[]) const {
+    const uint32_t *q = &l.entries[i * m_Stride];
+    for (int k = 0; k < m_Stride; k++) {
+        acc[k] += q[k];
+    }
+}
+
+/// countPartial adds the counts of [start, end), part of base block b, to acc. When most of the block lies
+/// within the range, its entry is added and the rest of it counted from the bytes and subtracted instead.
+void CClassPyramid::countPartial(int64_t b, int64_t start, int64_t end, bool want_classes, bool want_sum,
+                                 uint64_t acc[]) const {
+    int64_t s = b * s_BlockSize;
+    int64_t e = min(m_Size, s + s_BlockSize);
+    if (2 * (end - start) <= e - s) {
+        countBytes(start, end, want_classes, want_sum, acc);
+        return;
+    }
+
+    uint64_t outside[CByteClasses::s_MaxClasses + 1] = {0};
+    countBytes(s, start, want_classes, want_sum, outside);
+    countBytes(end, e, want_classes, want_sum, outside);
+
+    addEntry(m_Levels[0], b, acc);
+    for (int k = 0; k < m_Stride; k++) {
+        acc[k] -= outside[k];
+    }
+}
+
+/// countBytes adds the byte sum and the class counts of [start, end), counted from the bytes, to acc,
+/// laid out as the entries are.
+void CClassPyramid::countBytes(int64_t start, int64_t end, bool want_classes, bool want_sum, uint64_t acc[]) const {
+    if (start >= end) return;
+    if (want_classes) m_Classes.count(m_Data + start, end - start, acc);
+    if (want_sum) acc[0] += sum_bytes(m_Data + start, end - start);
+}
@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// binvis-cli runs the analyses of the viewer over many files without a display, writing the results
+// for further processing. Files are handed out to a pool of worker threads. Each file is mapped and
+// passed in chunks to the streaming accumulators, so the memory held by the analyses does not depend
+// on the file size.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "array_io.h"
+#include "byte_classes.h"
+#include "dot_plot_calc.h"
+#include "histogram_calc.h"
+#include "mapped_file.h"
+#include "overview.h"
+#include "parallel.h"
+
+using std::max;
+using std::min;
+using std::string;
+using std::vector;
+
+// Size of the chunks the accumulators are fed with.
+static const int64_t s_FeedChunk = int64_t(64) << 20;
+
+enum class OutFormat_t {
+    NPY,
+    CSV,
+    PNG
+};
+
+struct CliOptions_t {
+    vector<string> files;
+    string outDir = ".";
+    OutFormat_t format = OutFormat_t::NPY;
+    int jobs = 0;
+
+    bool entropy = false;
+    bool histo = false;
+    bool histo2d = false;
+    bool histo3d = false;
+    bool overview = false;
+    bool dotPlot = false;
+
+    HistoDtype_t dtype = HistoDtype_t::U8;
+    bool overlap = true;
+    int64_t entropyWindow = 256;
+    int64_t entropyStep = 0;
+
+    int overviewWidth = 256;
+    int overviewHeight = 1024;
+    bool byteClasses = true;
+    bool hilbert = true;
+
+    int dotPlotSize = 512;
+    int dotPlotSamples = 10;
+    uint32_t seed = 1;
+};
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options] <file>...\n"
+            "\n"
+            "Analyses, all of them if none is selected:\n"
+            "  --entropy             entropy of each window of the file\n"
+            "  --histo               byte histogram, as raw counts\n"
+            "  --histo2d             2d histogram of consecutive elements\n"
+            "  --histo3d             sparse 3d histogram, as rows of a1, a2, a3, count\n"
+            "  --overview            overview image\n"
+            "  --dotplot             dot plot image\n"
+            "\n"
+            "Options:\n"
+            "  -o, --output <dir>    directory for the results, default '.'. The results of each file\n"
+            "                        keep its path below the directory shared by all the files.\n"
+            "  -f, --format <fmt>    npy (default), csv or png. Results without a csv form are\n"
+            "                        written as png and results without a png form as csv.\n"
+            "  -j, --jobs <n>        number of files analyzed concurrently, default the core count\n"
+            "  --dtype <type>        element type of the histograms: U8 (default), U12, U16, U32,\n"
+            "                        U64, F32, F64, F32_BITS or F64_BITS\n"
+            "  --no-overlap          3d histogram of non-overlapping trigrams\n"
+            "  --window <n>          entropy window in bytes, default 256\n"
+            "  --step <n>            distance between entropy windows, default the window size\n"
+            "  --size <w>x<h>        maximum overview size, default 256x1024\n"
+            "  --no-byte-classes     overview of average byte values instead of byte classes\n"
+            "  --classes <scheme>    byte classes of the overview, as <bytes>=<rrggbb> separated by ';',\n"
+            "                        default '01-1f=0000f0;20-7f=00f000;80-fe=f00000;ff=ffffff'\n"
+            "  --no-hilbert          overview laid out row by row instead of along a Hilbert curve\n"
+            "  --dot-size <n>        maximum dot plot size, default 512\n"
+            "  --dot-samples <n>     samples per dot plot cell, default 10\n"
+            "  --seed <n>            seed of the dot plot sampling, default 1\n",
+            argv0);
+}
+
+static bool parse_int(const char *s, int64_t lo, int64_t hi, int64_t &v) {
+    char *end = nullptr;
+    long long x = strtoll(s, &end, 10);
+    if (end == s || *end != '\0' || x < lo || x > hi) {
+        fprintf(stderr, "Invalid value '%s', expected an integer in [%lld, %lld]\n", s, (long long) lo, (long long) hi);
+        return false;
+    }
+    v = x;
+    return true;
+}
+
+static HistoDtype_t parse_dtype(const string &s) {
+    HistoDtype_t t = string_to_histo_dtype(s);
+    const string suffix = "_BITS";
+    if (t == HistoDtype_t::NONE && s.size() > suffix.size() &&
+        s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        t = string_to_histo_dtype(s.substr(0, s.size() - suffix.size()) + " Bits");
+    }
+    return t;
+}
+
+static bool parse_args(int argc, char *argv[], CliOptions_t &opt) {
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        bool has_value = i + 1 < argc;
+        int64_t v;
+
+        auto value = [&]() -> const char * {
+            return has_value ? argv[++i] : nullptr;
+        };
+
+        if (a == "--entropy") opt.entropy = true;
+        else if (a == "--histo") opt.histo = true;
+        else if (a == "--histo2d") opt.histo2d = true;
+        else if (a == "--histo3d") opt.histo3d = true;
+        else if (a == "--overview") opt.overview = true;
+        else if (a == "--dotplot") opt.dotPlot = true;
+        else if (a == "--no-overlap") opt.overlap = false;
+        else if (a == "--no-byte-classes") opt.byteClasses = false;
+        else if (a == "--no-hilbert") opt.hilbert = false;
+        else if (a == "-h" || a == "--help") return false;
+        else if (a.size() > 1 && a[0] == '-' && !has_value) {
+            fprintf(stderr, "Missing value for '%s'\n", a.c_str());
+            return false;
+        } else if (a == "-o" || a == "--output") {
+            opt.outDir = value();
+        } else if (a == "-f" || a == "--format") {
+            string f = value();
+            if (f == "npy") opt.format = OutFormat_t::NPY;
+            else if (f == "csv") opt.format = OutFormat_t::CSV;
+            else if (f == "png") opt.format = OutFormat_t::PNG;
+            else {
+                fprintf(stderr, "Unknown format '%s'\n", f.c_str());
+                return false;
+            }
+        } else if (a == "-j" || a == "--jobs") {
+            if (!parse_int(value(), 1, 1024, v)) return false;
+            opt.jobs = int(v);
+        } else if (a == "--dtype") {
+            string d = value();
+            opt.dtype = parse_dtype(d);
+            if (opt.dtype == HistoDtype_t::NONE) {
+                fprintf(stderr, "Unknown dtype '%s'\n", d.c_str());
+                return false;
+            }
+        } else if (a == "--window") {
+            if (!parse_int(value(), 1, int64_t(1) << 30, opt.entropyWindow)) return false;
+        } else if (a == "--step") {
+            if (!parse_int(value(), 1, int64_t(1) << 30, opt.entropyStep)) return false;
+        } else if (a == "--size") {
+            int w, h;
+            char c;
+            if (sscanf(value(), "%dx%d%c", &w, &h, &c) != 2 || w <= 0 || h <= 0 || int64_t(w) * h > (int64_t(1) << 28)) {
+                fprintf(stderr, "Invalid size '%s', expected <w>x<h>\n", argv[i]);
+                return false;
+            }
+            opt.overviewWidth = w;
+            opt.overviewHeight = h;
+        } else if (a == "--classes") {
+            CByteClasses classes;
+            if (!classes.parse(value())) return false;
+            set_byte_classes_scheme(classes);
+        } else if (a == "--dot-size") {
+            if (!parse_int(value(), 1, 8192, v)) return false;
+            opt.dotPlotSize = int(v);
+        } else if (a == "--dot-samples") {
+            if (!parse_int(value(), 1, 1 << 20, v)) return false;
+            opt.dotPlotSamples = int(v);
+        } else if (a == "--seed") {
+            if (!parse_int(value(), 0, UINT32_MAX, v)) return false;
+            opt.seed = uint32_t(v);
+        } else if (a.size() > 1 && a[0] == '-') {
+            fprintf(stderr, "Unknown option '%s'\n", a.c_str());
+            return false;
+        } else {
+            opt.files.push_back(a);
+        }
+    }
+
+    if (!(opt.entropy || opt.histo || opt.histo2d || opt.histo3d || opt.overview || opt.dotPlot)) {
+        opt.entropy = opt.histo = opt.histo2d = opt.histo3d = opt.overview = opt.dotPlot = true;
+    }
+
+    return !opt.files.empty();
+}
+
+/// CFileAnalysis runs the selected analyses over a single file.
+class CFileAnalysis {
+public:
+    CFileAnalysis(const CliOptions_t &opt, const string &filename, const string &prefix)
+            : m_Options(opt), m_Filename(filename), m_Prefix(prefix), m_Bytes(HistoDtype_t::U8) {
+        if (opt.entropy) m_Entropy.reset(new CEntropyAccum(opt.entropyWindow, opt.entropyStep));
+        if (opt.histo) m_Histo.reset(new CHistoAccum(opt.dtype));
+        if (opt.histo2d) m_Histo2D.reset(new CHisto2DAccum(opt.dtype));
+        if (opt.histo3d) m_Histo3D.reset(new CHisto3DAccum(opt.dtype, opt.overlap));
+    }
+
+    bool run();
+
+protected:
+    bool read();
+    void feed(const uint8_t *dat, int64_t n);
+    bool writeResults();
+    string outName(const char *kind, const char *ext) const { return m_Prefix + "." + kind + "." + ext; }
+
+    template<class T>
+    bool writeArray(const char *kind, const T *dat, int64_t rows, int64_t cols);
+    bool writeImage(const char *kind, const uint32_t *argb, int w, int h);
+
+    const CliOptions_t &m_Options;
+    string m_Filename;
+    string m_Prefix;
+
+    CMappedFile m_File;
+
+    CHistoAccum m_Bytes;
+    std::unique_ptr<CEntropyAccum> m_Entropy;
+    std::unique_ptr<CHistoAccum> m_Histo;
+    std::unique_ptr<CHisto2DAccum> m_Histo2D;
+    std::unique_ptr<CHisto3DAccum> m_Histo3D;
+};
+
+bool CFileAnalysis::run() {
+    if (!read()) {
+        fprintf(stderr, "Unable to open '%s'\n", m_Filename.c_str());
+        return false;
+    }
+
+    bool ok = writeResults();
+
+    double entropy = histo_entropy(m_Bytes.counts());
+    printf("%s: %lld bytes, entropy %.4f bits/byte%s\n", m_Filename.c_str(), (long long) m_File.size(), entropy,
+           ok ? "" : ", failed to write some results");
+    return ok;
+}
+
+void CFileAnalysis::feed(const uint8_t *dat, int64_t n) {
+    m_Bytes.feed(dat, n);
+    if (m_Entropy) m_Entropy->feed(dat, n);
+    if (m_Histo) m_Histo->feed(dat, n);
+    if (m_Histo2D) m_Histo2D->feed(dat, n);
+    if (m_Histo3D) m_Histo3D->feed(dat, n);
+}
+
+bool CFileAnalysis::read() {
+    if (!m_File.open(m_Filename)) {
+        return false;
+    }
+
+    m_File.advise(CMappedFile::Access_t::SEQUENTIAL);
+
+    for (int64_t i = 0; i < m_File.size(); i += s_FeedChunk) {
+        feed(m_File.data() + i, min(s_FeedChunk, m_File.size() - i));
+    }
+    return true;
+}
+
+template<class T>
+bool CFileAnalysis::writeArray(const char *kind, const T *dat, int64_t rows, int64_t cols) {
+    if (m_Options.format == OutFormat_t::NPY) {
+        vector<int64_t> shape = {rows};
+        if (cols > 1) shape.push_back(cols);
+        return write_npy(outName(kind, "npy"), dat, shape);
+    }
+    return write_csv(outName(kind, "csv"), dat, rows, cols);
+}
+
+bool CFileAnalysis::writeImage(const char *kind, const uint32_t *argb, int w, int h) {
+    if (m_Options.format == OutFormat_t::NPY) {
+        vector<uint8_t> rgb(int64_t(w) * h * 3);
+        for (int64_t i = 0; i < int64_t(w) * h; i++) {
+            rgb[i * 3 + 0] = argb[i] >> 16;
+            rgb[i * 3 + 1] = argb[i] >> 8;
+            rgb[i * 3 + 2] = argb[i] >> 0;
+        }
+        return write_npy(outName(kind, "npy"), rgb.data(), {h, w, 3});
+    }
+    return write_png(outName(kind, "png"), argb, w, h);
+}
+
+bool CFileAnalysis::writeResults() {
+    bool ok = true;
+
+    if (m_Entropy) {
+        int64_t len = 0;
+        float *dd = m_Entropy->finish(len);
+        ok = writeArray("entropy", dd, len, 1) && ok;
+        delete[] dd;
+    }
+
+    if (m_Histo) {
+        ok = writeArray("histo", m_Histo->counts(), 256, 1) && ok;
+    }
+
+    if (m_Histo2D) {
+        int *hist = m_Histo2D->finish();
+        if (m_Options.format == OutFormat_t::PNG) {
+            // Log scaled, so that the less frequent digrams remain visible.
+            int mx = *std::max_element(hist, hist + 256 * 256);
+            double sf = mx > 0 ? 255. / std::log1p(double(mx)) : 0.;
+            vector<uint32_t> img(256 * 256);
+            for (int i = 0; i < 256 * 256; i++) {
+                uint32_t c = uint32_t(std::log1p(double(hist[i])) * sf + .5);
+                img[i] = 0xff000000u | (c << 16) | (c << 8) | (c << 0);
+            }
+            ok = writeImage("histo2d", img.data(), 256, 256) && ok;
+        } else {
+            ok = writeArray("histo2d", (const int32_t *) hist, 256, 256) && ok;
+        }
+        delete[] hist;
+    }
+
+    if (m_Histo3D) {
+        SparseHisto3D_t hist;
+        m_Histo3D->finish(hist);
+        vector<uint64_t> rows;
+        rows.reserve(hist.size() * 4);
+        for (const auto &t : hist) {
+            rows.push_back((t.index >> 16) & 0xff);
+            rows.push_back((t.index >> 8) & 0xff);
+            rows.push_back((t.index >> 0) & 0xff);
+            rows.push_back(t.count);
+        }
+        ok = writeArray("histo3d", rows.data(), int64_t(hist.size()), 4) && ok;
+    }
+
+    if (m_Options.overview && m_File.size() > 0) {
+        vector<uint32_t> img;
+        int w, h;
+        render_overview(m_File.data(), m_File.size(), m_Options.overviewWidth, m_Options.overviewHeight,
+                        m_Options.byteClasses, m_Options.hilbert, img, w, h);
+        ok = writeImage("overview", img.data(), w, h) && ok;
+    }
+
+    if (m_Options.dotPlot && m_File.size() > 0) {
+        int mat_max = m_Options.dotPlotSize;
+        vector<int> mat(int64_t(mat_max) * mat_max);
+        int n = generate_dot_plot(m_File.data(), m_File.size(), mat_max, m_Options.dotPlotSamples, m_Options.seed, mat.data());
+        if (m_Options.format == OutFormat_t::NPY) {
+            ok = writeArray("dotplot", (const int32_t *) mat.data(), n, n) && ok;
+        } else if (n > 0) {
+            vector<uint32_t> img(int64_t(n) * n);
+            dot_plot_image(mat.data(), n, img.data());
+            ok = writeImage("dotplot", img.data(), n, n) && ok;
+        }
+    }
+
+    return ok;
+}
+
+/// Returns the output prefix of each file, its path below the deepest directory shared by all the files
+/// mirrored under the output directory. Files of the same name from different directories thus do not
+/// overwrite each other's results, while a single file keeps the plain <dir>/<name> prefix.
+static vector<string> output_prefixes(const string &outDir, const vector<string> &files) {
+    namespace fs = std::filesystem;
+
+    vector<fs::path> paths;
+    for (const auto &f : files) {
+        std::error_code ec;
+        fs::path p = fs::absolute(f, ec);
+        paths.push_back((ec ? fs::path(f) : p).lexically_normal());
+    }
+
+    fs::path base = paths.empty() ? fs::path() : paths[0].parent_path();
+    for (const auto &p : paths) {
+        fs::path dir = p.parent_path(), common;
+        for (auto i = base.begin(), j = dir.begin(); i != base.end() && j != dir.end() && *i == *j; ++i, ++j) {
+            common /= *i;
+        }
+        base = common;
+    }
+
+    vector<string> prefixes;
+    std::set<string> used;
+    for (const auto &p : paths) {
+        fs::path rel = base.empty() ? p.relative_path() : p.lexically_relative(base);
+        string prefix = (fs::path(outDir) / rel).string();
+
+        // The same file given more than once.
+        string unique = prefix;
+        for (int k = 2; !used.insert(unique).second; k++) {
+            unique = prefix + "-" + std::to_string(k);
+        }
+        prefixes.push_back(unique);
+    }
+    return prefixes;
+}
+
+int main(int argc, char *argv[]) {
+    CliOptions_t opt;
+    if (!parse_args(argc, argv, opt)) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    vector<string> prefixes = output_prefixes(opt.outDir, opt.files);
+
+    std::set<std::filesystem::path> dirs;
+    for (const auto &p : prefixes) dirs.insert(std::filesystem::path(p).parent_path());
+    for (const auto &d : dirs) {
+        std::error_code ec;
+        std::filesystem::create_directories(d, ec);
+        if (ec) {
+            fprintf(stderr, "Unable to create '%s': %s\n", d.string().c_str(), ec.message().c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int64_t n = opt.files.size();
+    int workers = parallel_worker_count(n, 1, opt.jobs);
+
+    std::atomic<int64_t> next(0);
+    std::atomic<int64_t> failed(0);
+
+    parallel_run(workers, [&](int) {
+        for (int64_t i = next++; i < n; i = next++) {
+            CFileAnalysis a(opt, opt.files[i], prefixes[i]);
+            if (!a.run()) failed++;
+        }
+    });
+
+    if (failed > 0) {
+        fprintf(stderr, "%lld of %lld files failed\n", (long long) failed.load(), (long long) n);
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
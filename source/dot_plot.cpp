@@ -17,8 +17,9 @@
  *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <vector>
 #include <algorithm>
+#include <climits>
+#include <random>
 
 #include <QtGui>
 #include <QGridLayout>
@@ -26,32 +27,17 @@
 #include <QComboBox>
 #include <QPushButton>
 
-#include <stdlib.h>
-
 #include "dot_plot.h"
+#include "dot_plot_calc.h"
 #include "main_app.h"
 
 using std::max;
 using std::min;
-using std::vector;
-using std::shuffle;
-using std::pair;
-using std::make_pair;
-
-#if defined(_WIN32)
-// For MSVC x86, x64, and 32/64-bit ARM
-//  MSVC lacks the random() function so we will wrap rand
-//  to provide random values for these targets since this
-//  program is not providing any cryptographic functions.
-//  TODO consider replacing with <random> from C++ 11.
-long random() { return rand(); }
-#endif
 
 CDotPlot::CDotPlot(QWidget *p)
         : QLabel(p),
           m_Data(nullptr), m_Size(0),
-          m_Material(nullptr), m_MaterialMaxSize(0), m_MaterialSize(0),
-          m_PointsIndex(0) {
+          m_Material(nullptr), m_MaterialMaxSize(0), m_MaterialSize(0) {
     {
         auto layout = new QGridLayout(this);
         int r = 0;
@@ -189,11 +175,13 @@ void CDotPlot::setData(const quint8 *dat, qsizetype n) {
     m_Data = dat;
     m_Size = n;
 
-    m_Offset1->setRange(0, m_Size);
-    m_Offset2->setRange(0, m_Size);
-    m_Width->setRange(1, m_Size);
+    // QSpinBox holds ints, the maximum width stands for the whole selection when it is larger.
+    int max_n = int(min<qsizetype>(m_Size, INT_MAX));
+    m_Offset1->setRange(0, max_n);
+    m_Offset2->setRange(0, max_n);
+    m_Width->setRange(1, max_n);
 
-    m_Width->setValue(m_Size);
+    m_Width->setValue(max_n);
 
     // parameters_changed() triggered by the previous setValue() call.
     // parameters_changed();
@@ -201,192 +189,37 @@ void CDotPlot::setData(const quint8 *dat, qsizetype n) {
 
 void CDotPlot::parametersChanged() {
     std::random_device rd;
-    std::mt19937 g(rd());
 
     puts("called");
 
-    qsizetype mdw = min(m_Size, (qsizetype)m_Width->value());
-    int bs = int(mdw / m_MaterialMaxSize) + ((mdw % m_MaterialMaxSize) > 0 ? 1 : 0);
+    qsizetype mdw = m_Width->value() == m_Width->maximum() ? m_Size : min(m_Size, (qsizetype)m_Width->value());
+    int64_t bs = dot_plot_block_size(mdw, m_MaterialMaxSize);
     m_MaterialSize = 0;
 
     if (m_Size > 0) {
-        m_MaterialSize = min(int(mdw / bs), m_MaterialMaxSize);
-        printf("Setting max to: '%d'\n", bs);
-        m_MaxSamples->setMaximum(bs);
+        printf("Setting max to: '%lld'\n", (long long) bs);
+        m_MaxSamples->setMaximum(int(min<int64_t>(bs, INT_MAX)));
     }
 
-    int mul = bs * m_MaterialSize;
+    m_MaterialSize = generate_dot_plot(m_Data, mdw, m_MaterialMaxSize, m_MaxSamples->value(), rd(), m_Material);
+
+    long long mul = bs * m_MaterialSize;
 
-    printf("%s(%lld) %s(%lld) %s(%d) %s(%d) %s(%d) %s(%d)\n",
+    printf("%s(%lld) %s(%lld) %s(%d) %s(%lld) %s(%d) %s(%lld)\n",
         NAMEOF(m_Size), m_Size, 
         NAMEOF(mdw), mdw, 
         NAMEOF(m_MaterialMaxSize), m_MaterialMaxSize, 
-        NAMEOF(bs), bs,
+        NAMEOF(bs), (long long) bs,
         NAMEOF(m_MaterialSize), m_MaterialSize,
         NAMEOF(mul), mul);
 
-    memset(m_Material, 0, sizeof(m_Material[0]) * m_MaterialMaxSize * m_MaterialMaxSize);
-
-    m_Points.clear();
-    m_Points.reserve(m_MaterialSize * m_MaterialSize);
-#if 1
-    for (int i = 0; i < m_MaterialSize; i++) {
-        for (int j = i; j < m_MaterialSize; j++) {
-            m_Points.emplace_back(make_pair(i, j));
-        }
-    }
-#else
-    for (int i = 0; i < mat_n_; i++) {
-        pts_.emplace_back(make_pair(i, mat_n_-i-1));
-//        pts_.emplace_back(make_pair(i, i));
-    }
-#endif
-    shuffle(m_Points.begin(), m_Points.end(), g);
-
-    {
-//        float sf = 1.f;
-//        if (mwh < mdw) {
-//            sf = mwh / float(mdw);
-//        }
-//
-//        int xyn = 1 / sf + 1;
-
-//        printf("min(width(), height()): %d mwh:%d mdw:%d dat_n:%d sf:%f xyn:%d", min(width(), height()), mwh, mdw, dat_n_, sf, xyn);
-
-
-//        printf("pts_.size(): %d sf: %f\n", pts_.size(), sf);
-        // pts_i_ is decremented in advance_mat()
-        m_PointsIndex = m_Points.size();
-        int ii = 0;
-        // Precompute some random values for sampling
-        std::vector<pair<int, int> > random;
-        while (m_PointsIndex > 0) {
-            if ((ii++ % 100) == 0) {
-                {
-                    int n = min(m_MaxSamples->value(), bs);
-//            n = n * n;
-                    random.clear();
-                    random.reserve(n);
-                    printf("Generating '%d' points in range [0, %d-1] along the diagonal axis\n", n, bs);
-                    for (int tt = 0; tt < n; tt++) {
-                        int a = rand() % bs;
-                        random.emplace_back(make_pair(a, a));
-                    }
-                    int n2 = min(m_MaxSamples->value(), bs * bs - bs);
-                    printf("Generating '%d' points in range [0, %d-1] off the diagonal axis\n", n2, bs);
-                    for (int tt = 0; tt < n2;) {
-                        int a = rand() % bs;
-                        int b = rand() % bs;
-                        if (a == b) continue;
-                        random.emplace_back(make_pair(a, b));
-                        tt++;
-                    }
-//            for (int tt = 0; tt < n; tt++) {
-//                rand.emplace_back(make_pair(random() % bs, random() % bs));
-//            }
-                }
-            }
-
-
-//            random_shuffle(rand.begin(), rand.end());
-            advanceMat(bs, random);
-        }
-    }
     regenImage();
 }
 
-void CDotPlot::advanceMat(int bs, const vector<pair<int, int> > &rand) {
-    if (m_PointsIndex == 0 || m_Points.empty()) return;
-
-    m_PointsIndex--;
-    pair<int, int> pt = m_Points[m_PointsIndex];
-
-    int x = pt.first;
-    int y = pt.second;
-
-    int xo = x * bs;
-    int yo = y * bs;
-
-    if (true) {
-//        for (int tt = 0; tt < bs; tt++) {
-//            int i = xo + tt;
-//            int j = yo + tt;
-//
-//            if (dat_[i] == dat_[j]) {
-//                int ii = y * mat_n_ + x;
-//                int jj = x * mat_n_ + y;
-//                if (0 <= ii && ii < mat_n_ * mat_n_) mat_[ii]++;
-//                if (0 <= jj && jj < mat_n_ * mat_n_) mat_[jj]++;
-//            }
-////            printf("%d %d %d %d %d %d %d %d\n", xo, yo, tt, rand[tt], i, j, dat_[i], dat_[j]);
-//        }
-        for (int tt = 0; tt < rand.size(); tt++) {
-            int i = xo + rand[tt].first;
-            int j = yo + rand[tt].second;
-//            int i = xo + (random() % bs);
-//            int j = yo + (random() % bs);
-
-            if (m_Data[i] == m_Data[j]) {
-                int ii = y * m_MaterialSize + x;
-                int jj = x * m_MaterialSize + y;
-                if (0 <= ii && ii < m_MaterialSize * m_MaterialSize) m_Material[ii]++;
-                if (0 <= jj && jj < m_MaterialSize * m_MaterialSize) m_Material[jj]++;
-            }
-//            printf("%d %d %d %d %d %d %d %d\n", xo, yo, tt, rand[tt], i, j, dat_[i], dat_[j]);
-        }
-    } else {
-        for (int tt1 = 0; tt1 < bs; tt1++) {
-            for (int tt2 = 0; tt2 < bs; tt2++) {
-                int i = xo + tt1;
-                int j = yo + tt2;
-
-                if (m_Data[i] == m_Data[j]) {
-                    int ii = y * m_MaterialSize + x;
-                    int jj = x * m_MaterialSize + y;
-                    if (0 <= ii && ii < m_MaterialSize * m_MaterialSize) m_Material[ii]++;
-//                    else abort();
-                    if (0 <= jj && jj < m_MaterialSize * m_MaterialSize) m_Material[jj]++;
-//                    else abort();
-                }
-                printf("%d %d %d %d %d %d %u %u\n", xo, yo, tt1, tt2, i, j, m_Data[i], m_Data[j]);
-            }
-        }
-    }
-}
-
 void CDotPlot::regenImage() {
-    // Find the maximum value, ignoring the diagonal.
-    // Could stop the search once m = max_samples_->value()
-    int m = 0;
-    for (int j = 0; j < m_MaterialSize; j++) {
-        for (int i = 0; i < j; i++) {
-            int k = j * m_MaterialSize + i;
-            if (m < m_Material[k]) m = m_Material[k];
-        }
-        for (int i = j + 1; i < m_MaterialSize; i++) {
-            int k = j * m_MaterialSize + i;
-            if (m < m_Material[k]) m = m_Material[k];
-        }
-    }
-
-    printf("max(1): %d\n", m);
-    if (true) {
-        // Brighten image
-        m = max(1, int(m * .75));
-        printf("max(2): %d\n", m);
-    }
-
     QImage img(m_MaterialSize, m_MaterialSize, QImage::Format_RGB32);
     img.fill(0);
-    auto p = (unsigned int *) img.bits();
-    for (int i = 0; i < m_MaterialSize * m_MaterialSize; i++) {
-        int c = min(255, int(m_Material[i] / float(m) * 255. + .5));
-        unsigned char r = c;
-        unsigned char g = c;
-        unsigned char b = c;
-        unsigned int v = 0xff000000 | (r << 16) | (g << 8) | (b << 0);
-        *p++ = v;
-    }
+    dot_plot_image(m_Material, m_MaterialSize, (uint32_t *) img.bits());
 
     if (!g_currentfile.isEmpty())
     {
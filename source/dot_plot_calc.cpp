@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <cstring>
+
+#include "dot_plot_calc.h"
+
+using std::max;
+using std::min;
+using std::pair;
+using std::vector;
+
+/// dot_plot_block_size returns the number of bytes along each side of a dot plot cell.
+/// @param [in] n Number of bytes being plotted.
+/// @param [in] mat_max Maximum number of cells along each side of the plot.
+int64_t dot_plot_block_size(int64_t n, int mat_max) {
+    if (n <= 0 || mat_max <= 0) return 0;
+    return n / mat_max + (n % mat_max > 0 ? 1 : 0);
+}
+
+/// generate_dot_plot estimates the self-similarity of dat. The bytes are split into blocks of
+/// dot_plot_block_size(n, mat_max) bytes, and each pair of blocks is compared at randomly sampled
+/// offsets, max_samples along the diagonal and max_samples off of it. Matching bytes increment the
+/// cells of both orderings of the pair, so the matrix is symmetric.
+/// @param [in] dat Byte data to be analyzed.
+/// @param [in] n Length of dat in bytes.
+/// @param [in] mat_max Maximum number of cells along each side of the plot.
+/// @param [in] max_samples Number of offsets sampled per block pair, on and off the diagonal.
+/// @param [in] seed Seed of the random sampling; the same seed gives the same plot.
+/// @param [out] mat Matrix of at least mat_max * mat_max cells, the first mat_n * mat_n of which are filled.
+/// @return mat_n, the number of cells along each side of the plot.
+int generate_dot_plot(const uint8_t *dat, int64_t n, int mat_max, int max_samples, uint32_t seed, int *mat) {
+    int64_t bs = dot_plot_block_size(n, mat_max);
+    if (bs == 0) return 0;
+
+    int mat_n = int(min<int64_t>(n / bs, mat_max));
+    memset(mat, 0, sizeof(mat[0]) * mat_max * mat_max);
+
+    std::mt19937 g(seed);
+
+    vector<pair<int, int> > points;
+    points.reserve(int64_t(mat_n) * (mat_n + 1) / 2);
+    for (int i = 0; i < mat_n; i++) {
+        for (int j = i; j < mat_n; j++) {
+            points.emplace_back(i, j);
+        }
+    }
+    std::shuffle(points.begin(), points.end(), g);
+
+    // The sampled offsets are redrawn every so many block pairs.
+    const size_t redraw = 100;
+
+    vector<pair<int64_t, int64_t> > offsets;
+    for (size_t pi = 0; pi < points.size(); pi++) {
+        if (pi % redraw == 0) {
+            offsets.clear();
+
+            std::uniform_int_distribution<int64_t> u(0, bs - 1);
+            int64_t n1 = min<int64_t>(max_samples, bs);
+            for (int64_t k = 0; k < n1; k++) {
+                int64_t a = u(g);
+                offsets.emplace_back(a, a);
+            }
+            // bs * (bs - 1) off-diagonal offsets exist, more than max_samples for any bs above 65536.
+            int64_t n2 = bs > 65536 ? max_samples : min<int64_t>(max_samples, bs * bs - bs);
+            for (int64_t k = 0; k < n2;) {
+                int64_t a = u(g);
+                int64_t b = u(g);
+                if (a == b) continue;
+                offsets.emplace_back(a, b);
+                k++;
+            }
+        }
+
+        int x = points[pi].first;
+        int y = points[pi].second;
+        const uint8_t *xo = dat + x * bs;
+        const uint8_t *yo = dat + y * bs;
+
+        int hits = 0;
+        for (const auto &o : offsets) {
+            hits += xo[o.first] == yo[o.second];
+        }
+        mat[y * mat_n + x] += hits;
+        mat[x * mat_n + y] += hits;
+    }
+
+    return mat_n;
+}
+
+/// dot_plot_image converts a dot plot to grey levels, scaled so that 75% of the largest count off the
+/// diagonal is white.
+/// @param [in] mat Matrix of mat_n * mat_n cells, as filled by generate_dot_plot.
+/// @param [in] mat_n Number of cells along each side of the plot.
+/// @param [out] img The image, as mat_n * mat_n pixels of 0xAARRGGBB.
+void dot_plot_image(const int *mat, int mat_n, uint32_t *img) {
+    int m = 0;
+    for (int j = 0; j < mat_n; j++) {
+        for (int i = 0; i < mat_n; i++) {
+            if (i != j) m = max(m, mat[j * mat_n + i]);
+        }
+    }
+
+    // Brighten image
+    m = max(1, int(m * .75));
+
+    for (int i = 0; i < mat_n * mat_n; i++) {
+        uint32_t c = min(255, int(mat[i] / float(m) * 255. + .5));
+        img[i] = 0xff000000u | (c << 16) | (c << 8) | (c << 0);
+    }
+}
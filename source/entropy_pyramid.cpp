@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "entropy_pyramid.h"
+#include "histogram_calc.h"
+#include "parallel.h"
+
+using std::min;
+using std::max;
+
+// Number of base blocks handed to a worker at a time, also the granularity of cancellation.
+static const int64_t s_BlocksPerTask = 64 * 1024;
+
+// Target number of pyramid entries read for each output point of sample().
+static const int s_EntriesPerPoint = 8;
+
+CEntropyPyramid::CEntropyPyramid()
+        : m_Size(0), m_BlockSize(256) {
+}
+
+/// build computes the base level, the entropy of each bs-sized block of dat, and every reduction above it.
+/// @param [in] dat Byte data to be analyzed.
+/// @param [in] n Length of dat in bytes.
+/// @param [in] bs The block size of the base level.
+/// @param [in] cancel Optional flag polled while building, the build is abandoned once it is set.
+/// @return False if the build was cancelled, in which case the pyramid is left empty.
+bool CEntropyPyramid::build(const uint8_t *dat, int64_t n, int64_t bs, const std::atomic<bool> *cancel) {
+    clear();
+
+    if (dat == nullptr || n <= 0 || bs <= 0) {
+        return true;
+    }
+
+    int64_t nb = (n + bs - 1) / bs;
+
+    Level_t base;
+    base.mean.resize(nb);
+
+    std::atomic<int64_t> next(0);
+    std::atomic<bool> cancelled(false);
+    parallel_run(parallel_worker_count(nb, s_BlocksPerTask), [&](int) {
+        for (;;) {
+            int64_t b = next.fetch_add(s_BlocksPerTask);
+            if (b >= nb) break;
+            if (cancel && cancel->load()) {
+                cancelled = true;
+                break;
+            }
+
+            int64_t e = min(nb, b + s_BlocksPerTask);
+            int64_t len;
+            float *dd = generate_entropy(dat + b * bs, min(n, e * bs) - b * bs, len, bs);
+            for (int64_t i = 0; i < len; i++) {
+                base.mean[b + i] = uint16_t(min(1.f, dd[i]) * 65535.f + .5f);
+            }
+            delete[] dd;
+        }
+    });
+
+    if (cancelled) {
+        return false;
+    }
+
+    m_Size = n;
+    m_BlockSize = bs;
+    m_Levels.emplace_back(std::move(base));
+
+    // The base level has min == max == mean, so those vectors are left empty there.
+    while (m_Levels.back().mean.size() > 1) {
+        const Level_t &src = m_Levels.back();
+        const std::vector<uint16_t> &smin = src.min.empty() ? src.mean : src.min;
+        const std::vector<uint16_t> &smax = src.max.empty() ? src.mean : src.max;
+
+        int64_t sn = src.mean.size();
+        int64_t dn = (sn + 1) / 2;
+
+        Level_t dst;
+        dst.mean.resize(dn);
+        dst.min.resize(dn);
+        dst.max.resize(dn);
+        for (int64_t i = 0; i < dn; i++) {
+            int64_t a = i * 2;
+            int64_t b = min(sn - 1, a + 1);
+            dst.mean[i] = uint16_t((src.mean[a] + src.mean[b] + 1) / 2);
+            dst.min[i] = min(smin[a], smin[b]);
+            dst.max[i] = max(smax[a], smax[b]);
+        }
+
+        m_Levels.emplace_back(std::move(dst));
+    }
+
+    return true;
+}
+
+void CEntropyPyramid::clear() {
+    m_Size = 0;
+    m_Levels.clear();
+}
+
+bool CEntropyPyramid::empty() const {
+    return m_Levels.empty();
+}
+
+int64_t CEntropyPyramid::size() const {
+    return m_Size;
+}
+
+int64_t CEntropyPyramid::blockSize() const {
+    return m_BlockSize;
+}
+
+int CEntropyPyramid::levels() const {
+    return int(m_Levels.size());
+}
+
+/// memoryUsage returns the number of bytes held by all levels.
+int64_t CEntropyPyramid::memoryUsage() const {
+    int64_t rv = 0;
+    for (const auto &l : m_Levels) {
+        rv += int64_t((l.mean.capacity() + l.min.capacity() + l.max.capacity()) * sizeof(uint16_t));
+    }
+    return rv;
+}
+
+/// expectedMemoryUsage returns the number of bytes held by all levels of a pyramid of n bytes built with
+/// blocks of bs bytes.
+int64_t CEntropyPyramid::expectedMemoryUsage(int64_t n, int64_t bs) {
+    if (n <= 0 || bs <= 0) return 0;
+
+    // The base level only keeps the means.
+    int64_t count = (n + bs - 1) / bs;
+    int64_t rv = int64_t(count * sizeof(uint16_t));
+    while (count > 1) {
+        count = (count + 1) / 2;
+        rv += int64_t(3 * count * sizeof(uint16_t));
+    }
+    return rv;
+}
+
+/// sample resamples the entropy of [start, end) to n_out points, reading the level whose entries
+/// are closest to, but not larger than, the span of a single output point.
+/// @param [in] start First byte of the range.
+/// @param [in] end One past the last byte of the range.
+/// @param [in] n_out Number of output points.
+/// @param [out] mean Mean entropy of each output point, between [0., 1.]
+/// @param [out] mn Optional minimum block entropy of each output point.
+/// @param [out] mx Optional maximum block entropy of each output point.
+void CEntropyPyramid::sample(int64_t start, int64_t end, int n_out, float *mean, float *mn, float *mx) const {
+    start = max<int64_t>(0, start);
+    end = min(m_Size, end);
+    if (empty() || n_out <= 0 || start >= end) {
+        for (int i = 0; i < n_out; i++) {
+            mean[i] = 0.f;
+            if (mn) mn[i] = 0.f;
+            if (mx) mx[i] = 0.f;
+        }
+        return;
+    }
+
+    // Reading a few entries per point keeps the blur at the point edges small while staying O(n_out).
+    double span = double(end - start) / n_out / m_BlockSize / s_EntriesPerPoint;
+    int level = 0;
+    while (level + 1 < levels() && double(int64_t(1) << (level + 1)) <= span) {
+        level++;
+    }
+
+    const Level_t &l = m_Levels[level];
+    const std::vector<uint16_t> &lmin = l.min.empty() ? l.mean : l.min;
+    const std::vector<uint16_t> &lmax = l.max.empty() ? l.mean : l.max;
+    int64_t ln = l.mean.size();
+    int64_t ebs = m_BlockSize << level;
+
+    for (int i = 0; i < n_out; i++) {
+        int64_t s = start + (end - start) * i / n_out;
+        int64_t e = start + (end - start) * (i + 1) / n_out;
+
+        int64_t b0 = min(ln - 1, s / ebs);
+        int64_t b1 = min(ln, max(b0 + 1, (e + ebs - 1) / ebs));
+
+        // The mean is weighted by how much of each entry lies within the point.
+        double acc = 0., wsum = 0.;
+        uint16_t lo = 65535, hi = 0;
+        for (int64_t b = b0; b < b1; b++) {
+            double w = double(max<int64_t>(1, min(e, (b + 1) * ebs) - max(s, b * ebs)));
+            acc += w * l.mean[b];
+            wsum += w;
+            lo = min(lo, lmin[b]);
+            hi = max(hi, lmax[b]);
+        }
+
+        mean[i] = float(acc / wsum / 65535.);
+        if (mn) mn[i] = lo / 65535.f;
+        if (mx) mx[i] = hi / 65535.f;
+    }
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <QtGui>
+
+#include "glyph_atlas.h"
+
+// Cells of each set are laid out 16 by 16, the hex pairs, then the ASCII cells, then a row of labels below.
+static const int s_GridSize = 16;
+
+CGlyphAtlas::CGlyphAtlas()
+        : m_Dpr(0.), m_LabelColor(0), m_HexColors(), m_AsciiColors(),
+          m_CharWidth(0), m_CellHeight(0), m_Ascent(0), m_LabelAdvance(0) {
+}
+
+int CGlyphAtlas::cellWidth(Set_t set) const {
+    return set == HEX ? 2 * m_CharWidth : m_CharWidth;
+}
+
+/// cellOrigin returns the top left of cell c of set in the atlas, in logical pixels.
+QPoint CGlyphAtlas::cellOrigin(Set_t set, int c) const {
+    switch (set) {
+        case HEX:
+            return {(c % s_GridSize) * cellWidth(HEX), (c / s_GridSize) * m_CellHeight};
+        case ASCII:
+            return {s_GridSize * cellWidth(HEX) + (c % s_GridSize) * cellWidth(ASCII), (c / s_GridSize) * m_CellHeight};
+        case LABEL:
+        default:
+            return {c * cellWidth(LABEL), s_GridSize * m_CellHeight};
+    }
+}
+
+/// update rasterizes the atlas again when the font, device pixel ratio or any of the colors differ from
+/// those it was last drawn with.
+/// @return true if the atlas was redrawn.
+bool CGlyphAtlas::update(const QFont &font, qreal dpr, QRgb label_color, const QRgb hex_colors[256], const QRgb ascii_colors[256]) {
+    if (!m_Pixmap.isNull() && font == m_Font && dpr == m_Dpr && label_color == m_LabelColor &&
+        std::equal(hex_colors, hex_colors + 256, m_HexColors) &&
+        std::equal(ascii_colors, ascii_colors + 256, m_AsciiColors)) {
+        return false;
+    }
+
+    m_Font = font;
+    m_Dpr = dpr;
+    m_LabelColor = label_color;
+    std::copy(hex_colors, hex_colors + 256, m_HexColors);
+    std::copy(ascii_colors, ascii_colors + 256, m_AsciiColors);
+
+    QFontMetrics fm(m_Font);
+    m_CharWidth = fm.maxWidth();
+    m_CellHeight = fm.height();
+    m_Ascent = fm.ascent();
+    m_LabelAdvance = fm.horizontalAdvance(QLatin1Char('0'));
+
+    int w = s_GridSize * (cellWidth(HEX) + cellWidth(ASCII));
+    int h = (s_GridSize + 1) * m_CellHeight;
+    m_Pixmap = QPixmap(QSize(w, h) * m_Dpr);
+    m_Pixmap.setDevicePixelRatio(m_Dpr);
+    m_Pixmap.fill(Qt::transparent);
+
+    QPainter p(&m_Pixmap);
+    p.setFont(m_Font);
+
+    static const char s_Digits[] = "0123456789abcdef";
+    static const char s_Label[] = "0123456789ABCDEFx";
+    for (int c = 0; c < 256; c++) {
+        QPoint o = cellOrigin(HEX, c);
+        p.setPen(QColor(m_HexColors[c]));
+        const char pair[] = {s_Digits[c >> 4], s_Digits[c & 15], '\0'};
+        p.drawText(o.x(), o.y() + m_Ascent, QString(QLatin1String(pair)));
+
+        o = cellOrigin(ASCII, c);
+        p.setPen(QColor(m_AsciiColors[c]));
+        p.drawText(o.x(), o.y() + m_Ascent, QString(QLatin1Char(0x20 <= c && c <= 0x7e ? char(c) : '.')));
+    }
+    p.setPen(QColor(m_LabelColor));
+    for (int c = 0; c <= s_LabelX; c++) {
+        QPoint o = cellOrigin(LABEL, c);
+        p.drawText(o.x(), o.y() + m_Ascent, QString(QLatin1Char(s_Label[c])));
+    }
+
+    return true;
+}
+
+/// fragment returns the fragment drawing cell c of set with its left edge at x and its baseline at baseline,
+/// the position drawText would place the same text at.
+QPainter::PixmapFragment CGlyphAtlas::fragment(Set_t set, int c, qreal x, qreal baseline) const {
+    QPoint o = cellOrigin(set, c);
+    qreal cw = cellWidth(set);
+    qreal ch = m_CellHeight;
+
+    // Source rectangles are in device pixels, scaled back to logical ones when drawn.
+    QRectF source(o.x() * m_Dpr, o.y() * m_Dpr, cw * m_Dpr, ch * m_Dpr);
+    QPointF center(x + cw / 2, baseline - m_Ascent + ch / 2);
+    return QPainter::PixmapFragment::create(center, source, 1. / m_Dpr, 1. / m_Dpr);
+}
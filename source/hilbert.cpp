@@ -17,108 +17,245 @@
  *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-// The gilbert2d method is based on Python code from https://github.com/jakubcerveny/gilbert/blob/master/gilbert2d.py
+// The gilbert2d curve is based on Python code from https://github.com/jakubcerveny/gilbert/blob/master/gilbert2d.py
 
+#include <algorithm>
+#include <list>
+#include <mutex>
 #include <vector>
 
 #include <cstdlib>
 
 using std::vector;
-using std::pair;
-using std::make_pair;
 
 #include "hilbert.h"
+#include "parallel.h"
 
-template<class T>
-T sgn(const T &x) { return (x > 0) - (x < 0); }
+// The curve is defined recursively on rectangles, each given by its first point, its major axis a
+// and its minor axis b. A rectangle a single row or column wide is walked directly, any other is
+// split into two or three smaller ones along the curve. As the size of each part is known up
+// front, a point of the curve can be located by descending into a single part per level, and a
+// range of the curve by descending only into the parts overlapping it.
 
-template<class T>
-pair<T, T> sgn(const pair<T, T> &pt) { return make_pair(sgn(pt.first), sgn(pt.second)); }
+// A rectangle of the curve and the index along the curve of its first point.
+struct Rect_t {
+    int x, y;
+    int ax, ay;
+    int bx, by;
+    int64_t d;
+};
 
-template<class T>
-pair<T, T> operator+(const pair<T, T> &a, const pair<T, T> &b) { return make_pair(a.first + b.first, a.second + b.second); }
+static inline int sgn(int x) { return (x > 0) - (x < 0); }
 
-template<class T>
-pair<T, T> operator+=(pair<T, T> &a, const pair<T, T> &b) {
-    a.first += b.first;
-    a.second += b.second;
-    return a;
+static inline int64_t rect_size(const Rect_t &r) {
+    return int64_t(abs(r.ax + r.ay)) * abs(r.bx + r.by);
 }
 
-template<class T>
-pair<T, T> operator-(const pair<T, T> &a, const pair<T, T> &b) { return make_pair(a.first - b.first, a.second - b.second); }
+/// split_rect divides r into the rectangles that the curve visits in turn.
+/// @return The number of parts written to parts, 0 if r is a single row or column.
+static int split_rect(const Rect_t &r, Rect_t parts[3]) {
+    int w = abs(r.ax + r.ay);
+    int h = abs(r.bx + r.by);
+    if (h == 1 || w == 1) return 0;
 
-template<class T>
-pair<T, T> operator-(const pair<T, T> &a) { return make_pair(-a.first, -a.second); }
+    int dax = sgn(r.ax), day = sgn(r.ay); // unit major direction
+    int dbx = sgn(r.bx), dby = sgn(r.by); // unit orthogonal direction
 
-template<class T>
-pair<T, T> operator/(const pair<T, T> &a, const T &b) { return make_pair(a.first / b, a.second / b); }
+    int ax2 = r.ax / 2, ay2 = r.ay / 2;
+    int bx2 = r.bx / 2, by2 = r.by / 2;
 
+    int w2 = abs(ax2 + ay2);
+    int h2 = abs(bx2 + by2);
 
-static void gilbert2d(pt_t pt, pt_t a, pt_t b, curve_t &curve) {
-//    """
-//    Generalized Hilbert ('gilbert') space-filling curve for arbitrary-sized
-//    2D rectangular grids.
-//    """
+    if (2 * w > 3 * h) {
+        if ((w2 % 2) && (w > 2)) {
+            // prefer even steps
+            ax2 += dax;
+            ay2 += day;
+        }
+        // long case: split in two parts only
+        parts[0] = {r.x, r.y, ax2, ay2, r.bx, r.by, r.d};
+        parts[1] = {r.x + ax2, r.y + ay2, r.ax - ax2, r.ay - ay2, r.bx, r.by, r.d + rect_size(parts[0])};
+        return 2;
+    }
 
-    int w = abs(a.first + a.second);
-    int h = abs(b.first + b.second);
+    if ((h2 % 2) && (h > 2)) {
+        // prefer even steps
+        bx2 += dbx;
+        by2 += dby;
+    }
+    // standard case: one step up, one long horizontal, one step down
+    parts[0] = {r.x, r.y, bx2, by2, ax2, ay2, r.d};
+    parts[1] = {r.x + bx2, r.y + by2, r.ax, r.ay, r.bx - bx2, r.by - by2, r.d + rect_size(parts[0])};
+    parts[2] = {r.x + (r.ax - dax) + (bx2 - dbx), r.y + (r.ay - day) + (by2 - dby),
+                -bx2, -by2, -(r.ax - ax2), -(r.ay - ay2), parts[1].d + rect_size(parts[1])};
+    return 3;
+}
 
-    pt_t da = sgn(a); // unit major direction
-    pt_t db = sgn(b); // unit orthogonal direction
+static Rect_t root_rect(int width, int height) {
+    if (width < height) return {0, 0, 0, height, width, 0, 0};
+    return {0, 0, width, 0, 0, height, 0};
+}
 
-    if (h == 1) {
-        // trivial row fill
-        for (int i = 0; i < w; i++) {
-            curve.emplace_back(pt);
-            pt += da;
-        }
-        return;
+/// gilbert2d_d2xy returns the point at index d along the curve of a width x height grid.
+/// Takes time proportional to the depth of the curve, O(log(width * height)).
+/// @param [in] d Index along the curve, in [0, width * height).
+pt_t gilbert2d_d2xy(int64_t d, int width, int height) {
+    Rect_t r = root_rect(width, height);
+    Rect_t parts[3];
+
+    for (;;) {
+        int n = split_rect(r, parts);
+        if (n == 0) break;
+
+        int k = 0;
+        while (k + 1 < n && d >= parts[k + 1].d) k++;
+        r = parts[k];
     }
 
-    if (w == 1) {
-        // trivial column fill
-        for (int i = 0; i < h; i++) {
-            curve.emplace_back(pt);
-            pt += db;
-        }
-        return;
+    // A single row or column, walked along whichever axis is longer than one.
+    int64_t i = d - r.d;
+    if (abs(r.bx + r.by) == 1) {
+        return pt_t(int(r.x + sgn(r.ax) * i), int(r.y + sgn(r.ay) * i));
     }
+    return pt_t(int(r.x + sgn(r.bx) * i), int(r.y + sgn(r.by) * i));
+}
 
-    pt_t a2 = a / 2;
-    pt_t b2 = b / 2;
+static inline bool rect_contains(const Rect_t &r, int x, int y) {
+    // The offset from the first point, measured along each axis, must lie within its length.
+    int64_t da = r.ax != 0 ? int64_t(x - r.x) * sgn(r.ax) : int64_t(y - r.y) * sgn(r.ay);
+    int64_t db = r.bx != 0 ? int64_t(x - r.x) * sgn(r.bx) : int64_t(y - r.y) * sgn(r.by);
+    return 0 <= da && da < abs(r.ax + r.ay) && 0 <= db && db < abs(r.bx + r.by);
+}
 
-    int w2 = abs(a2.first + a2.second);
-    int h2 = abs(b2.first + b2.second);
+/// gilbert2d_xy2d returns the index along the curve of a width x height grid of the point (x, y),
+/// the inverse of gilbert2d_d2xy.
+int64_t gilbert2d_xy2d(int x, int y, int width, int height) {
+    Rect_t r = root_rect(width, height);
+    Rect_t parts[3];
 
-    if (2 * w > 3 * h) {
-        if ((w2 % 2) && (w > 2)) {
-            // prefer even steps
-            a2 += da;
+    for (;;) {
+        int n = split_rect(r, parts);
+        if (n == 0) break;
+
+        int k = 0;
+        while (k + 1 < n && !rect_contains(parts[k], x, y)) k++;
+        r = parts[k];
+    }
+
+    if (abs(r.bx + r.by) == 1) {
+        return r.d + (r.ax != 0 ? int64_t(x - r.x) * sgn(r.ax) : int64_t(y - r.y) * sgn(r.ay));
+    }
+    return r.d + (r.bx != 0 ? int64_t(x - r.x) * sgn(r.bx) : int64_t(y - r.y) * sgn(r.by));
+}
+
+/// gilbert2d_fill writes the pixel indices, y * width + x, of the points [d0, d1) along the curve of
+/// a width x height grid to lut[0, d1 - d0). Disjoint ranges may be filled concurrently.
+void gilbert2d_fill(int width, int height, int64_t d0, int64_t d1, uint32_t *lut) {
+    if (d0 >= d1) return;
+
+    // Depth first over the rectangles overlapping [d0, d1), descending into the first part of each
+    // and stacking the others. At most two parts are stacked per level, the depth being logarithmic.
+    vector<Rect_t> stack;
+    stack.reserve(128);
+    stack.push_back(root_rect(width, height));
+
+    Rect_t parts[3];
+    while (!stack.empty()) {
+        Rect_t r = stack.back();
+        stack.pop_back();
+
+        for (;;) {
+            int n = split_rect(r, parts);
+            if (n == 0) break;
+
+            int first = -1;
+            for (int k = n - 1; k >= 0; k--) {
+                if (parts[k].d < d1 && parts[k].d + rect_size(parts[k]) > d0) {
+                    if (first >= 0) stack.push_back(parts[first]);
+                    first = k;
+                }
+            }
+            r = parts[first];
         }
-        // long case: split in two parts only
-        gilbert2d(pt, a2, b, curve);
-        gilbert2d(pt + a2, a - a2, b, curve);
-    } else {
-        if ((h2 % 2) && (h > 2)) {
-            // prefer even steps
-            b2 += db;
+
+        int dx, dy;
+        int64_t len;
+        if (abs(r.bx + r.by) == 1) {
+            dx = sgn(r.ax);
+            dy = sgn(r.ay);
+            len = abs(r.ax + r.ay);
+        } else {
+            dx = sgn(r.bx);
+            dy = sgn(r.by);
+            len = abs(r.bx + r.by);
+        }
+
+        int64_t i0 = std::max<int64_t>(0, d0 - r.d);
+        int64_t i1 = std::min<int64_t>(len, d1 - r.d);
+        int64_t x = r.x + dx * i0;
+        int64_t y = r.y + dy * i0;
+        for (int64_t i = i0; i < i1; i++, x += dx, y += dy) {
+            lut[r.d + i - d0] = uint32_t(y * width + x);
         }
-        // standard case: one step up, one long horizontal, one step down
-        gilbert2d(pt, b2, a2, curve);
-        gilbert2d(pt + b2, a, b - b2, curve);
-        gilbert2d(pt + (a - da) + (b2 - db),
-                  -b2, -(a - a2), curve);
     }
 }
 
-
+/// gilbert2d computes the generalized Hilbert ('gilbert') space-filling curve for an arbitrary-sized
+/// width x height rectangular grid, starting at (0, 0).
 void gilbert2d(int width, int height, curve_t &curve) {
     curve.clear();
+    if (width <= 0 || height <= 0) return;
+
+    int64_t n = int64_t(width) * height;
+    vector<uint32_t> lut(n);
+    gilbert2d_fill(width, height, 0, n, lut.data());
+
+    curve.resize(n);
+    for (int64_t i = 0; i < n; i++) {
+        curve[i] = pt_t(int(lut[i] % uint32_t(width)), int(lut[i] / uint32_t(width)));
+    }
+}
 
-    pt_t pt{0, 0}, a{width, 0}, b{0, height};
+// Below this many points the table is filled on the calling thread.
+static const int64_t s_MinPointsPerWorker = 256 * 1024;
+
+// Number of curve tables kept by gilbert2d_lut, enough for the views of a few window sizes.
+static const size_t s_MaxCachedLuts = 8;
+
+/// gilbert2d_lut returns the curve of gilbert2d as pixel indices. The tables are cached process-wide,
+/// most recently used first, so that views of the same size share one and a resize or a new file
+/// does not rebuild it.
+/// @param [in] width Width of the grid, width * height must be below 2^32.
+/// @param [in] height Height of the grid.
+std::shared_ptr<const curve_lut_t> gilbert2d_lut(int width, int height) {
+    struct Entry_t {
+        int width;
+        int height;
+        std::shared_ptr<const curve_lut_t> lut;
+    };
+    static std::mutex s_Mutex;
+    static std::list<Entry_t> s_Luts;
+
+    {
+        std::lock_guard<std::mutex> lock(s_Mutex);
+        for (auto i = s_Luts.begin(); i != s_Luts.end(); ++i) {
+            if (i->width == width && i->height == height) {
+                s_Luts.splice(s_Luts.begin(), s_Luts, i);
+                return i->lut;
+            }
+        }
+    }
 
-    if (width < height) std::swap(a, b);
+    // Built outside of the lock, two threads asking for the same new size both build it.
+    int64_t n = std::max(0, width) * int64_t(std::max(0, height));
+    auto lut = std::make_shared<curve_lut_t>(n);
+    parallel_for(n, s_MinPointsPerWorker, [&](int64_t d0, int64_t d1) {
+        gilbert2d_fill(width, height, d0, d1, lut->data() + d0);
+    });
 
-    gilbert2d(pt, a, b, curve);
+    std::lock_guard<std::mutex> lock(s_Mutex);
+    s_Luts.push_front({width, height, lut});
+    if (s_Luts.size() > s_MaxCachedLuts) s_Luts.pop_back();
+    return lut;
 }
@@ -23,6 +23,7 @@
 #include <QGridLayout>
 #include <QSpinBox>
 #include <QComboBox>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include "histogram_2d_view.h"
 #include "histogram_calc.h"
@@ -34,7 +35,11 @@ using std::isinf;
 
 CHistogram2D::CHistogram2D(QWidget *p)
         : QLabel(p),
-          m_Histogram(nullptr), m_Data(nullptr), m_Size(0) {
+          m_Data(nullptr), m_Size(0),
+          m_Cancel(false), m_Generation(0), m_Pending(false) {
+    m_Watcher = new QFutureWatcher<Histo2DJob_t>(this);
+    connect(m_Watcher, SIGNAL(finished()), SLOT(histoReady()));
+
     {
         auto layout = new QGridLayout(this);
         {
@@ -74,11 +79,14 @@ CHistogram2D::CHistogram2D(QWidget *p)
             auto cb = new QComboBox(this);
             cb->setFixedSize(cb->sizeHint());
             cb->addItem("U8");
+            cb->addItem("U12");
             cb->addItem("U16");
             cb->addItem("U32");
             cb->addItem("U64");
             cb->addItem("F32");
             cb->addItem("F64");
+            cb->addItem("F32 Bits");
+            cb->addItem("F64 Bits");
             cb->setCurrentIndex(0);
             cb->setEditable(false);
             m_Type = cb;
@@ -95,7 +103,7 @@ CHistogram2D::CHistogram2D(QWidget *p)
 }
 
 CHistogram2D::~CHistogram2D() {
-    delete[] m_Histogram;
+    stop();
 }
 
 void CHistogram2D::setImage(QImage &img) {
@@ -139,17 +147,81 @@ void CHistogram2D::setData(const quint8 *dat, qsizetype n) {
     regenHisto();
 }
 
+/// setHistogram shows histogram, computed elsewhere for the n bytes of dat at the current type, instead of
+/// computing it again.
+void CHistogram2D::setHistogram(const quint8 *dat, qsizetype n, const std::shared_ptr<int> &histogram) {
+    cancel();
+    m_Data = dat;
+    m_Size = n;
+    m_Histogram = histogram;
+
+    parametersChanged();
+}
+
+/// dtype returns the type of the values the histogram counts.
+HistoDtype_t CHistogram2D::dtype() const {
+    return string_to_histo_dtype(m_Type->currentText().toStdString());
+}
+
+/// regenHisto requests the histogram of the current data, computed in the background by startJob().
 void CHistogram2D::regenHisto() {
-    delete[] m_Histogram;
-    m_Histogram = nullptr;
+    m_Generation++;
+    m_Pending = true;
+    m_Cancel = true;
+    if (!m_Watcher->isRunning()) startJob();
+}
 
-    HistoDtype_t t = string_to_histo_dtype(m_Type->currentText().toStdString());
-    m_Histogram = generate_histo_2d(m_Data, m_Size, t);
+void CHistogram2D::startJob() {
+    m_Pending = false;
+    m_Cancel = false;
+
+    const quint8 *dat = m_Data;
+    qsizetype n = m_Size;
+    HistoDtype_t t = dtype();
+    int generation = m_Generation;
+    m_Watcher->setFuture(QtConcurrent::run([this, dat, n, t, generation]() {
+        Histo2DJob_t job;
+        job.generation = generation;
+        job.histogram.reset(generate_histo_2d(dat, n, t, &m_Cancel), std::default_delete<int[]>());
+        return job;
+    }));
+}
+
+void CHistogram2D::histoReady() {
+    Histo2DJob_t job = m_Watcher->result();
+    if (m_Pending) {
+        startJob();
+        return;
+    }
+    if (job.generation != m_Generation || !job.histogram) {
+        return;
+    }
+
+    m_Histogram = job.histogram;
+    emit(histogramReady(m_Data, m_Size));
 
     parametersChanged();
 }
 
+/// cancel abandons the histogram being computed, if any, keeping the one shown.
+void CHistogram2D::cancel() {
+    m_Generation++;
+    m_Pending = false;
+    m_Cancel = true;
+}
+
+/// stop cancels the computation and waits for it to return, after which the data may be released.
+void CHistogram2D::stop() {
+    cancel();
+    m_Watcher->waitForFinished();
+    m_Data = nullptr;
+    m_Size = 0;
+}
+
 void CHistogram2D::parametersChanged() {
+    if (!m_Histogram) return;
+    const int *histogram = m_Histogram.get();
+
     int thresh = m_Threshold->value();
     float scale_factor = m_Scale->value();
 
@@ -159,8 +231,8 @@ void CHistogram2D::parametersChanged() {
     auto p = (unsigned int *) img.bits();
 
     for (int i = 0; i < 256 * 256; i++, p++) {
-        if (m_Histogram[i] >= thresh) {
-            float cc = m_Histogram[i] / scale_factor;
+        if (histogram[i] >= thresh) {
+            float cc = histogram[i] / scale_factor;
             cc += .2;
             if (cc > 1.) cc = 1.;
             int c = cc * 255 + .5;
@@ -26,6 +26,7 @@
 #include <QCheckBox>
 #include <QPushButton>
 #include <QKeyEvent>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include <glut.h>
 
@@ -40,10 +41,12 @@ CHistogram3D::CHistogram3D(QWidget *p)
         : QGLWidget(p)
         , m_Vertices(nullptr)
         , m_Colors(nullptr)
-        , m_Histogram(nullptr) 
         , m_Data(nullptr)
         , m_Size(0)
         , m_Flags(0)
+        , m_Cancel(false)
+        , m_Generation(0)
+        , m_Pending(false)
         , m_VertexCount(0)
         , m_MouseX(0)
         , m_MouseY(0)
@@ -52,6 +55,9 @@ CHistogram3D::CHistogram3D(QWidget *p)
         , m_ScaleX(1)
         , m_ScaleY(1)
         , m_ScaleZ(1) {
+    m_Watcher = new QFutureWatcher<Histo3DJob_t>(this);
+    connect(m_Watcher, SIGNAL(finished()), SLOT(histoReady()));
+
     auto update_timer = new QTimer(this);
     QObject::connect(update_timer, SIGNAL(timeout()), this, SLOT(updateGL())); //, Qt::QueuedConnection);
     update_timer->start(10);
@@ -107,6 +113,8 @@ CHistogram3D::CHistogram3D(QWidget *p)
         cb->addItem("U64");
         cb->addItem("F32");
         cb->addItem("F64");
+        cb->addItem("F32 Bits");
+        cb->addItem("F64 Bits");
         cb->setCurrentIndex(0);
         cb->setEditable(false);
         m_Type = cb;
@@ -176,10 +184,8 @@ CHistogram3D::CHistogram3D(QWidget *p)
 }
 
 CHistogram3D::~CHistogram3D() {
+    stop();
 
-    if (m_Histogram) {
-        delete[] m_Histogram;
-    }
     if (m_Vertices) {
         delete[] m_Vertices;
     }
@@ -368,28 +374,96 @@ void CHistogram3D::transformHisto() {
     }
 }
 
+/// setHistogram shows histogram, computed elsewhere for the n bytes of dat at the current type and overlap,
+/// instead of computing it again.
+void CHistogram3D::setHistogram(const quint8 *dat, qsizetype n, const std::shared_ptr<const SparseHisto3D_t> &histogram) {
+    cancel();
+    m_Data = dat;
+    m_Size = n;
+    m_Histogram = histogram;
+
+    parametersChanged();
+}
+
+/// dtype returns the type of the values the histogram counts.
+HistoDtype_t CHistogram3D::dtype() const {
+    return string_to_histo_dtype(m_Type->currentText().toStdString());
+}
+
+/// overlap returns whether the histogram counts overlapping triples of values.
+bool CHistogram3D::overlap() const {
+    return m_Overlap->isChecked();
+}
+
+/// regenHisto requests the histogram of the current data, computed in the background by startJob().
 void CHistogram3D::regenHisto() {
-    if (m_Histogram) {
-        delete[] m_Histogram;
-        m_Histogram = nullptr;
+    m_Generation++;
+    m_Pending = true;
+    m_Cancel = true;
+    if (!m_Watcher->isRunning()) startJob();
+}
+
+void CHistogram3D::startJob() {
+    m_Pending = false;
+    m_Cancel = false;
+
+    const quint8 *dat = m_Data;
+    qsizetype n = m_Size;
+    HistoDtype_t t = dtype();
+    bool ov = overlap();
+    int generation = m_Generation;
+    m_Watcher->setFuture(QtConcurrent::run([this, dat, n, t, ov, generation]() {
+        Histo3DJob_t job;
+        job.generation = generation;
+        auto hist = std::make_shared<SparseHisto3D_t>();
+        if (generate_histo_3d(dat, n, t, *hist, ov, &m_Cancel)) {
+            job.histogram = hist;
+        }
+        return job;
+    }));
+}
+
+void CHistogram3D::histoReady() {
+    Histo3DJob_t job = m_Watcher->result();
+    if (m_Pending) {
+        startJob();
+        return;
+    }
+    if (job.generation != m_Generation || !job.histogram) {
+        return;
     }
 
-    HistoDtype_t t = string_to_histo_dtype(m_Type->currentText().toStdString());
-    m_Histogram = generate_histo_3d(m_Data, m_Size, t, m_Overlap->isChecked());
+    m_Histogram = job.histogram;
+    emit(histogramReady(m_Data, m_Size));
 
     parametersChanged();
 }
 
-void CHistogram3D::parametersChanged() {
-    if (!m_Histogram)
-        return;
+/// cancel abandons the histogram being computed, if any, keeping the one shown.
+void CHistogram3D::cancel() {
+    m_Generation++;
+    m_Pending = false;
+    m_Cancel = true;
+}
 
-    int thresh = m_Threshold->value();
+/// stop cancels the computation and waits for it to return, after which the data may be released.
+void CHistogram3D::stop() {
+    cancel();
+    m_Watcher->waitForFinished();
+    m_Data = nullptr;
+    m_Size = 0;
+}
+
+void CHistogram3D::parametersChanged() {
+    uint32_t thresh = m_Threshold->value();
     float scale_factor = m_Scale->value();
 
+    // Only the populated bins are stored, so both passes scale with the number of distinct trigrams.
+    static const SparseHisto3D_t s_Empty;
+    const SparseHisto3D_t &histogram = m_Histogram ? *m_Histogram : s_Empty;
     m_VertexCount = 0;
-    for (int i = 0; i < 256 * 256 * 256; i++) {
-        if (m_Histogram[i] >= thresh) {
+    for (const auto &t : histogram) {
+        if (t.count >= thresh) {
             m_VertexCount++;
         }
     }
@@ -402,8 +476,10 @@ void CHistogram3D::parametersChanged() {
     if (m_VertexCount > 0) {
         m_Vertices = new GLfloat[m_VertexCount * 3];
         m_Colors = new GLfloat[m_VertexCount * 3];
-        for (int i = 0, j = 0; i < 256 * 256 * 256; i++) {
-            if (m_Histogram[i] >= thresh) {
+        int j = 0;
+        for (const auto &t : histogram) {
+            if (t.count >= thresh) {
+                int i = t.index;
                 float x = i / (256 * 256);
                 float y = (i % (256 * 256)) / 256;
                 float z = i % 256;
@@ -421,7 +497,7 @@ void CHistogram3D::parametersChanged() {
                 m_Vertices[j * 3 + 1] = y * 2. - 1.;
                 m_Vertices[j * 3 + 2] = z * 2. - 1.;
 
-                float cc = m_Histogram[i] / scale_factor;
+                float cc = t.count / scale_factor;
                 cc += .2;
                 if (cc > 1.) {
                     cc = 1.;
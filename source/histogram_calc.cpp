@@ -18,14 +18,17 @@
  */
 
 #include <cfloat>
+#include <climits>
 #include <cmath>
 #include <algorithm>
+#include <vector>
 
 #include <cstring>
 #include <cstdlib>
 
+#include "byte_count.h"
 #include "histogram_calc.h"
-#include "histogram_3d_view.h"
+#include "parallel.h"
 
 using std::min;
 using std::max;
@@ -47,363 +50,788 @@ HistoDtype_t string_to_histo_dtype(const std::string &s) {
     else if (s == "U64") t = HistoDtype_t::U64;
     else if (s == "F32") t = HistoDtype_t::F32;
     else if (s == "F64") t = HistoDtype_t::F64;
+    else if (s == "F32 Bits") t = HistoDtype_t::F32_BITS;
+    else if (s == "F64 Bits") t = HistoDtype_t::F64_BITS;
     else t = HistoDtype_t::NONE;
 
     return t;
 }
 
 
+/// histo_dtype_size returns the size in bytes of a single element of type dtype, or 0 for NONE.
+int histo_dtype_size(HistoDtype_t dtype) {
+    switch (dtype) {
+        case HistoDtype_t::NONE:
+            return 0;
+        case HistoDtype_t::U8:
+            return 1;
+        case HistoDtype_t::U12:
+        case HistoDtype_t::U16:
+            return 2;
+        case HistoDtype_t::U32:
+        case HistoDtype_t::F32:
+        case HistoDtype_t::F32_BITS:
+            return 4;
+        case HistoDtype_t::U64:
+        case HistoDtype_t::F64:
+        case HistoDtype_t::F64_BITS:
+            return 8;
+    }
+    return 0;
+}
+
+// Quantizers map a single element onto one of 256 bins. The integer ones keep the top 8 bits of
+// the value, which avoids the floating point divide per element.
+
+struct QuantU8 {
+    typedef uint8_t elem_t;
+    static inline uint32_t bin(elem_t v) { return v; }
+};
+
+struct QuantU12 {
+    typedef uint16_t elem_t;
+    static inline uint32_t bin(elem_t v) { return (v & 0x0fff) >> 4; }
+};
+
+struct QuantU16 {
+    typedef uint16_t elem_t;
+    static inline uint32_t bin(elem_t v) { return v >> 8; }
+};
+
+struct QuantU32 {
+    typedef uint32_t elem_t;
+    static inline uint32_t bin(elem_t v) { return v >> 24; }
+};
+
+struct QuantU64 {
+    typedef uint64_t elem_t;
+    static inline uint32_t bin(elem_t v) { return uint32_t(v >> 56); }
+};
+
+// Floats are scaled from [-max, max] onto [0, 255], with infinities and NaNs pushed to either end depending on their sign.
 template<class T>
-void hist_float_helper_2d(int *hist, T *dat_f, int64_t n) {
-    for (int64_t i = 0; i < n / int64_t(sizeof(T)) - 1; i++) {
-        int a1;
-        int a2;
-        if (sizeof(T) == 4) {
-            a1 = ((dat_f[i + 0] / FLT_MAX) * 255. + 255.) / 2.;
-            a2 = ((dat_f[i + 1] / FLT_MAX) * 255. + 255.) / 2.;
-        } else if (sizeof(T) == 8) {
-            a1 = ((dat_f[i + 0] / DBL_MAX) * 255. + 255.) / 2.;
-            a2 = ((dat_f[i + 1] / DBL_MAX) * 255. + 255.) / 2.;
-        } else {
-            abort();
+struct QuantFloat {
+    typedef T elem_t;
+    static inline uint32_t bin(elem_t v) {
+        const double mx = sizeof(T) == 4 ? double(FLT_MAX) : DBL_MAX;
+
+        if (isnan(v) || isinf(v)) {
+            return signbit(v) ? 0 : 255;
         }
 
-        if (isnan(dat_f[i + 0])) a1 = 255;
-        if (isnan(dat_f[i + 1])) a2 = 255;
+        int a = ((v / mx) * 255. + 255.) / 2.;
+        return uint32_t(min(255, max(0, a)));
+    }
+};
+
+// Floats can also be binned by their bit pattern. Flipping all bits of negative values and only the
+// sign bit of positive ones gives integers that sort like the floats they encode, whose top 8 bits
+// are the sign followed by the leading exponent bits. Bins then follow the order of magnitude rather
+// than collapsing onto the middle of the range. The sign is turned into a mask instead of a branch;
+// infinities land in the outermost bins and NaNs beyond them, on the side of their sign bit.
+template<class U>
+struct QuantFloatBits {
+    typedef U elem_t;
+    static inline uint32_t bin(elem_t v) {
+        const int bits = sizeof(U) * 8;
+        U mask = U(0) - (v >> (bits - 1)); // all ones for negative values
+        U key = v ^ (mask | (U(1) << (bits - 1)));
+        return uint32_t(key >> (bits - 8));
+    }
+};
 
-        if (isnan(dat_f[i + 0])) { if (signbit(dat_f[i + 0])) { a1 = 0; } else { a1 = 255; }}
-        if (isnan(dat_f[i + 1])) { if (signbit(dat_f[i + 1])) { a2 = 0; } else { a2 = 255; }}
+/// load_elem reads an element of type T from a possibly unaligned address.
+template<class T>
+static inline T load_elem(const uint8_t *p) {
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/// CDenseCounts adapts a plain array of counts to the interface shared with CTrigramPages.
+template<class T>
+class CDenseCounts {
+public:
+    explicit CDenseCounts(T *hist) : m_Histogram(hist) {}
 
-        if (isinf(dat_f[i + 0])) { if (signbit(dat_f[i + 0])) { a1 = 0; } else { a1 = 255; }}
-        if (isinf(dat_f[i + 1])) { if (signbit(dat_f[i + 1])) { a2 = 0; } else { a2 = 255; }}
+    inline void add(uint32_t ind) {
+        m_Histogram[ind]++;
+    }
+
+protected:
+    T *m_Histogram;
+};
+
+/// CTrigramPages counts trigrams in a two-level table, the leaves being pages of C counters that are
+/// only allocated once a trigram within them is seen. Memory is proportional to the populated pages
+/// rather than to the full 256^3 bins.
+template<class C>
+class CTrigramPages {
+public:
+    static const int s_PageBits = 14;
+    static const int s_PageSize = 1 << s_PageBits;
+    static const int s_PageCount = (256 * 256 * 256) >> s_PageBits;
+
+    CTrigramPages() {
+        memset(m_Pages, 0, sizeof(m_Pages));
+    }
 
-#if 0
-        if(a1 < 0 || a1 > 255) {
-          printf("0 %d %f\n", a1, dat_f[i+0]);
+    ~CTrigramPages() {
+        for (auto &pg : m_Pages) {
+            delete[] pg;
         }
-        if(a2 < 0 || a2 > 255) {
-          printf("1 %d %f %d %d\n", a2, dat_f[i+1], isnan(dat_f[i+1]), dat_f[i+1] < 0);
+    }
+
+    CTrigramPages(const CTrigramPages &) = delete;
+    CTrigramPages &operator=(const CTrigramPages &) = delete;
+
+    inline void add(uint32_t ind) {
+        C *&pg = m_Pages[ind >> s_PageBits];
+        if (!pg) pg = newPage();
+        pg[ind & (s_PageSize - 1)]++;
+    }
+
+    /// mergePage adds page pg of other to the same page of this table.
+    void mergePage(int pg, const CTrigramPages &other) {
+        const C *src = other.m_Pages[pg];
+        if (!src) return;
+
+        C *&dst = m_Pages[pg];
+        if (!dst) dst = newPage();
+        for (int i = 0; i < s_PageSize; i++) {
+            dst[i] += src[i];
         }
-#endif
+    }
 
-        if (a1 < 0) a1 = 0;
-        if (a2 < 0) a2 = 0;
+    /// collect appends the non-zero bins, in increasing index order, to hist.
+    void collect(SparseHisto3D_t &hist) const {
+        for (int p = 0; p < s_PageCount; p++) {
+            const C *pg = m_Pages[p];
+            if (!pg) continue;
 
-        if (a1 > 255) a1 = 255;
-        if (a2 > 255) a2 = 255;
+            uint32_t base = uint32_t(p) << s_PageBits;
+            for (int i = 0; i < s_PageSize; i++) {
+                if (pg[i] > 0) hist.push_back({base + i, uint64_t(pg[i])});
+            }
+        }
+    }
 
-        hist[a1 * 256 + a2]++;
+protected:
+    static C *newPage() {
+        auto pg = new C[s_PageSize];
+        memset(pg, 0, sizeof(pg[0]) * s_PageSize);
+        return pg;
     }
+
+    C *m_Pages[s_PageCount];
+};
+
+/// histo_ngram accumulates the n-grams of N elements starting at element indices [i0, i1) with stride st into hist.
+/// The n-gram starting at i reads elements i to i + N - 1, which may lie beyond i1.
+template<class Q, int N, class H>
+static void histo_ngram(H &hist, const uint8_t *dat_u8, int64_t i0, int64_t i1, int st) {
+    typedef typename Q::elem_t T;
+
+    for (int64_t i = i0; i < i1; i += st) {
+        const uint8_t *p = dat_u8 + i * int64_t(sizeof(T));
+
+        uint32_t ind = 0;
+        for (int k = 0; k < N; k++) {
+            ind = (ind << 8) | Q::bin(load_elem<T>(p + k * sizeof(T)));
+        }
+
+        hist.add(ind);
+    }
+}
+
+template<int N, class H>
+using ngram_fn_t = void (*)(H &, const uint8_t *, int64_t, int64_t, int);
+
+// Indexed by HistoDtype_t, in the order of its enumerators.
+template<int N, class H>
+constexpr ngram_fn_t<N, H> s_NgramKernels[] = {
+        nullptr,
+        histo_ngram<QuantU8, N, H>,
+        histo_ngram<QuantU12, N, H>,
+        histo_ngram<QuantU16, N, H>,
+        histo_ngram<QuantU32, N, H>,
+        histo_ngram<QuantU64, N, H>,
+        histo_ngram<QuantFloat<float>, N, H>,
+        histo_ngram<QuantFloat<double>, N, H>,
+        histo_ngram<QuantFloatBits<uint32_t>, N, H>,
+        histo_ngram<QuantFloatBits<uint64_t>, N, H>,
+};
+
+/// ngram_kernel returns the kernel counting N-grams of dtype elements into H, or nullptr for NONE.
+template<int N, class H>
+static ngram_fn_t<N, H> ngram_kernel(HistoDtype_t dtype) {
+    static_assert(sizeof(s_NgramKernels<N, H>) / sizeof(s_NgramKernels<N, H>[0]) == int(HistoDtype_t::F64_BITS) + 1,
+                  "s_NgramKernels does not cover HistoDtype_t");
+    return s_NgramKernels<N, H>[int(dtype)];
 }
 
-/// generate_histo computes the histogram for each byte within dat_u8.
+/// generate_histo computes the histogram for each element within dat_u8.
 /// @param [in] dat_u8 Byte data to be analyzed.
 /// @param [in] n Length of dat_u8 in bytes
-/// @return The calculated histogram of each byte of dat_u8, as vector of length 256 scaled between [0., 1.]
-float *generate_histo(const uint8_t *dat_u8, int64_t n) { //, histo_dtype_t dtype) {
-    auto hist = new float[256];
-    memset(hist, 0, sizeof(hist[0]) * 256);
+/// @param [in] dtype The type of data to cast dat_u8 as.
+/// @return The calculated histogram of each element of dat_u8, as vector of length 256 scaled between [0., 1.]
+float *generate_histo(const uint8_t *dat_u8, int64_t n, HistoDtype_t dtype) {
+    uint64_t counts[256] = {0};
+
+    if (dtype == HistoDtype_t::U8) {
+        count_bytes(dat_u8, n, counts);
+    } else if (auto fn = ngram_kernel<1, CDenseCounts<uint64_t> >(dtype)) {
+        CDenseCounts<uint64_t> dc(counts);
+        fn(dc, dat_u8, 0, n / histo_dtype_size(dtype), 1);
+    }
 
-    //if(dtype != u8) {
-    //  abort()
-    //}
+    return generate_histo(counts);
+}
 
-    for (int64_t i = 0; i < n; i++) {
-        hist[dat_u8[i]]++;
-    }
+/// generate_histo scales precomputed byte counts, for example from a CByteIndex, like generate_histo does.
+/// @param [in] counts Number of occurrences of each byte value.
+/// @return The histogram as vector of length 256 scaled between [0., 1.]
+float *generate_histo(const uint64_t counts[256]) {
+    auto hist = new float[256];
 
-    float mx = 0.;
+    uint64_t mx = 0;
     for (int i = 0; i < 256; i++) {
-        mx = max(mx, hist[i]);
+        mx = max(mx, counts[i]);
     }
     for (int i = 0; i < 256; i++) {
-        hist[i] /= mx;
+        hist[i] = mx > 0 ? float(double(counts[i]) / double(mx)) : 0.f;
     }
 
     return hist;
 }
 
+// The n-gram and entropy kernels poll the cancellation flag of a request between slices of this many start positions.
+static const int64_t s_CancelSlice = 16 * 1024 * 1024;
+
+/// histo_ngram_sliced runs fn over the start positions [i0, i1) in slices, giving up between two once cancel is set.
+/// Slices are multiples of st long so that the sampled positions are unchanged.
+/// @return False if cancelled.
+template<class F>
+static bool histo_ngram_sliced(F &&fn, int64_t i0, int64_t i1, int st, const std::atomic<bool> *cancel) {
+    int64_t slice = (s_CancelSlice + st - 1) / st * st;
+    for (int64_t i = i0; i < i1; i += slice) {
+        if (cancel && cancel->load()) {
+            return false;
+        }
+        fn(i, min(i1, i + slice));
+    }
+    return true;
+}
+
 /// generate_histo_2d computes a 2d histogram of each overlapping digram within dat_u8.
 /// @param [in] dat_u8 Byte data to be analyzed.
 /// @param [in] n Length of dat_u8 in bytes.
 /// @param [in] dtype The type of data to cast dat_u8 as.
+/// @param [in] cancel Optional flag polled while counting, the histogram is abandoned once it is set.
 /// @return The 2d histogram, as a linearized matrix of size 256 * 256, containing counts of each digram,
-int *generate_histo_2d(const uint8_t *dat_u8, int64_t n, HistoDtype_t dtype) {
+/// saturated at INT_MAX, or nullptr if cancelled.
+int *generate_histo_2d(const uint8_t *dat_u8, int64_t n, HistoDtype_t dtype, const std::atomic<bool> *cancel) {
     auto hist = new int[256 * 256];
     memset(hist, 0, sizeof(hist[0]) * 256 * 256);
 
-    switch (dtype) {
-        case HistoDtype_t::NONE:
-            break;
-        case HistoDtype_t::U8: {
-            for (int64_t i = 0; i < n - 1; i++) {
-                int a1 = dat_u8[i + 0];
-                int a2 = dat_u8[i + 1];
+    auto fn = ngram_kernel<2, CDenseCounts<uint64_t> >(dtype);
+    int64_t ne = fn ? n / histo_dtype_size(dtype) - 1 : 0; // number of digram start positions
 
-                hist[a1 * 256 + a2]++;
-            }
-        }
-            break;
-        case HistoDtype_t::U16: {
-            auto dat_u16 = (const uint16_t *) dat_u8;
-            for (int64_t i = 0; i < n / 2 - 1; i++) {
-                int a1 = dat_u16[i + 0] / float(0xffff) * 255.;
-                int a2 = dat_u16[i + 1] / float(0xffff) * 255.;
-
-                hist[a1 * 256 + a2]++;
-            }
-        }
-            break;
-        case HistoDtype_t::U32: {
-            auto dat_u32 = (const uint32_t *) dat_u8;
-            for (int64_t i = 0; i < n / 4 - 1; i++) {
-                int a1 = dat_u32[i + 0] / float(0xffffffff) * 255.;
-                int a2 = dat_u32[i + 1] / float(0xffffffff) * 255.;
-
-                hist[a1 * 256 + a2]++;
-            }
-        }
-            break;
-        case HistoDtype_t::U64: {
-            auto dat_u64 = (const uint64_t *) dat_u8;
-            for (int64_t i = 0; i < n / 8 - 1; i++) {
-                int a1 = dat_u64[i + 0] / float(0xffffffffffffffff) * 255.;
-                int a2 = dat_u64[i + 1] / float(0xffffffffffffffff) * 255.;
-
-                hist[a1 * 256 + a2]++;
-            }
-        }
-            break;
-        case HistoDtype_t::F32: {
-            auto dat_f32 = (const float *) dat_u8;
-            hist_float_helper_2d(hist, dat_f32, n);
-        }
-            break;
-        case HistoDtype_t::F64: {
-            auto dat_f64 = (const double *) dat_u8;
-            hist_float_helper_2d(hist, dat_f64, n);
+    bool done = true;
+
+    // Inputs of more than INT_MAX digrams are counted in 64 bits, a single digram may occur that often.
+    if (ne > INT_MAX) {
+        std::vector<uint64_t> counts(256 * 256);
+        CDenseCounts<uint64_t> dc(counts.data());
+        done = histo_ngram_sliced([&](int64_t i0, int64_t i1) { fn(dc, dat_u8, i0, i1, 1); }, 0, ne, 1, cancel);
+        for (int i = 0; i < 256 * 256; i++) {
+            hist[i] = int(min<uint64_t>(counts[i], INT_MAX));
         }
-            break;
+    } else if (ne > 0) {
+        auto fn32 = ngram_kernel<2, CDenseCounts<int> >(dtype);
+        CDenseCounts<int> dc(hist);
+        done = histo_ngram_sliced([&](int64_t i0, int64_t i1) { fn32(dc, dat_u8, i0, i1, 1); }, 0, ne, 1, cancel);
     }
 
-#if 0
-    int n_vertices = 0;
-    float m=10000000, M=-1, a=0.;
-    for(int i=0; i<256*256; i++) {
-      if(hist[i] > 0) {
-        n_vertices++;
-
-        if(m > hist[i]) m = hist[i];
-        if(M < hist[i]) M = hist[i];
-        a += hist[i];
-      }
+    if (!done) {
+        delete[] hist;
+        return nullptr;
     }
-    a /= n_vertices;
-    printf("%d %f %f %f\n", n_vertices, m, M, a);
-#endif
 
     return hist;
 }
 
-template<class T>
-void hist_float_helper_3d(int *hist, T *dat_f, int64_t n, int st) {
-    for (int64_t i = 0; i < n / int64_t(sizeof(T)) - 2; i += st) {
-        int a1;
-        int a2;
-        int a3;
-        if (sizeof(T) == 4) {
-            a1 = ((dat_f[i + 0] / FLT_MAX) * 255. + 255.) / 2.;
-            a2 = ((dat_f[i + 1] / FLT_MAX) * 255. + 255.) / 2.;
-            a3 = ((dat_f[i + 2] / FLT_MAX) * 255. + 255.) / 2.;
-        } else if (sizeof(T) == 8) {
-            a1 = ((dat_f[i + 0] / DBL_MAX) * 255. + 255.) / 2.;
-            a2 = ((dat_f[i + 1] / DBL_MAX) * 255. + 255.) / 2.;
-            a3 = ((dat_f[i + 2] / DBL_MAX) * 255. + 255.) / 2.;
-        } else {
-            abort();
-        }
+// Below this many trigrams the input is counted on the calling thread.
+static const int64_t s_MinTrigramsPerWorker = 1024 * 1024;
 
-        if (isnan(dat_f[i + 0])) a1 = 255;
-        if (isnan(dat_f[i + 1])) a2 = 255;
-        if (isnan(dat_f[i + 2])) a3 = 255;
+/// histo_3d_shards counts the trigrams starting at element indices [0, ne) with stride st into pages of C
+/// counters, one table per worker, and merges them into hist.
+/// @return False if cancelled.
+template<class C>
+static bool histo_3d_shards(const uint8_t *dat_u8, int64_t ne, HistoDtype_t dtype, int st, SparseHisto3D_t &hist,
+                            const std::atomic<bool> *cancel) {
+    auto fn = ngram_kernel<3, CTrigramPages<C> >(dtype);
 
-        if (isnan(dat_f[i + 0])) { if (signbit(dat_f[i + 0])) { a1 = 0; } else { a1 = 255; }}
-        if (isnan(dat_f[i + 1])) { if (signbit(dat_f[i + 1])) { a2 = 0; } else { a2 = 255; }}
-        if (isnan(dat_f[i + 2])) { if (signbit(dat_f[i + 2])) { a3 = 0; } else { a3 = 255; }}
+    int workers = parallel_worker_count(ne / st, s_MinTrigramsPerWorker);
 
-        if (isinf(dat_f[i + 0])) { if (signbit(dat_f[i + 0])) { a1 = 0; } else { a1 = 255; }}
-        if (isinf(dat_f[i + 1])) { if (signbit(dat_f[i + 1])) { a2 = 0; } else { a2 = 255; }}
-        if (isinf(dat_f[i + 2])) { if (signbit(dat_f[i + 2])) { a3 = 0; } else { a3 = 255; }}
+    // Chunks must start on a multiple of the stride so that the sampled positions are unchanged.
+    int64_t chunk = (ne + workers - 1) / workers;
+    chunk = (chunk + st - 1) / st * st;
 
+    std::vector<CTrigramPages<C> > shards(workers);
 
-    if(a1 < 0 || a1 > 255) {
-      printf("0 %d %f\n", a1, dat_f[i+0]);
+    std::atomic<bool> cancelled(false);
+    parallel_run(workers, [&](int w) {
+        int64_t i0 = min(ne, w * chunk);
+        int64_t i1 = min(ne, i0 + chunk);
+        if (!histo_ngram_sliced([&](int64_t b, int64_t e) { fn(shards[w], dat_u8, b, e, st); }, i0, i1, st, cancel)) {
+            cancelled = true;
+        }
+    });
+
+    if (cancelled) {
+        return false;
     }
-    if(a3 < 0 || a3 > 255) {
-      printf("2 %d %f\n", a3, dat_f[i+2]);
+
+    if (workers > 1) {
+        parallel_for(CTrigramPages<C>::s_PageCount, 16, [&](int64_t b, int64_t e) {
+            for (int64_t pg = b; pg < e; pg++) {
+                for (int w = 1; w < workers; w++) {
+                    shards[0].mergePage(int(pg), shards[w]);
+                }
+            }
+        });
     }
-    if(a2 < 0 || a2 > 255) {
-      printf("1 %d %f %d %d\n", a2, dat_f[i+1], isnan(dat_f[i+1]), dat_f[i+1] < 0);
+
+    shards[0].collect(hist);
+    return true;
+}
+
+/// generate_histo_3d computes a sparse 3d histogram of each overlapping trigram within dat_u8.
+/// The input is split into contiguous chunks of trigram start positions, each counted into a private
+/// page table by its own thread. Trigrams straddling two chunks are counted once by the chunk they start in.
+/// The page tables are then merged in parallel, each thread reducing a disjoint range of pages.
+/// @param [in] dat_u8 Byte data to be analyzed.
+/// @param [in] n Length of dat_u8 in bytes.
+/// @param [in] dtype The type of data to cast dat_u8 as.
+/// @param [out] hist The non-zero bins of the histogram, ordered by increasing trigram index.
+/// @param [in] overlap Whether to move by a single element (true) or by three elements (false).
+/// @param [in] cancel Optional flag polled while counting, the histogram is abandoned once it is set.
+/// @return False if cancelled, in which case hist is left empty.
+bool generate_histo_3d(const uint8_t *dat_u8, int64_t n, HistoDtype_t dtype, SparseHisto3D_t &hist, bool overlap,
+                       const std::atomic<bool> *cancel) {
+    hist.clear();
+
+    if (dtype == HistoDtype_t::NONE) {
+        return true;
     }
 
+    int st = overlap ? 1 : 3;
+    int64_t ne = n / histo_dtype_size(dtype) - 2; // number of trigram start positions
+
+    if (ne <= 0) {
+        return true;
+    }
 
-        if (a1 < 0) a1 = 0;
-        if (a2 < 0) a2 = 0;
-        if (a3 < 0) a3 = 0;
+    bool done;
 
-        if (a1 > 255) a1 = 255;
-        if (a2 > 255) a2 = 255;
-        if (a3 > 255) a3 = 255;
+    // Inputs of more than UINT32_MAX trigrams are counted in 64 bits, a single trigram may occur that
+    // often. Smaller ones keep the pages, and the memory of every shard, half the size.
+    if ((ne + st - 1) / st > int64_t(UINT32_MAX)) {
+        done = histo_3d_shards<uint64_t>(dat_u8, ne, dtype, st, hist, cancel);
+    } else {
+        done = histo_3d_shards<uint32_t>(dat_u8, ne, dtype, st, hist, cancel);
+    }
 
-        hist[a1 * 256 * 256 + a2 * 256 + a3]++;
+    if (!done) {
+        hist.clear();
     }
+    return done;
 }
 
-/// generate_histo_3d computes a 3d histogram of each overlapping digram within dat_u8.
-/// @param [in] dat_u8 Byte data to be analyzed.
-/// @param [in] n Length of dat_u8 in bytes.
-/// @param [in] dtype The type of data to cast dat_u8 as.
-/// @param [in] overlap Whether to move by a single byte (true) or length of dtype (false) (not implemented correctly.)
-/// @return The 2d histogram, as a linearized matrix of size 256 * 256, containing counts of each digram,
-int *generate_histo_3d(const uint8_t *dat_u8, int64_t n, HistoDtype_t dtype, bool overlap) {
-    auto hist = new int[256 * 256 * 256];
-    memset(hist, 0, sizeof(hist[0]) * 256 * 256 * 256);
+/// histo_3d_memory_usage bounds the memory of the sparse 3d histogram generate_histo_3d computes, from the
+/// number of trigrams it counts, and of the page tables it fills meanwhile.
+/// @param [in] n Length of the data in bytes.
+/// @param [in] dtype The type of data to cast it as.
+/// @param [in] overlap Whether trigrams overlap.
+/// @param [out] pages Optional, set to the bytes of the page tables of all workers, released once it returns.
+/// @return The bytes held by the histogram, at most one bin per trigram.
+int64_t histo_3d_memory_usage(int64_t n, HistoDtype_t dtype, bool overlap, int64_t *pages) {
+    if (pages) *pages = 0;
+
+    if (dtype == HistoDtype_t::NONE) {
+        return 0;
+    }
 
     int st = overlap ? 1 : 3;
+    int64_t ne = n / histo_dtype_size(dtype) - 2;
+    if (ne <= 0) {
+        return 0;
+    }
 
-    switch (dtype) {
-        case HistoDtype_t::NONE:
-            break;
-        case HistoDtype_t::U8: {
-            for (int64_t i = 0; i < n - 2; i += st) {
-                int a1 = dat_u8[i + 0];
-                int a2 = dat_u8[i + 1];
-                int a3 = dat_u8[i + 2];
-
-                hist[a1 * 256 * 256 + a2 * 256 + a3]++;
-            }
-        }
-            break;
-        case HistoDtype_t::U12: {
-            auto dat_u16 = (const uint16_t *) dat_u8;
-            for (int64_t i = 0; i < n / 2 - 2; i += st) {
-                int a1 = (dat_u16[i + 0] & 0x0fff) / float(0x0fff) * 255.;
-                int a2 = (dat_u16[i + 1] & 0x0fff) / float(0x0fff) * 255.;
-                int a3 = (dat_u16[i + 2] & 0x0fff) / float(0x0fff) * 255.;
-
-                hist[a1 * 256 * 256 + a2 * 256 + a3]++;
-            }
+    int64_t trigrams = (ne + st - 1) / st;
+    if (pages) {
+        int64_t page_bytes = CTrigramPages<uint32_t>::s_PageSize *
+                             int64_t(trigrams > int64_t(UINT32_MAX) ? sizeof(uint64_t) : sizeof(uint32_t));
+        int workers = parallel_worker_count(trigrams, s_MinTrigramsPerWorker);
+        int64_t per_worker = min<int64_t>(CTrigramPages<uint32_t>::s_PageCount, (trigrams + workers - 1) / workers);
+        *pages = workers * per_worker * page_bytes;
+    }
+    return int64_t(min<int64_t>(trigrams, 256 * 256 * 256) * sizeof(Trigram_t));
+}
+
+
+/// histo_entropy computes the Shannon entropy of a byte distribution.
+/// @param [in] counts Number of occurrences of each byte value.
+/// @return The entropy in bits per byte, between [0., 8.]
+double histo_entropy(const uint64_t counts[256]) {
+    uint64_t n = 0;
+    for (int i = 0; i < 256; i++) {
+        n += counts[i];
+    }
+    if (n == 0) {
+        return 0.;
+    }
+
+    double entropy = 0.;
+    for (int i = 0; i < 256; i++) {
+        if (counts[i] > 0) {
+            double p = counts[i] / double(n);
+            entropy -= p * std::log2(p);
         }
-            break;
-        case HistoDtype_t::U16: {
-            auto dat_u16 = (const uint16_t *) dat_u8;
-            for (int64_t i = 0; i < n / 2 - 2; i += st) {
-                int a1 = dat_u16[i + 0] / float(0xffff) * 255.;
-                int a2 = dat_u16[i + 1] / float(0xffff) * 255.;
-                int a3 = dat_u16[i + 2] / float(0xffff) * 255.;
-
-                hist[a1 * 256 * 256 + a2 * 256 + a3]++;
+    }
+    return entropy;
+}
+
+/// entropy_nlogn_table returns t with t[c] = c * log2(c) for c in [0, n], and t[0] = 0.
+static std::vector<double> entropy_nlogn_table(int64_t n) {
+    std::vector<double> t(n + 1);
+    t[0] = 0.;
+    for (int64_t c = 1; c <= n; c++) {
+        t[c] = c * std::log2(double(c));
+    }
+    return t;
+}
+
+/// entropy_windows computes the entropy of count windows of bs bytes of dat_u8, a window starting every inc bytes.
+/// Windows reaching beyond n are truncated. nlogn must hold at least min(n, bs) + 1 entries.
+static void entropy_windows(const uint8_t *dat_u8, int64_t n, int64_t bs, int64_t inc, int64_t count,
+                            const std::vector<double> &nlogn, float *dd) {
+    if (inc >= bs) {
+        // Windows do not overlap, count each one from scratch.
+        for (int64_t di = 0; di < count; di++) {
+            int64_t is = di * inc;
+            int64_t ie = min(n, is + bs);
+
+            uint64_t dict[256] = {0};
+            count_bytes(dat_u8 + is, ie - is, dict);
+
+            double sum = 0.;
+            for (int i = 0; i < 256; i++) {
+                sum += nlogn[dict[i]];
             }
+
+            int64_t m = ie - is;
+            dd[di] = float(max(0., (nlogn[m] - sum) / m / 8.));
         }
-            break;
-        case HistoDtype_t::U32: {
-            auto dat_u32 = (const uint32_t *) dat_u8;
-            for (int64_t i = 0; i < n / 4 - 2; i += st) {
-                int a1 = dat_u32[i + 0] / float(0xffffffff) * 255.;
-                int a2 = dat_u32[i + 1] / float(0xffffffff) * 255.;
-                int a3 = dat_u32[i + 2] / float(0xffffffff) * 255.;
-
-                hist[a1 * 256 * 256 + a2 * 256 + a3]++;
+    } else {
+        int64_t dict[256] = {0};
+        double sum = 0.;
+        int64_t lo = 0, hi = 0;
+
+        for (int64_t di = 0; di < count; di++) {
+            int64_t is = di * inc;
+            int64_t ie = min(n, is + bs);
+
+            // Drop the bytes leaving the window before adding the new ones, so no count exceeds bs.
+            for (; lo < is; lo++) {
+                int64_t &c = dict[dat_u8[lo]];
+                sum += nlogn[c - 1] - nlogn[c];
+                c--;
             }
-        }
-            break;
-        case HistoDtype_t::U64: {
-            auto dat_u64 = (const uint64_t *) dat_u8;
-            for (int64_t i = 0; i < n / 8 - 2; i += st) {
-                int a1 = dat_u64[i + 0] / float(0xffffffffffffffff) * 255.;
-                int a2 = dat_u64[i + 1] / float(0xffffffffffffffff) * 255.;
-                int a3 = dat_u64[i + 2] / float(0xffffffffffffffff) * 255.;
-
-                hist[a1 * 256 * 256 + a2 * 256 + a3]++;
+            for (; hi < ie; hi++) {
+                int64_t &c = dict[dat_u8[hi]];
+                sum += nlogn[c + 1] - nlogn[c];
+                c++;
             }
-        }
-            break;
-        case HistoDtype_t::F32: {
-            auto dat_f32 = (const float *) dat_u8;
-            hist_float_helper_3d(hist, dat_f32, n, st);
-        }
-            break;
-        case HistoDtype_t::F64: {
-            auto dat_f64 = (const double *) dat_u8;
-            hist_float_helper_3d(hist, dat_f64, n, st);
-        }
-            break;
-    }
 
-#if 0
-    n_vertices = 0;
-    float m=10000000, M=-1, a=0.;
-    for(int i=0; i<256*256*256; i++) {
-      if(hist[i] > 0) {
-        n_vertices++;
-
-        if(m > hist[i]) m = hist[i];
-        if(M < hist[i]) M = hist[i];
-        a += hist[i];
-      }
+            int64_t m = ie - is;
+            dd[di] = float(max(0., (nlogn[m] - sum) / m / 8.));
+        }
     }
-    a /= n_vertices;
-    printf("%d %f %f %f\n", n_vertices, m, M, a);
-#endif
-
-    return hist;
 }
 
-/// generate_entropy computes the entropy within bs-sized blocks of dat_u8.
+/// generate_entropy computes the entropy within windows of bs bytes of dat_u8, a window starting every step bytes.
+/// With bs * H = bs * log2(bs) - sum(c * log2(c)) over the byte counts c of a window, the sum can be kept
+/// up to date as bytes enter and leave the window using a table of c * log2(c). Overlapping windows
+/// therefore cost O(n) in total rather than O(n * bs).
 /// @param [in] dat_u8 Byte data to be analyzed.
 /// @param [in] n Length of dat_u8 in bytes.
 /// @param [out] rv_len The length of the return vector.
-/// @param [in] bs The block sized used to analyze dat_u8.
-/// @return The calculated entropy for each block of dat_u8, as vector of length rv_len scaled between [0., 1.]
-float *generate_entropy(const uint8_t *dat_u8, int64_t n, int64_t&rv_len, int64_t bs) { //, histo_dtype_t dtype) {
-    if (n <= 0) {
+/// @param [in] bs The window size used to analyze dat_u8.
+/// @param [in] step The distance between the start of consecutive windows; 0 or bs for adjacent blocks, less than bs to overlap.
+/// @param [in] cancel Optional flag polled while computing, nullptr is returned once it is set.
+/// @return The calculated entropy for each window of dat_u8, as vector of length rv_len scaled between [0., 1.]
+float *generate_entropy(const uint8_t *dat_u8, int64_t n, int64_t&rv_len, int64_t bs, int64_t step,
+                        const std::atomic<bool> *cancel) {
+    if (n <= 0 || bs <= 0) {
         rv_len = 0;
         return nullptr;
     }
 
-    int64_t inc = bs; // set to a value less than bs to create overlapping
+    int64_t inc = step > 0 ? step : bs;
 
     int64_t ddn = n / inc + (n % inc ? 1 : 0);
     auto dd = new float[ddn];
-    memset(dd, 0, sizeof(dd[0]) * ddn);
 
-    for (int64_t is = 0; is < n; is += inc) {
-        int64_t ie = min(n, is + bs);
+    auto nlogn = entropy_nlogn_table(min(n, bs));
 
-        int dict[256] = {0};
-        for (int64_t i = is; i < ie; i++) {
-            dict[dat_u8[i]]++;
+    // The windows are computed in slices of about s_CancelSlice bytes. Each slice restarts its counts, which
+    // costs another bs bytes per slice when the windows overlap.
+    int64_t slice = max<int64_t>(1, s_CancelSlice / inc);
+    for (int64_t d0 = 0; d0 < ddn; d0 += slice) {
+        if (cancel && cancel->load()) {
+            delete[] dd;
+            rv_len = 0;
+            return nullptr;
         }
+        entropy_windows(dat_u8 + d0 * inc, n - d0 * inc, bs, inc, min(ddn, d0 + slice) - d0, nlogn, dd + d0);
+    }
 
-        float entropy = 0.;
-        for (int i = 0; i < 256; i++) {
-            float p = dict[i] / float(ie - is);
-            if (p > 0.) {
-                entropy += -p * logf(p);
-            }
-        }
-        entropy /= logf(2.0);
-        entropy /= 8.0;
+    rv_len = ddn;
+    return dd;
+}
+
+
+CStreamAccum::CStreamAccum(int64_t window, int64_t align, int64_t origin)
+        : m_Window(max<int64_t>(1, window)),
+          m_Align(max<int64_t>(1, align)),
+          m_Origin(origin),
+          m_End(origin) {
+}
+
+/// feed appends the next n bytes of the stream.
+/// @param [in] dat_u8 Byte data to be analyzed, following the bytes fed previously.
+/// @param [in] n Length of dat_u8 in bytes.
+void CStreamAccum::feed(const uint8_t *dat_u8, int64_t n) {
+    if (n <= 0) {
+        return;
+    }
+
+    int64_t keep = m_Window - 1;
+
+    // Items whose last byte arrives with this chunk, first those starting in the bytes already fed.
+    stitch(dat_u8, min(n, keep));
+    countSpan(dat_u8, m_End, m_End, m_End + n - keep);
 
-        int64_t di = is / bs;
-        if (di >= ddn) {
-            printf("%lld %lld %lld %lld\n", is, bs, is/bs, n);
-            continue;
+    if (int64_t(m_Head.size()) < keep) {
+        m_Head.insert(m_Head.end(), dat_u8, dat_u8 + min(n, keep - int64_t(m_Head.size())));
+    }
+
+    if (n >= keep) {
+        m_Tail.assign(dat_u8 + n - keep, dat_u8 + n);
+    } else {
+        m_Tail.insert(m_Tail.end(), dat_u8, dat_u8 + n);
+        if (int64_t(m_Tail.size()) > keep) {
+            m_Tail.erase(m_Tail.begin(), m_Tail.end() - keep);
         }
+    }
 
-        dd[di] = entropy;
+    m_End += n;
+}
+
+/// mergeStream appends the stream seen by other, which must start where this one ends, and counts
+/// the items straddling the two. The caller adds the items counted by other.
+/// @return False if other does not continue this stream.
+bool CStreamAccum::mergeStream(const CStreamAccum &other) {
+    if (other.m_Window != m_Window || other.m_Align != m_Align || other.m_Origin != m_End) {
+        return false;
+    }
+    if (other.m_End == other.m_Origin) {
+        return true;
     }
 
-    rv_len = ddn;
+    int64_t keep = m_Window - 1;
+
+    stitch(other.m_Head.data(), other.m_Head.size());
+
+    if (int64_t(m_Head.size()) < keep) {
+        m_Head.insert(m_Head.end(), other.m_Head.begin(),
+                      other.m_Head.begin() + min<int64_t>(other.m_Head.size(), keep - int64_t(m_Head.size())));
+    }
+
+    m_Tail.insert(m_Tail.end(), other.m_Tail.begin(), other.m_Tail.end());
+    if (int64_t(m_Tail.size()) > keep) {
+        m_Tail.erase(m_Tail.begin(), m_Tail.end() - keep);
+    }
+
+    m_End = other.m_End;
+    return true;
+}
+
+/// stitch counts the items starting within the kept tail that end within the following head_len bytes.
+void CStreamAccum::stitch(const uint8_t *head, int64_t head_len) {
+    if (m_Tail.empty() || head_len <= 0) {
+        return;
+    }
+
+    std::vector<uint8_t> buf(m_Tail);
+    buf.insert(buf.end(), head, head + head_len);
+
+    int64_t off = m_End - int64_t(m_Tail.size());
+    countSpan(buf.data(), off, off, min(m_End, m_End + head_len - m_Window + 1));
+}
+
+/// countSpan counts the aligned items starting at stream offsets [s_lo, s_hi), p holding the bytes from stream offset p_off.
+void CStreamAccum::countSpan(const uint8_t *p, int64_t p_off, int64_t s_lo, int64_t s_hi) {
+    int64_t s0 = (s_lo + m_Align - 1) / m_Align * m_Align;
+    if (s0 >= s_hi) {
+        return;
+    }
+
+    countStarts(p + (s0 - p_off), (s_hi - s0 + m_Align - 1) / m_Align);
+}
+
+
+CHistoAccum::CHistoAccum(HistoDtype_t dtype, int64_t origin)
+        : CStreamAccum(histo_dtype_size(dtype), histo_dtype_size(dtype), origin),
+          m_Dtype(dtype) {
+    memset(m_Counts, 0, sizeof(m_Counts));
+}
+
+void CHistoAccum::countStarts(const uint8_t *p, int64_t count) {
+    if (m_Dtype == HistoDtype_t::U8) {
+        count_bytes(p, count, m_Counts);
+    } else if (auto fn = ngram_kernel<1, CDenseCounts<uint64_t> >(m_Dtype)) {
+        CDenseCounts<uint64_t> dc(m_Counts);
+        fn(dc, p, 0, count, 1);
+    }
+}
+
+/// merge adds the counts of other, which must cover the bytes following those fed to this accumulator.
+bool CHistoAccum::merge(const CHistoAccum &other) {
+    if (other.m_Dtype != m_Dtype || !mergeStream(other)) {
+        return false;
+    }
+    for (int i = 0; i < 256; i++) {
+        m_Counts[i] += other.m_Counts[i];
+    }
+    return true;
+}
+
+/// finish returns the histogram of the bytes fed so far, as generate_histo would for the whole stream.
+float *CHistoAccum::finish() const {
+    return generate_histo(m_Counts);
+}
+
+
+CHisto2DAccum::CHisto2DAccum(HistoDtype_t dtype, int64_t origin)
+        : CStreamAccum(2 * histo_dtype_size(dtype), histo_dtype_size(dtype), origin),
+          m_Dtype(dtype),
+          m_Counts(256 * 256, 0) {
+}
+
+void CHisto2DAccum::countStarts(const uint8_t *p, int64_t count) {
+    if (auto fn = ngram_kernel<2, CDenseCounts<uint64_t> >(m_Dtype)) {
+        CDenseCounts<uint64_t> dc(m_Counts.data());
+        fn(dc, p, 0, count, 1);
+    }
+}
+
+/// merge adds the counts of other, which must cover the bytes following those fed to this accumulator.
+bool CHisto2DAccum::merge(const CHisto2DAccum &other) {
+    if (other.m_Dtype != m_Dtype || !mergeStream(other)) {
+        return false;
+    }
+    for (int i = 0; i < 256 * 256; i++) {
+        m_Counts[i] += other.m_Counts[i];
+    }
+    return true;
+}
+
+/// finish returns the 2d histogram of the digrams fed so far, as generate_histo_2d would for the whole
+/// stream. Counts beyond the range of int are saturated.
+int *CHisto2DAccum::finish() const {
+    auto hist = new int[256 * 256];
+    for (int i = 0; i < 256 * 256; i++) {
+        hist[i] = int(min<uint64_t>(m_Counts[i], INT_MAX));
+    }
+    return hist;
+}
+
+
+CHisto3DAccum::CHisto3DAccum(HistoDtype_t dtype, bool overlap, int64_t origin)
+        : CStreamAccum(3 * histo_dtype_size(dtype), (overlap ? 1 : 3) * histo_dtype_size(dtype), origin),
+          m_Dtype(dtype),
+          m_Overlap(overlap),
+          m_Pages(new CTrigramPages<uint64_t>) {
+}
+
+CHisto3DAccum::~CHisto3DAccum() = default;
+
+void CHisto3DAccum::countStarts(const uint8_t *p, int64_t count) {
+    if (auto fn = ngram_kernel<3, CTrigramPages<uint64_t> >(m_Dtype)) {
+        int st = m_Overlap ? 1 : 3;
+        fn(*m_Pages, p, 0, count * st, st);
+    }
+}
+
+/// merge adds the counts of other, which must cover the bytes following those fed to this accumulator.
+bool CHisto3DAccum::merge(const CHisto3DAccum &other) {
+    if (other.m_Dtype != m_Dtype || other.m_Overlap != m_Overlap || !mergeStream(other)) {
+        return false;
+    }
+    for (int pg = 0; pg < CTrigramPages<uint64_t>::s_PageCount; pg++) {
+        m_Pages->mergePage(pg, *other.m_Pages);
+    }
+    return true;
+}
+
+/// finish stores the non-zero bins of the trigrams fed so far in hist, as generate_histo_3d would for the whole stream.
+void CHisto3DAccum::finish(SparseHisto3D_t &hist) const {
+    hist.clear();
+    m_Pages->collect(hist);
+}
+
+
+CEntropyAccum::CEntropyAccum(int64_t bs, int64_t step, int64_t origin)
+        : CStreamAccum(bs, step > 0 ? step : bs, origin),
+          m_NLogN(entropy_nlogn_table(max<int64_t>(1, bs))) {
+}
+
+void CEntropyAccum::countStarts(const uint8_t *p, int64_t count) {
+    size_t i = m_Entropy.size();
+    m_Entropy.resize(i + count);
+    entropy_windows(p, (count - 1) * m_Align + m_Window, m_Window, m_Align, count, m_NLogN, m_Entropy.data() + i);
+}
+
+/// merge appends the windows of other, which must cover the bytes following those fed to this accumulator.
+bool CEntropyAccum::merge(const CEntropyAccum &other) {
+    if (!mergeStream(other)) {
+        return false;
+    }
+    m_Entropy.insert(m_Entropy.end(), other.m_Entropy.begin(), other.m_Entropy.end());
+    return true;
+}
+
+/// finish returns the entropy of every window started so far, as generate_entropy would for the whole
+/// stream. The windows still waiting for bytes are truncated at the end of the stream.
+/// @param [out] rv_len The length of the return vector.
+float *CEntropyAccum::finish(int64_t &rv_len) const {
+    int64_t off = m_End - int64_t(m_Tail.size());
+    int64_t s0 = (max(off, m_End - m_Window + 1) + m_Align - 1) / m_Align * m_Align;
+    int64_t pending = s0 < m_End ? (m_End - s0 + m_Align - 1) / m_Align : 0;
+
+    rv_len = int64_t(m_Entropy.size()) + pending;
+    if (rv_len == 0) {
+        return nullptr;
+    }
+
+    auto dd = new float[rv_len];
+    std::copy(m_Entropy.begin(), m_Entropy.end(), dd);
+    if (pending > 0) {
+        entropy_windows(m_Tail.data() + (s0 - off), m_End - s0, m_Window, m_Align, pending, m_NLogN,
+                        dd + m_Entropy.size());
+    }
     return dd;
 }
@@ -17,6 +17,9 @@
  *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <vector>
+
 #include <QtGui>
 #include <QGridLayout>
 #include <QSpinBox>
@@ -25,6 +28,16 @@
 #include "image_view.h"
 #include "bayer.h"
 
+// Images are limited to this many rows, far more than can be told apart on screen once scaled, the rest
+// of a larger selection is not drawn. This also keeps them well within QImage's limit of 2^31 bytes.
+static const int64_t s_MaxImageRows = 32768;
+
+/// image_pixels returns the number of whole pixels of bytes_per_pixel bytes from offset to the end of
+/// size bytes, limited to s_MaxImageRows rows of w pixels.
+static int64_t image_pixels(int64_t size, int64_t offset, int64_t bytes_per_pixel, int w) {
+    int64_t n = std::max<int64_t>(0, size - offset) / bytes_per_pixel;
+    return std::min(n, s_MaxImageRows * w);
+}
 
 CImageView::CImageView(QWidget *p)
         : QLabel(p),
@@ -220,11 +233,11 @@ void CImageView::parametersChanged() {
     switch (t) {
         case dtype_t::RGB8: {
             auto dat_u8 = m_Data + offset;
-            int n = (m_Size - offset) / 1 / 3;
+            int64_t n = image_pixels(m_Size, offset, 1 * 3, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = dat_u8[i * 3 + 0];
                 unsigned char g = dat_u8[i * 3 + 1];
                 unsigned char b = dat_u8[i * 3 + 2];
@@ -235,11 +248,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::RGB12: {
             auto dat_u16 = (const unsigned short *) (m_Data + offset);
-            int n = (m_Size - offset) / 2 / 3;
+            int64_t n = image_pixels(m_Size, offset, 2 * 3, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = (dat_u16[i * 3 + 0] >> 4) & 0xff;
                 unsigned char g = (dat_u16[i * 3 + 1] >> 4) & 0xff;
                 unsigned char b = (dat_u16[i * 3 + 2] >> 4) & 0xff;
@@ -250,11 +263,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::RGB16: {
             auto dat_u16 = (const unsigned short *) (m_Data + offset);
-            int n = (m_Size - offset) / 2 / 3;
+            int64_t n = image_pixels(m_Size, offset, 2 * 3, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = (dat_u16[i * 3 + 0] >> 8) & 0xff;
                 unsigned char g = (dat_u16[i * 3 + 1] >> 8) & 0xff;
                 unsigned char b = (dat_u16[i * 3 + 2] >> 8) & 0xff;
@@ -265,11 +278,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::RGBA8: {
             auto dat_u8 = (const unsigned char *) (m_Data + offset);
-            int n = (m_Size - offset) / 1 / 4;
+            int64_t n = image_pixels(m_Size, offset, 1 * 4, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = dat_u8[i * 4 + 0];
                 unsigned char g = dat_u8[i * 4 + 1];
                 unsigned char b = dat_u8[i * 4 + 2];
@@ -280,11 +293,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::RGBA12: {
             auto dat_u16 = (const unsigned short *) (m_Data + offset);
-            int n = (m_Size - offset) / 2 / 4;
+            int64_t n = image_pixels(m_Size, offset, 2 * 4, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = (dat_u16[i * 4 + 0] >> 4) & 0xff;
                 unsigned char g = (dat_u16[i * 4 + 1] >> 4) & 0xff;
                 unsigned char b = (dat_u16[i * 4 + 2] >> 4) & 0xff;
@@ -295,11 +308,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::RGBA16: {
             auto dat_u16 = (const unsigned short *) (m_Data + offset);
-            int n = (m_Size - offset) / 2 / 4;
+            int64_t n = image_pixels(m_Size, offset, 2 * 4, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = dat_u16[i * 4 + 0] >> 8;
                 unsigned char g = dat_u16[i * 4 + 1] >> 8;
                 unsigned char b = dat_u16[i * 4 + 2] >> 8;
@@ -310,11 +323,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::BGR8: {
             auto dat_u8 = (const unsigned char *) (m_Data + offset);
-            int n = (m_Size - offset) / 1 / 3;
+            int64_t n = image_pixels(m_Size, offset, 1 * 3, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = dat_u8[i * 3 + 2];
                 unsigned char g = dat_u8[i * 3 + 1];
                 unsigned char b = dat_u8[i * 3 + 0];
@@ -325,11 +338,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::BGR12: {
             auto dat_u16 = (const unsigned short *) (m_Data + offset);
-            int n = (m_Size - offset) / 2 / 3;
+            int64_t n = image_pixels(m_Size, offset, 2 * 3, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = (dat_u16[i * 3 + 2] >> 4) & 0xff;
                 unsigned char g = (dat_u16[i * 3 + 1] >> 4) & 0xff;
                 unsigned char b = (dat_u16[i * 3 + 0] >> 4) & 0xff;
@@ -340,11 +353,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::BGR16: {
             auto dat_u16 = (const unsigned short *) (m_Data + offset);
-            int n = (m_Size - offset) / 2 / 3;
+            int64_t n = image_pixels(m_Size, offset, 2 * 3, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = (dat_u16[i * 3 + 2] >> 8) & 0xff;
                 unsigned char g = (dat_u16[i * 3 + 1] >> 8) & 0xff;
                 unsigned char b = (dat_u16[i * 3 + 0] >> 8) & 0xff;
@@ -355,11 +368,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::BGRA8: {
             auto dat_u8 = (const unsigned char *) (m_Data + offset);
-            int n = (m_Size - offset) / 1 / 4;
+            int64_t n = image_pixels(m_Size, offset, 1 * 4, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = dat_u8[i * 4 + 2];
                 unsigned char g = dat_u8[i * 4 + 1];
                 unsigned char b = dat_u8[i * 4 + 0];
@@ -370,11 +383,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::BGRA12: {
             auto dat_u16 = (const unsigned short *) (m_Data + offset);
-            int n = (m_Size - offset) / 2 / 4;
+            int64_t n = image_pixels(m_Size, offset, 2 * 4, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = (dat_u16[i * 4 + 2] >> 4) & 0xff;
                 unsigned char g = (dat_u16[i * 4 + 1] >> 4) & 0xff;
                 unsigned char b = (dat_u16[i * 4 + 0] >> 4) & 0xff;
@@ -385,11 +398,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::BGRA16: {
             auto dat_u16 = (const unsigned short *) (m_Data + offset);
-            int n = (m_Size - offset) / 2 / 4;
+            int64_t n = image_pixels(m_Size, offset, 2 * 4, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = (dat_u16[i * 4 + 2] >> 8) & 0xff;
                 unsigned char g = (dat_u16[i * 4 + 1] >> 8) & 0xff;
                 unsigned char b = (dat_u16[i * 4 + 0] >> 8) & 0xff;
@@ -400,11 +413,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::GREY8: {
             auto dat_u8 = (const unsigned char *) (m_Data + offset);
-            int n = (m_Size - offset) / 1;
+            int64_t n = image_pixels(m_Size, offset, 1, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char c = dat_u8[i];
                 unsigned char r = c;
                 unsigned char g = c;
@@ -416,11 +429,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::GREY12: {
             auto dat_u16 = (const unsigned short *) (m_Data + offset);
-            int n = (m_Size - offset) / 2;
+            int64_t n = image_pixels(m_Size, offset, 2, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char c = (dat_u16[i] >> 4) & 0xff;
                 unsigned char r = c;
                 unsigned char g = c;
@@ -432,11 +445,11 @@ void CImageView::parametersChanged() {
             break;
         case dtype_t::GREY16: {
             auto dat_u16 = (const unsigned short *) (m_Data + offset);
-            int n = (m_Size - offset) / 2;
+            int64_t n = image_pixels(m_Size, offset, 2, w);
             img = QImage(w, n / w + 1, QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (int i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char c = (dat_u16[i] >> 8) & 0xff;
                 unsigned char r = c;
                 unsigned char g = c;
@@ -470,13 +483,13 @@ void CImageView::parametersChanged() {
         case dtype_t::BAYER8_21:
         case dtype_t::BAYER8_22:
         case dtype_t::BAYER8_23: {
-            int h = m_Size / w + 1;
-            //int bayer_n = w * h;
+            // Only whole rows are demosaiced, bayerBG reads all w * h bytes.
+            int h = int(image_pixels(m_Size, offset, 1, w) / w);
 
             auto dat_u8 = (const unsigned char *) (m_Data + offset);
 
             const unsigned char *bayer = dat_u8;
-            auto rgb = new unsigned char[w * h * 3];
+            std::vector<unsigned char> rgb(int64_t(w) * h * 3);
             int perm = 0;
             switch (t) {
                 case dtype_t::BAYER8_0:
@@ -552,13 +565,13 @@ void CImageView::parametersChanged() {
                     perm = 23;
                     break;
             }
-            bayerBG(bayer, h, w, perm, rgb);
+            bayerBG(bayer, h, w, perm, rgb.data());
 
-            qsizetype n = (m_Size - offset) / 1;
-            img = QImage(w, h, QImage::Format_RGB32);
+            int64_t n = int64_t(w) * h;
+            img = QImage(w, std::max(1, h), QImage::Format_RGB32);
             img.fill(0);
             auto p = (unsigned int *) img.bits();
-            for (qsizetype i = 0; i < n; i++) {
+            for (int64_t i = 0; i < n; i++) {
                 unsigned char r = rgb[i * 3 + 0];
                 unsigned char g = rgb[i * 3 + 1];
                 unsigned char b = rgb[i * 3 + 2];
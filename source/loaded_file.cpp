@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "byte_count.h"
+#include "histogram_calc.h"
+#include "loaded_file.h"
+
+using std::min;
+using std::max;
+
+// The pass over a file is made in chunks of this size, the unit of progress and of cancellation.
+static const int64_t s_AnalyzeChunk = 32 << 20;
+
+// The entropy preview has at most this many samples, each averaging s_PreviewWindows windows.
+static const int64_t s_PreviewSamples = 4096;
+static const int64_t s_PreviewWindows = 32;
+
+// Block size of the entropy pyramid's base level.
+static const int64_t s_PyramidBlockSize = 256;
+
+// Used when no budget is set.
+static const int64_t s_DefaultBudget = int64_t(1) << 30;
+
+bool LoadParams_t::operator==(const LoadParams_t &o) const {
+    for (int i = 0; i < 2; i++) {
+        if (overview_w[i] != o.overview_w[i] || overview_h[i] != o.overview_h[i] ||
+            byte_classes[i] != o.byte_classes[i] || hilbert[i] != o.hilbert[i]) {
+            return false;
+        }
+    }
+    return entropy_window == o.entropy_window;
+}
+
+bool HistoKey_t::operator==(const HistoKey_t &o) const {
+    return valid == o.valid && start == o.start && end == o.end && dtype == o.dtype && overlap == o.overlap;
+}
+
+CLoadedFile::CLoadedFile()
+        : m_Loaded(0), m_PyramidReady(false) {
+}
+
+/// open maps filename, the analyses are then made by analyze().
+/// @return False if the file cannot be read.
+bool CLoadedFile::open(const std::string &filename) {
+    if (!m_File.open(filename)) {
+        return false;
+    }
+
+    m_Filename = filename;
+    setup(m_Params);
+    return true;
+}
+
+/// setup discards the results of any previous pass and prepares for one with params.
+/// Must not be called while analyze() runs.
+void CLoadedFile::setup(const LoadParams_t &params) {
+    m_Params = params;
+
+    const uint8_t *dat = m_File.data();
+    int64_t n = m_File.size();
+
+    m_ByteIndex.begin(dat, n);
+    m_ClassPyramid.begin(dat, n, byte_classes_scheme());
+    for (int i = 0; i < 2; i++) {
+        m_Overview[i].layout(n, params.overview_w[i], params.overview_h[i], params.byte_classes[i], params.hilbert[i]);
+    }
+
+    int64_t bs = max<int64_t>(1, params.entropy_window);
+    m_EntropyPreview.assign(min(s_PreviewSamples, max<int64_t>(1, n / bs)), 0.f);
+
+    m_Loaded = 0;
+}
+
+/// analyze makes the pass over the file, or the remainder of a cancelled one.
+/// @param [in] cancel Optional flag polled between chunks.
+/// @return False if cancelled before the whole file was analyzed.
+bool CLoadedFile::analyze(const std::atomic<bool> *cancel) {
+    const uint8_t *dat = m_File.data();
+    int64_t n = m_File.size();
+    int64_t done = loaded();
+
+    int64_t samples = m_EntropyPreview.size();
+    int64_t preview_done = entropyPreviewDone(done);
+    int64_t bs = max<int64_t>(1, m_Params.entropy_window);
+
+    // The pass reads the whole file in order.
+    if (done < n) m_File.advise(CMappedFile::Access_t::SEQUENTIAL, done);
+
+    while (done < n) {
+        if (cancel && cancel->load()) {
+            return false;
+        }
+
+        int64_t end = min(n, done + s_AnalyzeChunk);
+        m_ByteIndex.extend(end);
+        m_ClassPyramid.extend(end);
+
+        for (auto &ov : m_Overview) {
+            ov.render(dat, ov.pixelsWithin(done), ov.pixelsWithin(end));
+        }
+
+        // Each preview sample averages the entropy of a few windows spread over its share of the file.
+        int64_t preview_end = entropyPreviewDone(end);
+        for (; preview_done < preview_end; preview_done++) {
+            int64_t b0 = preview_done * n / samples;
+            int64_t b1 = (preview_done + 1) * n / samples;
+            int64_t w = min(bs, b1 - b0);
+            int64_t k = min(s_PreviewWindows, max<int64_t>(1, (b1 - b0) / w));
+
+            double sum = 0.;
+            for (int64_t j = 0; j < k; j++) {
+                int64_t o = b0 + (k > 1 ? j * (b1 - b0 - w) / (k - 1) : 0);
+                uint64_t counts[256] = {0};
+                count_bytes(dat + o, w, counts);
+                sum += histo_entropy(counts) / 8.;
+            }
+            m_EntropyPreview[preview_done] = float(sum / k);
+        }
+
+        done = end;
+        m_Loaded.store(done, std::memory_order_release);
+    }
+
+    return true;
+}
+
+/// buildPyramid builds the entropy pyramid, another pass over the whole file, unless already built.
+/// @param [in] cancel Optional flag polled while building.
+/// @return False if cancelled.
+bool CLoadedFile::buildPyramid(const std::atomic<bool> *cancel) {
+    if (pyramidReady()) {
+        return true;
+    }
+
+    if (!m_EntropyPyramid.build(m_File.data(), m_File.size(), s_PyramidBlockSize, cancel)) {
+        return false;
+    }
+
+    // The passes over the whole file are done, the views read it at random from now on.
+    m_File.advise(CMappedFile::Access_t::NORMAL);
+
+    m_PyramidReady.store(true, std::memory_order_release);
+    return true;
+}
+
+/// buildHistograms computes the histograms of the views with a valid key, unless already kept for that key.
+/// @param [in] cancel Optional flag polled while computing.
+/// @return False if cancelled.
+bool CLoadedFile::buildHistograms(const HistoKey_t &key2d, const HistoKey_t &key3d, const std::atomic<bool> *cancel) {
+    const uint8_t *dat = m_File.data();
+
+    if (key2d.valid && !histo2D(key2d)) {
+        std::shared_ptr<int> hist(generate_histo_2d(dat + key2d.start, key2d.end - key2d.start, key2d.dtype, cancel),
+                                  std::default_delete<int[]>());
+        if (!hist) return false;
+        setHisto2D(key2d, hist);
+    }
+
+    if (key3d.valid && !histo3D(key3d)) {
+        auto hist = std::make_shared<SparseHisto3D_t>();
+        if (!generate_histo_3d(dat + key3d.start, key3d.end - key3d.start, key3d.dtype, *hist, key3d.overlap, cancel)) {
+            return false;
+        }
+        setHisto3D(key3d, hist);
+    }
+
+    return true;
+}
+
+/// histo2D returns the kept 2D histogram if computed for key, or null.
+std::shared_ptr<int> CLoadedFile::histo2D(const HistoKey_t &key) const {
+    std::lock_guard<std::mutex> lock(m_HistoMutex);
+    return key.valid && key == m_Histo2DKey ? m_Histo2D : nullptr;
+}
+
+/// histo3D returns the kept 3D histogram if computed for key, or null.
+std::shared_ptr<const SparseHisto3D_t> CLoadedFile::histo3D(const HistoKey_t &key) const {
+    std::lock_guard<std::mutex> lock(m_HistoMutex);
+    return key.valid && key == m_Histo3DKey ? m_Histo3D : nullptr;
+}
+
+/// setHisto2D keeps histogram, computed for key, in place of the last one.
+void CLoadedFile::setHisto2D(const HistoKey_t &key, const std::shared_ptr<int> &histogram) {
+    std::lock_guard<std::mutex> lock(m_HistoMutex);
+    m_Histo2DKey = key;
+    m_Histo2D = histogram;
+}
+
+/// setHisto3D keeps histogram, computed for key, in place of the last one.
+void CLoadedFile::setHisto3D(const HistoKey_t &key, const std::shared_ptr<const SparseHisto3D_t> &histogram) {
+    std::lock_guard<std::mutex> lock(m_HistoMutex);
+    m_Histo3DKey = key;
+    m_Histo3D = histogram;
+}
+
+/// entropyPreviewDone returns the number of leading entropy preview samples covered by the first bytes bytes.
+int64_t CLoadedFile::entropyPreviewDone(int64_t bytes) const {
+    int64_t n = m_File.size();
+    int64_t samples = m_EntropyPreview.size();
+    if (bytes >= n) return samples;
+
+    // Sample s covers [s * n / samples, (s + 1) * n / samples).
+    return min(samples, ((bytes + 1) * samples - 1) / n);
+}
+
+/// memoryUsage returns the memory held by the analyses and histograms, and by the file's contents if they were read onto
+/// the heap. Mapped pages are not counted: they belong to the page cache, which the system reclaims itself.
+int64_t CLoadedFile::memoryUsage() const {
+    int64_t rv = (m_File.isMapped() ? 0 : m_File.size()) + m_ByteIndex.memoryUsage() + m_ClassPyramid.memoryUsage() +
+                 int64_t(m_EntropyPreview.capacity() * sizeof(float));
+    for (const auto &ov : m_Overview) {
+        rv += ov.memoryUsage();
+    }
+    if (pyramidReady()) {
+        rv += m_EntropyPyramid.memoryUsage();
+    }
+
+    std::lock_guard<std::mutex> lock(m_HistoMutex);
+    if (m_Histo2D) rv += 256 * 256 * int64_t(sizeof(int));
+    if (m_Histo3D) rv += int64_t(m_Histo3D->capacity() * sizeof(Trigram_t));
+    return rv;
+}
+
+/// expectedMemoryUsage estimates from the file's size what memoryUsage() returns once it is analyzed with
+/// params, its entropy pyramid built and the histograms of the valid keys computed. A file already analyzed
+/// keeps its own params.
+/// @param [in] params The parameters the file would be set up with.
+/// @param [in] key2d The 2D histogram to compute, if valid; the one kept otherwise.
+/// @param [in] key3d The 3D histogram to compute, if valid; the one kept otherwise.
+/// @param [out] transient Optional, set to the memory only held while the histograms are computed.
+/// @return The estimated number of bytes.
+int64_t CLoadedFile::expectedMemoryUsage(const LoadParams_t &params, const HistoKey_t &key2d, const HistoKey_t &key3d,
+                                         int64_t *transient) const {
+    const LoadParams_t &p = analyzed() ? m_Params : params;
+    int64_t n = size();
+
+    int64_t rv = (m_File.isMapped() ? 0 : n) + CByteIndex::expectedMemoryUsage(n) +
+                 CClassPyramid::expectedMemoryUsage(n, byte_classes_scheme()) +
+                 int64_t(min(s_PreviewSamples, max<int64_t>(1, n / max<int64_t>(1, p.entropy_window))) * sizeof(float)) +
+                 CEntropyPyramid::expectedMemoryUsage(n, s_PyramidBlockSize);
+    for (int i = 0; i < 2; i++) {
+        rv += COverviewImage::expectedMemoryUsage(n, p.overview_w[i], p.overview_h[i], p.hilbert[i]);
+    }
+
+    int64_t pages = 0;
+    std::lock_guard<std::mutex> lock(m_HistoMutex);
+    if (key2d.valid || m_Histo2D) rv += 256 * 256 * int64_t(sizeof(int));
+    if (key3d.valid && !(m_Histo3D && m_Histo3DKey == key3d)) {
+        rv += histo_3d_memory_usage(key3d.end - key3d.start, key3d.dtype, key3d.overlap, &pages);
+    } else if (m_Histo3D) {
+        rv += int64_t(m_Histo3D->capacity() * sizeof(Trigram_t));
+    }
+
+    if (transient) *transient = pages;
+    return rv;
+}
+
+CFileCache::CFileCache()
+        : m_Budget(s_DefaultBudget) {
+}
+
+void CFileCache::setBudget(int64_t bytes) {
+    m_Budget = bytes;
+    trim();
+}
+
+/// find returns the cached file named filename, marking it as the most recently used, or null.
+std::shared_ptr<CLoadedFile> CFileCache::find(const std::string &filename) {
+    for (auto i = m_Files.begin(); i != m_Files.end(); ++i) {
+        if ((*i)->filename() == filename) {
+            auto f = *i;
+            m_Files.erase(i);
+            m_Files.push_front(f);
+            return f;
+        }
+    }
+    return nullptr;
+}
+
+/// insert adds f as the most recently used file, evicting others if over budget.
+void CFileCache::insert(const std::shared_ptr<CLoadedFile> &f) {
+    m_Files.remove(f);
+    m_Files.push_front(f);
+    trim();
+}
+
+/// trim evicts the least recently used files no longer referenced elsewhere until within budget.
+void CFileCache::trim() {
+    int64_t usage = memoryUsage();
+    for (auto i = m_Files.end(); i != m_Files.begin() && usage > m_Budget;) {
+        --i;
+        if (i->use_count() == 1) {
+            usage -= (*i)->memoryUsage();
+            i = m_Files.erase(i);
+        }
+    }
+}
+
+void CFileCache::clear() {
+    m_Files.clear();
+}
+
+/// memoryUsage returns the memory held by all cached files.
+int64_t CFileCache::memoryUsage() const {
+    int64_t rv = 0;
+    for (const auto &f : m_Files) {
+        rv += f->memoryUsage();
+    }
+    return rv;
+}
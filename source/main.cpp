@@ -42,8 +42,7 @@ int main(int argc, char *argv[]) {
     QCoreApplication::setOrganizationDomain("confluencerd.com");
     QCoreApplication::setApplicationName("binary_visualizer");
 
-    QString absPath = QDir(QApplication::applicationDirPath()).filePath("settings/style.ini");
-    QSettings settings(absPath, QSettings::IniFormat);
+    QSettings settings(CMain::settingsFile(), QSettings::IniFormat);
     QVariant darkMode = settings.value("theme/darkMode", "0");
     const char* style_set = darkMode.toBool() ? ":/qstyle/dark/style.qss" : ":/qstyle/light/style.qss";
 
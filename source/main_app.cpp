@@ -17,6 +17,7 @@
  *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 
@@ -25,11 +26,16 @@
 #include <QFileDialog>
 #include <QGridLayout>
 #include <QHBoxLayout>
+#include <QLineEdit>
+#include <QProgressBar>
 #include <QPushButton>
 #include <QSettings>
 #include <QShortcut>
+#include <QSpinBox>
 #include <QStyleFactory>
+#include <QTimer>
 #include <QApplication>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include "main_app.h"
 #include "binary_viewer.h"
@@ -40,9 +46,40 @@
 #include "histogram_3d_view.h"
 #include "plot_view.h"
 #include "histogram_calc.h"
+#include "byte_classes.h"
 
 static const int s_ScrollWidth = 16 * 8;
 
+// The entropy plot only has a few hundred rows, so the step is raised when it would produce more samples than this.
+static const int64_t s_MaxEntropySamples = 1 << 24;
+
+/// entropy_step returns the step of the entropy plot of n bytes, step raised so as not to exceed s_MaxEntropySamples.
+static int64_t entropy_step(int64_t step, int64_t n) {
+    return std::max(step, (n + s_MaxEntropySamples - 1) / s_MaxEntropySamples);
+}
+
+// Points per row of the entropy plot read from the entropy pyramid once the selection settles.
+static const int64_t s_EntropyPointsPerRow = 4;
+
+// Interval between updates of the views while loading, for 60 Hz.
+static const int s_LoadRefreshMs = 16;
+
+// While the selection is dragged, the views are previewed at most this often, and fully updated once it
+// has not moved for s_RangeSettleMs.
+static const int s_RangePreviewMs = 16;
+static const int s_RangeSettleMs = 250;
+
+// The entropy plot is recomputed once the window and step have not changed for this long.
+static const int s_EntropyParamsMs = 250;
+
+// Interval between updates of the search hits shown while a search runs.
+static const int s_SearchRefreshMs = 100;
+
+// Defaults of the settings cache/budget_mb, the memory kept for recently viewed and prefetched files,
+// and cache/prefetch, the number of files following the current one to analyze ahead.
+static const int s_DefaultCacheBudgetMB = 1024;
+static const int s_DefaultPrefetchCount = 2;
+
 void CMain::toggleFullScreen() {
 
     m_ViewModeToggled = true;
@@ -65,8 +102,7 @@ void CMain::toggleLightMode()
 {
     loadStyle(":/qstyle/light/style.qss");
 
-    QString absPath = QDir(QApplication::applicationDirPath()).filePath("settings/style.ini");
-    QSettings settings(absPath, QSettings::IniFormat);
+    QSettings settings(settingsFile(), QSettings::IniFormat);
 
     settings.setValue("theme/darkMode", "0");
 }
@@ -75,8 +111,7 @@ void CMain::toggleDarkMode()
 {
     loadStyle(":/qstyle/dark/style.qss");
 
-    QString absPath = QDir(QApplication::applicationDirPath()).filePath("settings/style.ini");
-    QSettings settings(absPath, QSettings::IniFormat);
+    QSettings settings(settingsFile(), QSettings::IniFormat);
 
     settings.setValue("theme/darkMode", "1");
 }
@@ -87,6 +122,19 @@ CMain::CMain(QWidget *p)
     , m_Size(0)
     , m_Start(0)
     , m_End(0)
+    , m_CancelBackground(false)
+    , m_CancelEntropy(false)
+    , m_EntropyGeneration(0)
+    , m_EntropyPending(false)
+    , m_CancelSearch(false)
+    , m_SearchDone(0)
+    , m_SearchShown(0)
+    , m_SearchCursor(-1)
+    , m_SearchCursorStart(-1)
+    , m_Loading(false)
+    , m_CancelLoad(false)
+    , m_CancelPrefetch(false)
+    , m_PrefetchCount(s_DefaultPrefetchCount)
     , m_CurrentFile(-1)
     , m_Initialized(false)
     , m_DoneFlag(false)
@@ -97,6 +145,56 @@ CMain::CMain(QWidget *p)
 {
     qApp->installEventFilter(this);
 
+    m_EntropyPyramidWatcher = new QFutureWatcher<bool>(this);
+    connect(m_EntropyPyramidWatcher, SIGNAL(finished()), SLOT(entropyPyramidReady()));
+
+    m_EntropyWatcher = new QFutureWatcher<EntropyJob_t>(this);
+    connect(m_EntropyWatcher, SIGNAL(finished()), SLOT(entropyReady()));
+
+    m_EntropyParamsTimer = new QTimer(this);
+    m_EntropyParamsTimer->setSingleShot(true);
+    m_EntropyParamsTimer->setInterval(s_EntropyParamsMs);
+    connect(m_EntropyParamsTimer, SIGNAL(timeout()), SLOT(entropyParametersChanged()));
+
+    m_LoadWatcher = new QFutureWatcher<bool>(this);
+    connect(m_LoadWatcher, SIGNAL(finished()), SLOT(loadFinished()));
+
+    m_LoadTimer = new QTimer(this);
+    m_LoadTimer->setInterval(s_LoadRefreshMs);
+    connect(m_LoadTimer, SIGNAL(timeout()), SLOT(loadProgress()));
+
+    m_PrefetchWatcher = new QFutureWatcher<bool>(this);
+    connect(m_PrefetchWatcher, SIGNAL(finished()), SLOT(prefetchFinished()));
+
+    m_RangePreviewTimer = new QTimer(this);
+    m_RangePreviewTimer->setSingleShot(true);
+    m_RangePreviewTimer->setInterval(s_RangePreviewMs);
+    connect(m_RangePreviewTimer, SIGNAL(timeout()), SLOT(rangePreview()));
+
+    m_SearchWatcher = new QFutureWatcher<bool>(this);
+    connect(m_SearchWatcher, SIGNAL(finished()), SLOT(searchFinished()));
+
+    m_SearchTimer = new QTimer(this);
+    m_SearchTimer->setInterval(s_SearchRefreshMs);
+    connect(m_SearchTimer, SIGNAL(timeout()), SLOT(searchProgress()));
+
+    m_RangeSettleTimer = new QTimer(this);
+    m_RangeSettleTimer->setSingleShot(true);
+    m_RangeSettleTimer->setInterval(s_RangeSettleMs);
+    connect(m_RangeSettleTimer, SIGNAL(timeout()), SLOT(rangeSettled()));
+
+    {
+        QSettings settings(settingsFile(), QSettings::IniFormat);
+        m_Cache.setBudget(int64_t(settings.value("cache/budget_mb", s_DefaultCacheBudgetMB).toInt()) << 20);
+        m_PrefetchCount = std::max(0, settings.value("cache/prefetch", s_DefaultPrefetchCount).toInt());
+
+        // The byte classes drawn by the overviews and the hex view, see CByteClasses for the format.
+        CByteClasses classes;
+        if (classes.parse(settings.value("overview/byte_classes", CByteClasses::s_DefaultScheme).toString().toStdString())) {
+            set_byte_classes_scheme(classes);
+        }
+    }
+
     this->setSizeGripEnabled(true);
     this->setAcceptDrops(true);
     this->setMinimumHeight(300);
@@ -106,6 +204,8 @@ CMain::CMain(QWidget *p)
     new QShortcut(QKeySequence(Qt::Key_F11), this, SLOT(toggleFullScreen()));
 	new QShortcut(QKeySequence(Qt::Key_F10), this, SLOT(toggleDarkMode()));
 	new QShortcut(QKeySequence(Qt::Key_F9), this, SLOT(toggleLightMode()));	
+    new QShortcut(QKeySequence(Qt::Key_F3), this, SLOT(findNext()));
+    new QShortcut(QKeySequence(Qt::SHIFT + Qt::Key_F3), this, SLOT(findPrevious()));
 
     {
         auto layout = new QHBoxLayout(p);
@@ -146,6 +246,7 @@ CMain::CMain(QWidget *p)
         m_PlotView->setMinimumSize(QSize(1, 1));
 
         connect(m_OverallPrimary, SIGNAL(rangeSelected(float, float)), SLOT(rangeSelected(float, float)));
+        connect(m_OverallPrimary, SIGNAL(selectionFinished()), SLOT(rangeSettled()));
 
         m_OverallPrimary->setFixedWidth(s_ScrollWidth);
         m_OverallZoomed->setFixedWidth(s_ScrollWidth);
@@ -177,10 +278,91 @@ CMain::CMain(QWidget *p)
             connect(m_CurrentView, SIGNAL(currentIndexChanged(int)), SLOT(switchView(int)));
             layout->addWidget(m_CurrentView);
         }
+        {
+            QSettings settings(settingsFile(), QSettings::IniFormat);
+
+            auto l = new QLabel("Entropy Window", this);
+            l->setFixedSize(l->sizeHint());
+            layout->addWidget(l);
+
+            auto sb = new QSpinBox(this);
+            sb->setRange(16, 1 << 20);
+            sb->setValue(settings.value("entropy/window", 256).toInt());
+            sb->setFixedSize(sb->sizeHint());
+            sb->setFixedWidth(sb->width() * 1.5);
+            m_EntropyWindow = sb;
+            layout->addWidget(sb);
+
+            l = new QLabel("Step", this);
+            l->setFixedSize(l->sizeHint());
+            layout->addWidget(l);
+
+            sb = new QSpinBox(this);
+            sb->setRange(1, 1 << 20);
+            sb->setValue(settings.value("entropy/step", 256).toInt());
+            sb->setFixedSize(sb->sizeHint());
+            sb->setFixedWidth(sb->width() * 1.5);
+            m_EntropyStep = sb;
+            layout->addWidget(sb);
+
+            connect(m_EntropyWindow, SIGNAL(valueChanged(int)), m_EntropyParamsTimer, SLOT(start()));
+            connect(m_EntropyStep, SIGNAL(valueChanged(int)), m_EntropyParamsTimer, SLOT(start()));
+        }
+        {
+            m_SearchMode = new QComboBox(this);
+            m_SearchMode->addItem("Hex");
+            m_SearchMode->addItem("ASCII");
+            m_SearchMode->addItem("UTF-16");
+            m_SearchMode->addItem("Regex");
+            m_SearchMode->setFixedSize(m_SearchMode->sizeHint());
+            layout->addWidget(m_SearchMode);
+
+            m_SearchText = new QLineEdit(this);
+            m_SearchText->setPlaceholderText("Search");
+            m_SearchText->setToolTip("Hex patterns are pairs of digits, ? being any nibble, as in 4d 5a ?? 0?.\n"
+                                     "Several patterns are separated by |, except for regular expressions.\n"
+                                     "F3 and Shift+F3 step through the hits.");
+            m_SearchText->setFixedWidth(200);
+            connect(m_SearchText, SIGNAL(returnPressed()), SLOT(startSearch()));
+            layout->addWidget(m_SearchText);
+
+            auto pb = new QPushButton("<", this);
+            pb->setFixedSize(pb->sizeHint().height(), pb->sizeHint().height());
+            pb->setAutoDefault(false);
+            connect(pb, SIGNAL(clicked()), SLOT(findPrevious()));
+            layout->addWidget(pb);
+
+            pb = new QPushButton(">", this);
+            pb->setFixedSize(pb->sizeHint().height(), pb->sizeHint().height());
+            pb->setAutoDefault(false);
+            connect(pb, SIGNAL(clicked()), SLOT(findNext()));
+            layout->addWidget(pb);
+
+            m_SearchStatus = new QLabel(this);
+            layout->addWidget(m_SearchStatus);
+        }
         {
             m_Filename = new QLabel(this);
             layout->addWidget(m_Filename);
         }
+        {
+            m_LoadProgress = new QProgressBar(this);
+            m_LoadProgress->setRange(0, 1000);
+            m_LoadProgress->setTextVisible(false);
+            m_LoadProgress->setFixedWidth(120);
+            m_LoadProgress->hide();
+            layout->addWidget(m_LoadProgress);
+
+            m_LoadCancel = new QPushButton("Cancel", this);
+            m_LoadCancel->setFixedSize(m_LoadCancel->sizeHint());
+            m_LoadCancel->hide();
+            connect(m_LoadCancel, SIGNAL(clicked()), SLOT(cancelLoad()));
+            layout->addWidget(m_LoadCancel);
+        }
+        {
+            m_Summary = new QLabel(this);
+            layout->addWidget(m_Summary);
+        }
 
         top_layout->addLayout(layout, 0, 1);
     }
@@ -193,8 +375,13 @@ CMain::CMain(QWidget *p)
         m_DotPlot = new CDotPlot(this);
 
         m_Histogram3D->setMinimumSize(QSize(1, 1));
+        connect(m_Histogram3D, SIGNAL(histogramReady(const quint8 *, qsizetype)),
+                SLOT(histogram3DReady(const quint8 *, qsizetype)));
         m_Histogram2D->setMinimumSize(QSize(1, 1));
+        connect(m_Histogram2D, SIGNAL(histogramReady(const quint8 *, qsizetype)),
+                SLOT(histogram2DReady(const quint8 *, qsizetype)));
         m_HexView->setMinimumSize(QSize(1, 1));
+        connect(m_HexView, SIGNAL(startChanged(qsizetype)), SLOT(hexStartChanged(qsizetype)));
         m_ImageView->setMinimumSize(QSize(1, 1));
         m_DotPlot->setMinimumSize(QSize(1, 1));
 
@@ -267,6 +454,8 @@ void CMain::quit() {
     if (!m_DoneFlag) {
         m_DoneFlag = true;
 
+        stopBackgroundJobs();
+
         exit(EXIT_SUCCESS);
     }
 }
@@ -283,35 +472,343 @@ bool CMain::loadFile(const QString &filename) {
     }
     g_currentfile = filename;
 
-    QFile file(filename.toStdString().c_str());
-    if (!file.open(QIODevice::OpenModeFlag::ReadOnly)) {
-        fprintf(stderr, "Unable to open: '%s'\n", filename.toStdString().c_str());
-        return false;
-    }
-
-    if (m_Data != nullptr) {
-        delete[] m_Data;
-        m_Data = nullptr;
-        m_Size = 0;
-        m_Start = 0;
-        m_End = 0;
+    // A prefetch job may be working on the file, it resumes in the foreground below.
+    stopPrefetch();
+
+    // The current file stays loaded if the new one cannot be opened.
+    std::string name = filename.toStdString();
+    auto f = m_Cache.find(name);
+    if (!f) {
+        f = std::make_shared<CLoadedFile>();
+        if (!f->open(name)) {
+            fprintf(stderr, "Unable to open: '%s'\n", name.c_str());
+            startPrefetch();
+            return false;
+        }
     }
 
-    qsizetype len = file.size();
-    m_Data = new quint8[len];
-    m_Size = file.read(reinterpret_cast<char*>(m_Data), len);
+    unloadFile();
 
-    if (m_Size != len) {
-        printf("premature read: '%zu' of '%zu'\n", m_Size, len);
-    }
+    m_Current = f;
+    m_Cache.insert(f);
+    m_Data = f->data();
+    m_Size = f->size();
 
     m_Start = 0;
     m_End = m_Size;
 
-    updateViews();
+    if (f->analyzed()) {
+        showLoaded();
+    } else {
+        // A pass made with other view settings is started over, the results are shown as they come in.
+        LoadParams_t params = loadParams();
+        if (f->params() != params) f->setup(params);
+        startLoading();
+    }
     return true;
 }
 
+/// unloadFile stops all work on the current file and releases it, though it remains in the cache.
+void CMain::unloadFile() {
+    stopBackgroundJobs();
+
+    m_RangePreviewTimer->stop();
+    m_RangeSettleTimer->stop();
+    m_Histogram2D->stop();
+    m_Histogram3D->stop();
+
+    m_OverallPrimary->setPyramid(nullptr);
+    m_OverallZoomed->setPyramid(nullptr);
+    clearSearch();
+
+    m_Current.reset();
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Start = 0;
+    m_End = 0;
+}
+
+/// loadParams returns the settings of the views that the analyses of a file depend on.
+LoadParams_t CMain::loadParams() const {
+    LoadParams_t params;
+
+    const COverallView *overviews[2] = {m_OverallPrimary, m_OverallZoomed};
+    for (int i = 0; i < 2; i++) {
+        params.overview_w[i] = overviews[i]->width();
+        params.overview_h[i] = overviews[i]->height();
+        params.byte_classes[i] = overviews[i]->byteClassesEnabled();
+        params.hilbert[i] = overviews[i]->hilbertCurveEnabled();
+    }
+    params.entropy_window = m_EntropyWindow->value();
+
+    return params;
+}
+
+/// histoKey2D returns the key of the 2D histogram of [start, end) at the view's settings.
+HistoKey_t CMain::histoKey2D(int64_t start, int64_t end) const {
+    HistoKey_t key;
+    key.valid = true;
+    key.start = start;
+    key.end = end;
+    key.dtype = m_Histogram2D->dtype();
+    return key;
+}
+
+/// histoKey3D returns the key of the 3D histogram of [start, end) at the view's settings.
+HistoKey_t CMain::histoKey3D(int64_t start, int64_t end) const {
+    HistoKey_t key;
+    key.valid = true;
+    key.start = start;
+    key.end = end;
+    key.dtype = m_Histogram3D->dtype();
+    key.overlap = m_Histogram3D->overlap();
+    return key;
+}
+
+/// startLoading runs the first pass over m_Current in the background, building the byte index,
+/// rendering the overview images and sampling the entropy preview chunk by chunk. loadProgress()
+/// shows the results as they come in.
+void CMain::startLoading() {
+    m_Loading = true;
+    m_CancelLoad = false;
+
+    m_Summary->clear();
+
+    // The start of the file can be shown right away.
+    if (m_HexView->isVisible()) {
+        m_HexView->setData(m_Data, m_Size);
+        m_HexView->setStart(0);
+    }
+
+    m_LoadProgress->show();
+    m_LoadCancel->show();
+    loadProgress();
+
+    auto f = m_Current;
+    m_LoadWatcher->setFuture(QtConcurrent::run([this, f]() {
+        return f->analyze(&m_CancelLoad);
+    }));
+    m_LoadTimer->start();
+}
+
+/// loadProgress shows the parts of the first pass completed so far, called from m_LoadTimer.
+void CMain::loadProgress() {
+    if (!m_Loading) return;
+
+    int64_t loaded = m_Current->loaded();
+    m_LoadProgress->setValue(m_Size > 0 ? int(1000 * double(loaded) / m_Size) : 1000);
+
+    m_OverallPrimary->showOverview(m_Data, m_Size, m_Current->overview(0), m_Current->overview(0).pixelsWithin(loaded));
+    m_OverallZoomed->showOverview(m_Data, m_Size, m_Current->overview(1), m_Current->overview(1).pixelsWithin(loaded));
+
+    // Samples beyond those completed are still being written, and are shown as zero.
+    const auto &preview = m_Current->entropyPreview();
+    std::vector<float> dd(preview.size(), 0.f);
+    std::copy(preview.begin(), preview.begin() + m_Current->entropyPreviewDone(loaded), dd.begin());
+    m_PlotView->setData(0, dd.data(), dd.size());
+}
+
+void CMain::loadFinished() {
+    if (!m_Loading) return;
+
+    bool ok = !m_LoadWatcher->isCanceled() && m_LoadWatcher->result();
+    if (ok) {
+        loadProgress();
+    }
+
+    m_Loading = false;
+    m_LoadTimer->stop();
+    m_LoadProgress->hide();
+    m_LoadCancel->hide();
+
+    if (!ok) {
+        // What was done so far is kept in the cache, should the file be opened again.
+        unloadFile();
+        m_OverallPrimary->clear();
+        m_OverallZoomed->clear();
+        m_HexView->setData(nullptr, 0);
+        m_Filename->setText(m_Filename->text() + " (cancelled)");
+        return;
+    }
+
+    showLoaded();
+}
+
+/// showLoaded brings the views up to date with m_Current, whose first pass is done.
+void CMain::showLoaded() {
+    // Overviews of any range are read from the class pyramid from now on.
+    m_OverallPrimary->setPyramid(&m_Current->classPyramid());
+    m_OverallZoomed->setPyramid(&m_Current->classPyramid());
+
+    // The overview images rendered by the first pass are used unless the views changed since, or,
+    // for the zoomed one, a range was selected.
+    LoadParams_t params = loadParams();
+    const LoadParams_t &done = m_Current->params();
+    bool update_iv[2];
+
+    COverallView *overviews[2] = {m_OverallPrimary, m_OverallZoomed};
+    for (int i = 0; i < 2; i++) {
+        update_iv[i] = params.overview_w[i] != done.overview_w[i] || params.overview_h[i] != done.overview_h[i] ||
+                       params.byte_classes[i] != done.byte_classes[i] || params.hilbert[i] != done.hilbert[i];
+        if (!update_iv[i]) {
+            overviews[i]->showOverview(m_Data, m_Size, m_Current->overview(i), m_Current->overview(i).pixelCount());
+        }
+    }
+    update_iv[1] = update_iv[1] || m_Start != 0 || m_End != m_Size;
+
+    startBackgroundJobs();
+    updateViews(update_iv[0], false, update_iv[1]);
+}
+
+void CMain::cancelLoad() {
+    m_CancelLoad = true;
+}
+
+void CMain::startBackgroundJobs() {
+    if (m_Current->pyramidReady()) {
+        startPrefetch();
+        return;
+    }
+
+    m_CancelBackground = false;
+
+    auto f = m_Current;
+    m_EntropyPyramidWatcher->setFuture(QtConcurrent::run([this, f]() {
+        return f->buildPyramid(&m_CancelBackground);
+    }));
+}
+
+/// stopBackgroundJobs cancels the jobs reading m_Data and waits for them, after which m_Data may be released.
+void CMain::stopBackgroundJobs() {
+    m_CancelLoad = true;
+    m_LoadWatcher->waitForFinished();
+    m_Loading = false;
+    m_LoadTimer->stop();
+    m_LoadProgress->hide();
+    m_LoadCancel->hide();
+
+    m_CancelBackground = true;
+    m_EntropyPyramidWatcher->waitForFinished();
+
+    m_EntropyParamsTimer->stop();
+    cancelEntropy();
+    m_EntropyWatcher->waitForFinished();
+
+    stopSearch();
+    stopPrefetch();
+}
+
+void CMain::entropyPyramidReady() {
+    if (m_EntropyPyramidWatcher->isCanceled() || !m_EntropyPyramidWatcher->result()) {
+        return;
+    }
+
+    updateEntropy();
+    startPrefetch();
+}
+
+/// startPrefetch analyzes the next few files of m_FileList, and the previous one, in the background so
+/// that stepping to them is immediate. Files are skipped once they would not fit in the cache budget.
+void CMain::startPrefetch() {
+    if (m_Loading || !m_Current || !m_Current->pyramidReady() || m_PrefetchWatcher->isRunning()) {
+        return;
+    }
+
+    std::vector<int> order;
+    for (int i = 1; i <= m_PrefetchCount; i++) {
+        order.push_back(m_CurrentFile + i);
+    }
+    if (m_PrefetchCount > 0) order.push_back(m_CurrentFile - 1);
+
+    LoadParams_t params = loadParams();
+    int64_t room = m_Cache.budget() - m_Current->memoryUsage();
+
+    // Files are admitted in order while what they hold once analyzed, estimated from their size before any
+    // of it is allocated, fits in the budget. The histogram shown, if any, is computed over the whole of each
+    // file as well, its page tables needing room meanwhile. The first file admitted with work left is
+    // prefetched, prefetchFinished() trims the cache and comes back here for the next one.
+    HistoKey_t key2d, key3d;
+    m_Prefetching.clear();
+    for (int i : order) {
+        if (i < 0 || i >= m_FileList.size()) continue;
+
+        std::string name = m_FileList[i].toStdString();
+        auto f = m_Cache.find(name);
+        if (!f) {
+            f = std::make_shared<CLoadedFile>();
+            if (!f->open(name)) continue;
+            m_Cache.insert(f);
+        }
+
+        key2d = histoKey2D(0, f->size());
+        key3d = histoKey3D(0, f->size());
+        key2d.valid = m_Histogram2D->isVisible();
+        key3d.valid = m_Histogram3D->isVisible();
+        bool done = f->analyzed() && f->pyramidReady() && (!key2d.valid || f->histo2D(key2d)) &&
+                    (!key3d.valid || f->histo3D(key3d));
+
+        int64_t transient = 0;
+        room -= done ? f->memoryUsage() : f->expectedMemoryUsage(params, key2d, key3d, &transient);
+        if (room < transient) break;
+        if (done) continue;
+
+        if (!f->analyzed() && f->params() != params) f->setup(params);
+        m_Prefetching.push_back(f);
+        break;
+    }
+
+    // Leave the file shown as the most recently used.
+    m_Cache.find(m_Current->filename());
+
+    if (m_Prefetching.empty()) {
+        return;
+    }
+
+    m_CancelPrefetch = false;
+
+    auto f = m_Prefetching.front();
+    m_PrefetchWatcher->setFuture(QtConcurrent::run([this, f, key2d, key3d]() {
+        return f->analyze(&m_CancelPrefetch) && f->buildPyramid(&m_CancelPrefetch) &&
+               f->buildHistograms(key2d, key3d, &m_CancelPrefetch);
+    }));
+}
+
+/// stopPrefetch cancels the prefetch job and waits for it, the files keep what was done so far.
+void CMain::stopPrefetch() {
+    m_CancelPrefetch = true;
+    m_PrefetchWatcher->waitForFinished();
+    m_Prefetching.clear();
+}
+
+/// prefetchFinished trims the cache to the actual memory of the file just prefetched and moves on to the next
+/// one, unless the prefetch was cancelled or the file had to be evicted.
+void CMain::prefetchFinished() {
+    bool ok = !m_PrefetchWatcher->isCanceled() && m_PrefetchWatcher->result();
+    std::string name = m_Prefetching.empty() ? std::string() : m_Prefetching.front()->filename();
+    m_Prefetching.clear();
+    m_Cache.trim();
+
+    if (ok && !name.empty() && m_Cache.find(name)) {
+        startPrefetch();
+    }
+}
+
+/// histogram2DReady keeps the histogram the view computed for the n bytes of dat with the file shown.
+void CMain::histogram2DReady(const quint8 *dat, qsizetype n) {
+    if (!m_Current || m_Data == nullptr || dat < m_Data || dat + n > m_Data + m_Size) return;
+
+    m_Current->setHisto2D(histoKey2D(dat - m_Data, dat - m_Data + n), m_Histogram2D->histogram());
+    m_Cache.trim();
+}
+
+/// histogram3DReady keeps the histogram the view computed for the n bytes of dat with the file shown.
+void CMain::histogram3DReady(const quint8 *dat, qsizetype n) {
+    if (!m_Current || m_Data == nullptr || dat < m_Data || dat + n > m_Data + m_Size) return;
+
+    m_Current->setHisto3D(histoKey3D(dat - m_Data, dat - m_Data + n), m_Histogram3D->histogram());
+    m_Cache.trim();
+}
+
 bool CMain::loadFiles(const QStringList &filenames) {
     m_FileList = filenames;
     m_CurrentFile = -1;
@@ -345,6 +842,11 @@ void CMain::loadFile() {
     }
 }
 
+/// settingsFile returns the ini file holding the settings of the application, next to its executable.
+QString CMain::settingsFile() {
+    return QDir(QApplication::applicationDirPath()).filePath("settings/style.ini");
+}
+
 bool CMain::loadStyle(QString s)
 {
     QFile f(s);
@@ -364,7 +866,10 @@ bool CMain::loadStyle(QString s)
     return rv;
 }
 
-void CMain::updateViews(bool update_iv1, bool optimize) {
+void CMain::updateViews(bool update_iv1, bool optimize, bool update_iv2) {
+    // While loading the views are filled in by loadProgress(), and brought up to date by loadFinished().
+    if (m_Loading) return;
+
     if (update_iv1) m_OverallPrimary->clear();
 
     if (m_Data == nullptr) {
@@ -378,33 +883,34 @@ void CMain::updateViews(bool update_iv1, bool optimize) {
 
     // iv1 shows the entire file, iv2 shows the current segment
     if (update_iv1) m_OverallPrimary->setData(m_Data, m_Size, true, optimize);
-    m_OverallZoomed->setData(m_Data + m_Start, m_End - m_Start, true, optimize);
+    if (update_iv2) m_OverallZoomed->setData(m_Data + m_Start, m_End - m_Start, true, optimize);
 
     if (!optimize) {
-        {
-            int64_t n;
-            auto dd = generate_entropy(m_Data + m_Start, m_End - m_Start, n);
-            if (dd) {
-                m_PlotView->setData(0, dd, n);
-                delete[] dd;
+        updateEntropy();
+        updateCounts();
+    }
+
+    if (!optimize) {
+        // The histograms last computed for the file are shown again if the range and settings are the same.
+        if (m_Histogram3D->isVisible()) {
+            auto hist = m_Current->histo3D(histoKey3D(m_Start, m_End));
+            if (hist) {
+                m_Histogram3D->setHistogram(m_Data + m_Start, m_End - m_Start, hist);
+            } else {
+                m_Histogram3D->setData(m_Data + m_Start, m_End - m_Start);
             }
         }
-
-        {
-            auto dd = generate_histo(m_Data + m_Start, m_End - m_Start);
-            if (dd) {
-                m_PlotView->setData(1, dd, 256, false);
-                delete[] dd;
+        if (m_Histogram2D->isVisible()) {
+            auto hist = m_Current->histo2D(histoKey2D(m_Start, m_End));
+            if (hist) {
+                m_Histogram2D->setHistogram(m_Data + m_Start, m_End - m_Start, hist);
+            } else {
+                m_Histogram2D->setData(m_Data + m_Start, m_End - m_Start);
             }
         }
-    }
-
-    if (!optimize) {
-        if (m_Histogram3D->isVisible()) m_Histogram3D->setData(m_Data + m_Start, m_End - m_Start);
-        if (m_Histogram2D->isVisible()) m_Histogram2D->setData(m_Data + m_Start, m_End - m_Start);
         if (m_HexView->isVisible()) {
             //        binary_viewer_->setData(bin_ + start_, end_ - start_);
-            m_HexView->setData(m_Data, m_End);
+            m_HexView->setData(m_Data, m_Size);
             m_HexView->setStart(m_Start / 16);
         }
         if (m_ImageView->isVisible()) m_ImageView->setData(m_Data + m_Start, m_End - m_Start);
@@ -412,9 +918,190 @@ void CMain::updateViews(bool update_iv1, bool optimize) {
     }
 }
 
+/// updateEntropy plots the entropy of the selection. An approximate plot only reads the entropy pyramid,
+/// whatever the window, or the preview, and is skipped when neither is available.
+void CMain::updateEntropy(bool approximate) {
+    if (m_Data == nullptr || m_Loading) {
+        return;
+    }
+
+    int64_t n = m_End - m_Start;
+    int64_t bs = m_EntropyWindow->value();
+    int64_t step = m_EntropyStep->value();
+
+    m_PlotView->setToolTip(QString("Entropy window: %1 B, step: %2 B").arg(bs).arg(entropy_step(step, n)));
+
+    // The pyramid is read as the mean and envelope of a few points per row of the plot from its levels, in
+    // time independent of the selection's size, so that single blocks differing from their neighbours still
+    // show. A preview takes a point per row whatever the window, the settled plot of the pyramid's own window
+    // and step up to s_EntropyPointsPerRow, a point per block when the selection has fewer.
+    const CEntropyPyramid &pyramid = m_Current->entropyPyramid();
+    if (m_Current->pyramidReady() && (approximate || (bs == pyramid.blockSize() && step == bs))) {
+        int64_t rows = std::max(1, m_PlotView->height());
+        int64_t blocks = (n + pyramid.blockSize() - 1) / pyramid.blockSize();
+        int len = int(std::max<int64_t>(1, approximate ? rows : std::min(blocks, s_EntropyPointsPerRow * rows)));
+        std::vector<float> mean(len), mn(len), mx(len);
+        pyramid.sample(m_Start, m_End, len, mean.data(), mn.data(), mx.data());
+        cancelEntropy();
+        m_PlotView->setEnvelope(0, mean.data(), mn.data(), mx.data(), len);
+        return;
+    }
+
+    // Until the pyramid is ready, the whole file is shown from the preview sampled while loading.
+    const auto &preview = m_Current->entropyPreview();
+    if (!m_Current->pyramidReady() && m_Start == 0 && m_End == m_Size && bs == m_Current->params().entropy_window) {
+        cancelEntropy();
+        m_PlotView->setData(0, preview.data(), preview.size());
+        return;
+    }
+    if (approximate) {
+        return;
+    }
+
+    m_EntropyGeneration++;
+    m_EntropyPending = true;
+    m_CancelEntropy = true;
+    if (!m_EntropyWatcher->isRunning()) startEntropyJob();
+}
+
+/// startEntropyJob computes the entropy plot of the selection in the background, shown by entropyReady().
+void CMain::startEntropyJob() {
+    m_EntropyPending = false;
+    m_CancelEntropy = false;
+
+    const quint8 *dat = m_Data + m_Start;
+    int64_t n = m_End - m_Start;
+    int64_t bs = m_EntropyWindow->value();
+    int64_t step = entropy_step(m_EntropyStep->value(), n);
+    int generation = m_EntropyGeneration;
+    m_EntropyWatcher->setFuture(QtConcurrent::run([this, dat, n, bs, step, generation]() {
+        EntropyJob_t job;
+        job.generation = generation;
+        job.entropy.reset(generate_entropy(dat, n, job.len, bs, step, &m_CancelEntropy), std::default_delete<float[]>());
+        return job;
+    }));
+}
+
+void CMain::entropyReady() {
+    EntropyJob_t job = m_EntropyWatcher->result();
+    if (m_EntropyPending) {
+        startEntropyJob();
+        return;
+    }
+    if (job.generation != m_EntropyGeneration || !job.entropy) {
+        return;
+    }
+
+    m_PlotView->setData(0, job.entropy.get(), job.len);
+}
+
+/// cancelEntropy abandons the entropy plot being computed, if any, keeping the one shown.
+void CMain::cancelEntropy() {
+    m_EntropyGeneration++;
+    m_EntropyPending = false;
+    m_CancelEntropy = true;
+}
+
+/// updateCounts shows the byte histogram and the summary of the selection, read from the byte index.
+void CMain::updateCounts() {
+    uint64_t counts[256];
+    m_Current->byteIndex().counts(m_Start, m_End, counts);
+    updateSummary(counts);
+
+    auto dd = generate_histo(counts);
+    if (dd) {
+        m_PlotView->setData(1, dd, 256, false);
+        delete[] dd;
+    }
+}
+
+void CMain::updateSummary(const uint64_t counts[256]) {
+    uint64_t n = 0;
+    uint64_t printable = 0;
+    for (int i = 0; i < 256; i++) {
+        n += counts[i];
+        if (0x20 <= i && i <= 0x7e) printable += counts[i];
+    }
+
+    if (n == 0) {
+        m_Summary->clear();
+        return;
+    }
+
+    m_Summary->setText(QString("0x%1 - 0x%2 (%3 B)  entropy: %4 bits/B  zero: %5%  printable: %6%")
+                               .arg(m_Start, 8, 16, QChar('0'))
+                               .arg(m_End, 8, 16, QChar('0'))
+                               .arg(n)
+                               .arg(histo_entropy(counts), 0, 'f', 3)
+                               .arg(100. * counts[0] / n, 0, 'f', 1)
+                               .arg(100. * printable / n, 0, 'f', 1));
+}
+
+void CMain::entropyParametersChanged() {
+    QSettings settings(settingsFile(), QSettings::IniFormat);
+    settings.setValue("entropy/window", m_EntropyWindow->value());
+    settings.setValue("entropy/step", m_EntropyStep->value());
+
+    updateEntropy();
+}
+
+/// rangeSelected is called for every move of the selection. The work for the previous range is abandoned,
+/// the views are previewed by rangePreview() and brought up to date by rangeSettled().
 void CMain::rangeSelected(float s, float e) {
-    m_Start = s * m_Size;
-    m_End = e * m_Size;
+    // Scaled in double precision, a float only resolves positions within a terabyte file to 64 KB.
+    selectRange(qsizetype(double(s) * m_Size), std::min(m_Size, qsizetype(double(e) * m_Size)));
+}
+
+/// hexStartChanged moves the selection, keeping its length where the file allows, to start at the first row
+/// the user scrolled the hex view to, and the overview's band with it.
+void CMain::hexStartChanged(qsizetype offset) {
+    if (m_Data == nullptr || m_Size == 0) {
+        return;
+    }
+
+    qsizetype len = m_End - m_Start;
+    qsizetype start = std::min(offset, m_Size);
+    qsizetype end = std::min(m_Size, start + len);
+    m_OverallPrimary->setSelection(float(double(start) / m_Size), float(double(end) / m_Size));
+    selectRange(start, end);
+}
+
+/// selectRange makes [start, end) the selection, abandoning the work for the previous one.
+void CMain::selectRange(qsizetype start, qsizetype end) {
+    m_Start = start;
+    m_End = end;
+
+    m_Histogram2D->cancel();
+    m_Histogram3D->cancel();
+    cancelEntropy();
+
+    if (!m_RangePreviewTimer->isActive()) m_RangePreviewTimer->start();
+    m_RangeSettleTimer->start();
+}
+
+/// rangePreview shows the selection from the summaries that cost time proportional to the views rather than
+/// to the selection: the zoomed overview, the entropy pyramid, the byte index and the hex view's position.
+void CMain::rangePreview() {
+    if (m_Data == nullptr || m_Loading) {
+        return;
+    }
+
+    m_OverallZoomed->setData(m_Data + m_Start, m_End - m_Start, true, true);
+    updateEntropy(true);
+    updateCounts();
+
+    if (m_HexView->isVisible()) {
+        m_HexView->setData(m_Data, m_Size);
+        m_HexView->setStart(m_Start / 16);
+    }
+}
+
+/// rangeSettled brings every view up to date with the selection once it stopped moving.
+void CMain::rangeSettled() {
+    m_RangePreviewTimer->stop();
+    m_RangeSettleTimer->stop();
+
+    if (m_Current) m_Current->file().advise(CMappedFile::Access_t::WILL_NEED, m_Start, m_End - m_Start);
     updateViews(false);
 }
 
@@ -424,7 +1111,7 @@ void CMain::switchView(int ind) {
     }
 
     {
-        QSettings settings;
+        QSettings settings(settingsFile(), QSettings::IniFormat);
         if (ind == -1) {
             ind = settings.value("last_view", 0).toInt();
         }
@@ -552,3 +1239,158 @@ void CMain::keyReleaseEvent(QKeyEvent* event)
         break;
     }
 }
+
+/// startSearch searches the whole of m_Data, in the background, for the patterns entered, replacing the
+/// hits of the last search.
+void CMain::startSearch() {
+    clearSearch();
+
+    QString text = m_SearchText->text();
+    if (m_Data == nullptr || text.isEmpty()) {
+        return;
+    }
+
+    int mode = m_SearchMode->currentIndex();
+    QStringList parts = mode == 3 ? QStringList(text) : text.split('|');
+
+    std::vector<SearchPattern_t> patterns;
+    for (const auto &part : parts) {
+        if (part.isEmpty()) continue;
+        std::string s = part.toUtf8().toStdString();
+        SearchPattern_t pattern;
+        bool ok = true;
+        switch (mode) {
+            case 0:
+                ok = parse_hex_pattern(s, pattern);
+                break;
+            case 1:
+                pattern = ascii_pattern(s);
+                break;
+            case 2:
+                ok = utf16_pattern(s, pattern);
+                break;
+            default:
+                pattern = regex_pattern(s);
+                break;
+        }
+        if (!ok) {
+            m_SearchStatus->setText(QString("Invalid pattern: %1").arg(part));
+            return;
+        }
+        patterns.push_back(pattern);
+    }
+
+    auto search = std::make_shared<CSearch>();
+    std::string error;
+    if (!search->compile(patterns, error)) {
+        m_SearchStatus->setText(QString::fromStdString(error));
+        return;
+    }
+
+    m_CancelSearch = false;
+    m_SearchDone = 0;
+    m_HexView->setHits(&m_SearchHits);
+
+    const quint8 *dat = m_Data;
+    qsizetype n = m_Size;
+    m_SearchWatcher->setFuture(QtConcurrent::run([this, search, dat, n]() {
+        return search->run(dat, n, m_SearchHits, &m_CancelSearch, &m_SearchDone);
+    }));
+    m_SearchTimer->start();
+    searchProgress();
+}
+
+/// searchProgress shows the hits found so far, called from m_SearchTimer and once the search is done.
+void CMain::searchProgress() {
+    // A full list keeps its size while lower hits found later replace the higher ones.
+    size_t hits = m_SearchHits.size();
+    if (hits != m_SearchShown || m_SearchHits.truncated()) {
+        m_SearchShown = hits;
+        m_HexView->hitsChanged();
+
+        // Each row of the overview holding a hit is marked.
+        int h = std::max(1, m_OverallPrimary->height());
+        std::vector<uint32_t> counts(h);
+        m_SearchHits.density(0, m_Size, h, counts.data());
+        std::vector<float> markers;
+        for (int i = 0; i < h; i++) {
+            if (counts[i] > 0) markers.push_back((i + .5f) / h);
+        }
+        m_OverallPrimary->setMarkers(markers);
+    }
+
+    QString status = QString("%1%2 hits").arg(hits).arg(m_SearchHits.truncated() ? "+" : "");
+    if (m_SearchWatcher->isRunning() && m_Size > 0) {
+        status += QString(", %1%").arg(int(100 * double(m_SearchDone) / m_Size));
+    }
+    m_SearchStatus->setText(status);
+}
+
+void CMain::searchFinished() {
+    m_SearchTimer->stop();
+    if (m_SearchWatcher->isCanceled() || !m_SearchWatcher->result()) {
+        return;
+    }
+
+    searchProgress();
+}
+
+/// stopSearch cancels the search running, if any, and waits for it.
+void CMain::stopSearch() {
+    m_CancelSearch = true;
+    m_SearchWatcher->waitForFinished();
+    m_SearchTimer->stop();
+}
+
+/// clearSearch stops the search and removes its hits from the views.
+void CMain::clearSearch() {
+    stopSearch();
+
+    m_HexView->setHits(nullptr);
+    m_SearchHits.clear();
+    m_SearchShown = 0;
+    m_SearchCursor = -1;
+    m_SearchCursorStart = -1;
+    m_OverallPrimary->setMarkers({});
+    m_SearchStatus->clear();
+}
+
+/// findNext shows the first hit after the last one shown, or after the start of the selection once it moved,
+/// wrapping around at the end of the file.
+void CMain::findNext() {
+    qsizetype from = m_SearchCursorStart == m_Start ? m_SearchCursor + 1 : m_Start;
+
+    SearchHit_t hit;
+    if (m_SearchHits.next(from, hit) || m_SearchHits.next(0, hit)) {
+        showSearchHit(hit);
+    }
+}
+
+/// findPrevious shows the last hit before the last one shown, or before the start of the selection once it
+/// moved, wrapping around at the start of the file.
+void CMain::findPrevious() {
+    qsizetype before = m_SearchCursorStart == m_Start ? m_SearchCursor : m_Start;
+
+    SearchHit_t hit;
+    if (m_SearchHits.previous(before, hit) || m_SearchHits.previous(m_Size, hit)) {
+        showSearchHit(hit);
+    }
+}
+
+/// showSearchHit scrolls the hex view, shown if it is not, to hit, the selection following it.
+void CMain::showSearchHit(const SearchHit_t &hit) {
+    if (!m_HexView->isVisible()) {
+        int ind = int(std::find(m_Views.begin(), m_Views.end(), m_HexView) - m_Views.begin());
+        switchView(ind);
+    }
+    m_HexView->jumpTo(hit.offset);
+
+    m_SearchCursor = hit.offset;
+    m_SearchCursorStart = m_Start;
+
+    m_SearchStatus->setText(QString("Hit %1 of %2%3 at 0x%4")
+                                    .arg(m_SearchHits.rank(hit.offset) + 1)
+                                    .arg(m_SearchHits.size())
+                                    .arg(m_SearchHits.truncated() ? "+" : "")
+                                    .arg(hit.offset, 0, 16));
+}
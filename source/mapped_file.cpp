@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <cstdio>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+// Empty files cannot be mapped, they are given this instead so that data() is never null once opened.
+static const uint8_t s_Empty[1] = {0};
+
+CMappedFile::CMappedFile()
+        : m_Data(nullptr), m_Size(0), m_Mapped(false) {
+}
+
+CMappedFile::~CMappedFile() {
+    close();
+}
+
+/// open maps filename, or reads it onto the heap when it cannot be mapped. Any previous file is closed.
+/// @param [in] filename Name of the file, UTF-8 encoded.
+/// @return True if the contents of the file are available through data().
+bool CMappedFile::open(const std::string &filename) {
+    close();
+
+    return map(filename) || read(filename);
+}
+
+/// close releases the contents of the file; pointers returned by data() become invalid.
+void CMappedFile::close() {
+    if (m_Data != nullptr && m_Data != s_Empty) {
+        if (m_Mapped) {
+#if defined(_WIN32)
+            UnmapViewOfFile(m_Data);
+#else
+            munmap((void *) m_Data, m_Size);
+#endif
+        } else {
+            delete[] m_Data;
+        }
+    }
+
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Mapped = false;
+}
+
+/// advise tells the operating system how [start, start + len) is about to be accessed: NORMAL for random
+/// access, SEQUENTIAL for a pass over the range, WILL_NEED to start reading the range in. It is only a
+/// hint, and has no effect on data read onto the heap.
+/// @param [in] access The expected access pattern.
+/// @param [in] start Offset of the range in bytes.
+/// @param [in] len Length of the range in bytes, or -1 for the rest of the file.
+void CMappedFile::advise(Access_t access, int64_t start, int64_t len) const {
+    if (!m_Mapped) return;
+
+    start = std::max<int64_t>(0, std::min(start, m_Size));
+    if (len < 0 || len > m_Size - start) len = m_Size - start;
+    if (len == 0) return;
+
+#if defined(_WIN32)
+    // Windows only supports prefetching; the other patterns are left to its own heuristics.
+    if (access == Access_t::WILL_NEED) {
+        typedef BOOL (WINAPI *prefetch_fn_t)(HANDLE, ULONG_PTR, PWIN32_MEMORY_RANGE_ENTRY, ULONG);
+        static auto prefetch = (prefetch_fn_t) GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory");
+        if (prefetch) {
+            WIN32_MEMORY_RANGE_ENTRY range = {(PVOID) (m_Data + start), SIZE_T(len)};
+            prefetch(GetCurrentProcess(), 1, &range, 0);
+        }
+    }
+#else
+    // madvise wants a page aligned start.
+    static const int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t aligned = start / page * page;
+
+    int a = MADV_NORMAL;
+    if (access == Access_t::SEQUENTIAL) a = MADV_SEQUENTIAL;
+    else if (access == Access_t::WILL_NEED) a = MADV_WILLNEED;
+
+    madvise((void *) (m_Data + aligned), len + (start - aligned), a);
+#endif
+}
+
+bool CMappedFile::map(const std::string &filename) {
+#if defined(_WIN32)
+    int wn = MultiByteToWideChar(CP_UTF8, 0, filename.c_str(), -1, nullptr, 0);
+    std::wstring wfilename(std::max(0, wn - 1), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, filename.c_str(), -1, &wfilename[0], wn);
+
+    HANDLE f = CreateFileW(wfilename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f, &size) || GetFileType(f) != FILE_TYPE_DISK) {
+        CloseHandle(f);
+        return false;
+    }
+
+    if (size.QuadPart == 0) {
+        CloseHandle(f);
+        m_Data = s_Empty;
+        m_Size = 0;
+        return true;
+    }
+
+    HANDLE m = CreateFileMappingW(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(f);
+    if (m == nullptr) return false;
+
+    auto p = (const uint8_t *) MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(m); // the view keeps the mapping alive
+    if (p == nullptr) return false;
+
+    m_Data = p;
+    m_Size = size.QuadPart;
+    m_Mapped = true;
+    return true;
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+        ::close(fd);
+        return false;
+    }
+
+    // Block devices report no size through stat, their end is found by seeking to it.
+    int64_t size = st.st_size;
+    if (S_ISBLK(st.st_mode)) {
+        size = lseek(fd, 0, SEEK_END);
+        if (size < 0) {
+            ::close(fd);
+            return false;
+        }
+    }
+
+    // Files of /proc and the like report a size of 0 whatever their contents, so an empty regular file is
+    // read instead; read() gives the same result as here for one that is really empty.
+    if (size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void *p = mmap(nullptr, size_t(size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file open
+    if (p == MAP_FAILED) return false;
+
+    m_Data = (const uint8_t *) p;
+    m_Size = size;
+    m_Mapped = true;
+    return true;
+#endif
+}
+
+bool CMappedFile::read(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+
+    // The size of pipes, character devices and /proc files is not known in advance, grow the buffer as
+    // they are read.
+    int64_t cap = 1 << 20, n = 0;
+    auto buf = new uint8_t[cap];
+    while (true) {
+        if (n == cap) {
+            auto tmp = new uint8_t[cap * 2];
+            std::copy(buf, buf + n, tmp);
+            delete[] buf;
+            buf = tmp;
+            cap *= 2;
+        }
+        size_t r = fread(buf + n, 1, cap - n, f);
+        n += r;
+        if (r == 0) break;
+    }
+
+    bool ok = !ferror(f);
+    fclose(f);
+    if (!ok) {
+        delete[] buf;
+        return false;
+    }
+
+    if (n == 0) {
+        delete[] buf;
+        m_Data = s_Empty;
+    } else {
+        m_Data = buf;
+    }
+    m_Size = n;
+    m_Mapped = false;
+    return true;
+}
@@ -19,10 +19,8 @@
 
 #include <QtGui>
 
-#include "hilbert.h"
 #include "overall_view.h"
-
-using std::min;
+#include "overview.h"
 
 COverallView::COverallView(QWidget *p)
         : QLabel(p),
@@ -30,7 +28,9 @@ COverallView::COverallView(QWidget *p)
           m_AllowSelection(true),
           m_UseByteClasses(true),
           m_UseHilbertCurve(true),
-          m_Data(nullptr), m_Size(0) {
+          m_Data(nullptr), m_Size(0),
+          m_Pyramid(nullptr),
+          m_ShownPixels(0) {
 }
 
 void COverallView::enableSelection(bool v) {
@@ -38,6 +38,19 @@ void COverallView::enableSelection(bool v) {
     update();
 }
 
+/// setSelection moves the selection band to [s, e), as fractions of the height, without signalling it.
+void COverallView::setSelection(float s, float e) {
+    m_UpperBandPos = s;
+    m_LowerBandPos = e;
+    update();
+}
+
+/// setMarkers marks the given positions, fractions of the height, such as where search hits lie.
+void COverallView::setMarkers(const std::vector<float> &markers) {
+    m_Markers = markers;
+    update();
+}
+
 void COverallView::enableByteClasses(bool v) {
     m_UseByteClasses = v;
     update();
@@ -56,92 +69,68 @@ void COverallView::setImage(QImage &img) {
     update();
 }
 
+/// setPyramid makes setData() read the counts of ranges of the file summarized by pyramid from it instead of
+/// the bytes, which costs time proportional to the pixels drawn. The pyramid must be complete and remain
+/// valid until replaced; null reverts to the bytes.
+void COverallView::setPyramid(const CClassPyramid *pyramid) {
+    m_Pyramid = pyramid;
+}
+
 void COverallView::setData(const quint8 *dat, qsizetype len, bool resetSelection, bool disableByteClasses) {
     m_Data = dat;
     m_Size = len;
+    m_ShownPixels = 0;
 
     if (resetSelection) {
         m_UpperBandPos = 0.;
         m_LowerBandPos = 1.;
     }
 
-    int w = width();
-    int h = height();
-    int wh = w * h;
-    int sf = len / wh + 1;
-
-    int img_w = w, img_h = len / sf / w + 1;
-    QImage img(img_w, img_h, QImage::Format_RGB32);
-    printf("%d %d   %d %d\n", w, h, img_w, img_h);
-    img.fill(0);
-
-    curve_t hilbert;
-    size_t h_ind = 0;
-    if (m_UseHilbertCurve) gilbert2d(img_w, img_h, hilbert);
-
-    auto p = (unsigned int *) img.bits();
-
-    for (qsizetype i = 0; i < len;) {
-        int r = 0, g = 0, b = 0;
-
-        if (!m_UseByteClasses || disableByteClasses) {
-            int cn = 0;
-            int j;
-            for (j = 0; i < len && j < sf; i++, j++) {
-                cn += dat[i];
-            }
-            r = 20;
-            g = cn / j;
-            b = 20;
-        } else {
-            int j;
-            for (j = 0; i < len && j < sf; i++, j++) {
-                unsigned char c = dat[i];
-                if (c == 0x00) {
-                } else if (0x00 < c && c <= 0x1f) {
-                    b += 0xf0;
-                } else if (0x1f < c && c <= 0x7f) {
-                    g += 0xf0;
-                } else if (0x7f < c && c < 0xff) {
-                    r += 0xf0;
-                } else if (c == 0xff) {
-                    r += 0xff;
-                    g += 0xff;
-                    b += 0xff;
-                }
-            }
-
-            r /= j;
-            g /= j;
-            b /= j;
-        }
+    std::vector<uint32_t> pixels;
+    int img_w, img_h;
+    if (m_Pyramid && dat >= m_Pyramid->data() && dat + len <= m_Pyramid->data() + m_Pyramid->size()) {
+        // Byte classes cost no more than the average byte value when read from the pyramid.
+        render_overview(*m_Pyramid, dat - m_Pyramid->data(), len, width(), height(), m_UseByteClasses,
+                        m_UseHilbertCurve, pixels, img_w, img_h);
+    } else {
+        render_overview(dat, len, width(), height(), m_UseByteClasses && !disableByteClasses, m_UseHilbertCurve,
+                        pixels, img_w, img_h);
+    }
+    if (pixels.empty()) return;
+
+    // scaled() makes a deep copy, so the image may borrow the pixels.
+    QImage img((const uchar *) pixels.data(), img_w, img_h, img_w * 4, QImage::Format_RGB32);
+    img = img.scaled(size());
+    setImage(img);
+}
 
-        r = min(255, r) & 0xff;
-        g = min(255, g) & 0xff;
-        b = min(255, b) & 0xff;
+/// showOverview displays the first pixels pixels of img, an overview of dat being rendered elsewhere,
+/// for example while the file is read in. Only the pixels added since the previous call are copied;
+/// passing 0 pixels starts over.
+void COverallView::showOverview(const quint8 *dat, qsizetype len, const COverviewImage &img, qsizetype pixels) {
+    if (pixels == 0 || pixels < m_ShownPixels || dat != m_Data || len != m_Size ||
+        m_Image.size() != QSize(img.width(), img.height())) {
+        m_Data = dat;
+        m_Size = len;
+        m_UpperBandPos = 0.;
+        m_LowerBandPos = 1.;
+        m_ShownPixels = 0;
 
-        unsigned int v = (0xff << 24) | (r << 16) | (g << 8) | (b << 0);
+        m_Image = QImage(img.width(), img.height(), QImage::Format_RGB32);
+        m_Image.fill(0);
+    }
+    if (m_Image.isNull()) return;
 
-        if (!m_UseHilbertCurve) {
-            *p++ = v;
-        } else {
-            if (h_ind >= hilbert.size()) {
-                abort();
-            }
-
-            int x = hilbert[h_ind].first;
-            int y = hilbert[h_ind++].second;
-            int ind = y * w + x;
-            if (ind < wh) {
-                p[ind] = v;
-            } else {
-                abort();
-            }
-        }
+    auto dst = (uint32_t *) m_Image.bits();
+    const uint32_t *src = img.pixels().data();
+    for (qsizetype i = m_ShownPixels; i < pixels; i++) {
+        int64_t o = img.pixelOffset(i);
+        dst[o] = src[o];
     }
+    m_ShownPixels = pixels;
 
-    img = img.scaled(size());
-    setImage(img);
+    updatePixmap();
+    update();
 }
 
 void COverallView::paintEvent(QPaintEvent *e) {
@@ -159,6 +148,16 @@ void COverallView::paintEvent(QPaintEvent *e) {
         p.drawLine(0 + 3, ry2, width() - 1 - 3, ry2);
     }
 
+    // Search hits are ticks along both edges, at the same scale as the selection.
+    if (!m_Markers.empty()) {
+        p.setPen(QColor(255, 200, 0));
+        for (float m : m_Markers) {
+            int y = int(m * height());
+            p.drawLine(1, y, 6, y);
+            p.drawLine(width() - 7, y, width() - 2, y);
+        }
+    }
+
     // a border around the image helps to see the border of a dark image
     p.setPen(Qt::darkGray);
     p.drawRect(0, 0, width() - 1, height() - 1);
@@ -176,7 +175,6 @@ void COverallView::updatePixmap() {
     int vh = height();
     m_Pixmap = QPixmap::fromImage(m_Image).scaled(vw, vh/*, Qt::KeepAspectRatio*/);
     setPixmap(m_Pixmap);
-    printf("%d %d   %d %d\n", vw, vh, m_Image.width(), m_Image.height());
 }
 
 // Gray code related functions are from https://en.wikipedia.org/wiki/Gray_code
@@ -290,7 +288,11 @@ void COverallView::mouseReleaseEvent(QMouseEvent *e) {
 //    if (y < 0) y = 0;
 //    if (y > height() - 1) y = height() - 1;
 
+    bool moved = m_SelectionType != allow_selection_::NONE;
+
     m_MousePosX = -1;
     m_MousePosY = -1;
     m_SelectionType = allow_selection_::NONE;
+
+    if (moved) emit(selectionFinished());
 }
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <cstdlib>
+
+#include "byte_count.h"
+#include "overview.h"
+#include "parallel.h"
+
+using std::min;
+
+// Ranges of pixels summarizing fewer bytes than this are not worth a thread of their own.
+static const int64_t s_MinBytesPerWorker = 4 * 1024 * 1024;
+
+// Pixels read from a pyramid cost at most a few blocks of bytes each, so fewer are handed to a thread.
+static const int64_t s_MinPyramidPixelsPerWorker = 1024;
+
+COverviewImage::COverviewImage()
+        : m_Size(0), m_Width(0), m_Height(0), m_PixelBytes(1), m_PixelCount(0), m_ByteClasses(true), m_Hilbert(true) {
+}
+
+/// layout sizes the image for len bytes and clears it to black.
+/// @param [in] len Number of bytes to be drawn.
+/// @param [in] w Maximum width of the image.
+/// @param [in] h Maximum height of the image.
+/// @param [in] byte_classes Whether to color pixels by the classes of their bytes (true) or to draw the average byte value (false).
+/// @param [in] hilbert Whether to lay the pixels out along a Hilbert curve (true) or row by row (false).
+void COverviewImage::layout(int64_t len, int w, int h, bool byte_classes, bool hilbert) {
+    clear();
+
+    if (w <= 0 || h <= 0 || len < 0) {
+        return;
+    }
+
+    int64_t wh = int64_t(w) * h;
+
+    m_Size = len;
+    m_PixelBytes = len / wh + 1;
+    m_PixelCount = (len + m_PixelBytes - 1) / m_PixelBytes;
+    m_Width = w;
+    m_Height = int(len / m_PixelBytes / w + 1);
+    m_ByteClasses = byte_classes;
+    m_Hilbert = hilbert;
+    m_Classes = byte_classes_scheme();
+
+    m_Pixels.assign(int64_t(m_Width) * m_Height, 0);
+    if (m_Hilbert) m_Curve = gilbert2d_lut(m_Width, m_Height);
+}
+
+void COverviewImage::clear() {
+    m_Size = 0;
+    m_Width = m_Height = 0;
+    m_PixelBytes = 1;
+    m_PixelCount = 0;
+    m_Curve.reset();
+    m_Pixels.clear();
+}
+
+/// memoryUsage returns the number of bytes held by the image and its curve.
+int64_t COverviewImage::memoryUsage() const {
+    return int64_t(m_Pixels.capacity() * sizeof(uint32_t) + (m_Curve ? m_Curve->capacity() * sizeof(uint32_t) : 0));
+}
+
+/// expectedMemoryUsage returns the number of bytes held by an image laid out by layout(len, w, h, ..., hilbert).
+int64_t COverviewImage::expectedMemoryUsage(int64_t len, int w, int h, bool hilbert) {
+    if (w <= 0 || h <= 0 || len < 0) return 0;
+
+    int64_t pixel_bytes = len / (int64_t(w) * h) + 1;
+    int64_t pixels = int64_t(w) * (len / pixel_bytes / w + 1);
+    return int64_t(pixels * sizeof(uint32_t) * (hilbert ? 2 : 1));
+}
+
+/// pixelsWithin returns the number of leading pixels that only summarize bytes within the first bytes bytes.
+int64_t COverviewImage::pixelsWithin(int64_t bytes) const {
+    if (bytes >= m_Size) return m_PixelCount;
+    return bytes / m_PixelBytes;
+}
+
+/// pixelOffset returns the index within pixels() of pixel p.
+int64_t COverviewImage::pixelOffset(int64_t p) const {
+    if (!m_Hilbert) return p;
+    return (*m_Curve)[p];
+}
+
+/// render draws the pixels [p0, p1) summarizing the bytes of dat, which holds the len bytes passed to layout().
+/// Disjoint ranges of pixels may be rendered concurrently, and large ranges are split over several threads.
+void COverviewImage::render(const uint8_t *dat, int64_t p0, int64_t p1) {
+    p1 = std::min(p1, m_PixelCount);
+    if (p0 >= p1) return;
+    if (m_Hilbert && p1 > int64_t(m_Curve->size())) {
+        abort();
+    }
+
+    int64_t min_pixels = std::max<int64_t>(1, s_MinBytesPerWorker / m_PixelBytes);
+    parallel_for(p1 - p0, min_pixels, [&](int64_t b, int64_t e) {
+        renderRange(dat, p0 + b, p0 + e);
+    });
+}
+
+/// render draws the pixels [p0, p1) of an image laid out for the len bytes of pyramid's data starting at start,
+/// reading the counts of every pixel from the pyramid, which must be complete and count the classes of the
+/// scheme the image was laid out with.
+void COverviewImage::render(const CClassPyramid &pyramid, int64_t start, int64_t p0, int64_t p1) {
+    p1 = std::min(p1, m_PixelCount);
+    if (p0 >= p1) return;
+    if (m_Hilbert && p1 > int64_t(m_Curve->size())) {
+        abort();
+    }
+
+    parallel_for(p1 - p0, s_MinPyramidPixelsPerWorker, [&](int64_t b, int64_t e) {
+        uint64_t class_counts[CByteClasses::s_MaxClasses + 1];
+        uint64_t sum = 0;
+
+        for (int64_t pi = p0 + b; pi < p0 + e; pi++) {
+            int64_t i = pi * m_PixelBytes;
+            int64_t j = min(m_PixelBytes, m_Size - i);
+            if (m_ByteClasses) {
+                pyramid.counts(start + i, start + i + j, class_counts, nullptr);
+            } else {
+                pyramid.counts(start + i, start + i + j, nullptr, &sum);
+            }
+            m_Pixels[pixelOffset(pi)] = pixelColor(class_counts, sum, j);
+        }
+    });
+}
+
+/// renderRange draws the pixels [p0, p1) on the calling thread, see render().
+void COverviewImage::renderRange(const uint8_t *dat, int64_t p0, int64_t p1) {
+    uint64_t class_counts[CByteClasses::s_MaxClasses + 1];
+    uint64_t sum = 0;
+
+    for (int64_t pi = p0; pi < p1; pi++) {
+        int64_t i = pi * m_PixelBytes;
+        int64_t j = min(m_PixelBytes, m_Size - i);
+        if (m_ByteClasses) {
+            std::fill(class_counts, class_counts + CByteClasses::s_MaxClasses + 1, 0);
+            m_Classes.count(dat + i, j, class_counts);
+        } else {
+            sum = sum_bytes(dat + i, j);
+        }
+        m_Pixels[pixelOffset(pi)] = pixelColor(class_counts, sum, j);
+    }
+}
+
+/// pixelColor returns the color of a pixel summarizing j bytes with the given class counts, when drawing
+/// byte classes, or else with the given byte sum.
+uint32_t COverviewImage::pixelColor(const uint64_t class_counts[], uint64_t sum, int64_t j) const {
+    int r = 0, g = 0, b = 0;
+
+    if (!m_ByteClasses) {
+        r = 20;
+        g = int(sum / j);
+        b = 20;
+    } else {
+        int64_t rs = 0, gs = 0, bs = 0;
+        for (int k = 1; k <= m_Classes.classCount(); k++) {
+            uint32_t color = m_Classes.classColor(k);
+            rs += int64_t(class_counts[k]) * ((color >> 16) & 0xff);
+            gs += int64_t(class_counts[k]) * ((color >> 8) & 0xff);
+            bs += int64_t(class_counts[k]) * ((color >> 0) & 0xff);
+        }
+
+        r = int(rs / j);
+        g = int(gs / j);
+        b = int(bs / j);
+    }
+
+    r = min(255, r) & 0xff;
+    g = min(255, g) & 0xff;
+    b = min(255, b) & 0xff;
+
+    return (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+}
+
+/// render_overview draws len bytes of dat as an image of at most w x h pixels, see COverviewImage.
+/// @param [in] dat Byte data to be drawn.
+/// @param [in] len Length of dat in bytes.
+/// @param [in] w Maximum width of the image.
+/// @param [in] h Maximum height of the image.
+/// @param [in] byte_classes Whether to color pixels by the classes of their bytes (true) or to draw the average byte value (false).
+/// @param [in] hilbert Whether to lay the pixels out along a Hilbert curve (true) or row by row (false).
+/// @param [out] img The image, as img_w * img_h pixels of 0xAARRGGBB.
+/// @param [out] img_w Width of img.
+/// @param [out] img_h Height of img.
+void render_overview(const uint8_t *dat, int64_t len, int w, int h, bool byte_classes, bool hilbert,
+                     std::vector<uint32_t> &img, int &img_w, int &img_h) {
+    COverviewImage ov;
+    ov.layout(len, w, h, byte_classes, hilbert);
+    ov.render(dat, 0, ov.pixelCount());
+
+    img = ov.pixels();
+    img_w = ov.width();
+    img_h = ov.height();
+}
+
+/// render_overview draws the len bytes of pyramid's data starting at start as an image of at most w x h pixels,
+/// reading the counts from the pyramid, see render_overview() above for the other parameters.
+void render_overview(const CClassPyramid &pyramid, int64_t start, int64_t len, int w, int h, bool byte_classes,
+                     bool hilbert, std::vector<uint32_t> &img, int &img_w, int &img_h) {
+    COverviewImage ov;
+    ov.layout(len, w, h, byte_classes, hilbert);
+    ov.render(pyramid, start, 0, ov.pixelCount());
+
+    img = ov.pixels();
+    img_w = ov.width();
+    img_h = ov.height();
+}
@@ -18,6 +18,7 @@
  */
 
 #include <algorithm>
+#include <vector>
 #include <QtGui>
 
 #include "plot_view.h"
@@ -27,7 +28,7 @@ using std::max;
 
 CPlotView::CPlotView(QWidget *p)
         : QLabel(p),
-          m_UpperBandPos(0.), m_LowerBandPos(1.), m_MousePosX(-1), m_MousePosY(-1), m_ImageIndex(0), m_SelectionType(allow_selection_::NONE), m_AllowSelection(true) {
+          m_UpperBandPos(0.), m_LowerBandPos(1.), m_MousePosX(-1), m_MousePosY(-1), m_ImageIndex(0), m_SelectionType(allow_selection_::NONE), m_Normalize{true, true}, m_AllowSelection(true) {
 }
 
 void CPlotView::enableSelection(bool v) {
@@ -49,68 +50,98 @@ void CPlotView::setData(const float *dat, qsizetype len, bool normalize) {
 }
 
 void CPlotView::setData(int ind, const float *dat, qsizetype len, bool normalize) {
+    m_Series[ind].build(dat, len);
+    m_Normalize[ind] = normalize;
+
+    render(ind);
+}
+
+/// setEnvelope plots series ind from points already reduced from a longer series, drawing the band between
+/// their minima and maxima rather than around the means alone.
+void CPlotView::setEnvelope(int ind, const float *mean, const float *mn, const float *mx, qsizetype len,
+                            bool normalize) {
+    m_Series[ind].build(mean, mn, mx, len);
+    m_Normalize[ind] = normalize;
+
+    render(ind);
+}
+
+/// plot_color maps a normalized value to the plot's green, blue, red ramp, with intensity scaling the result.
+static unsigned int plot_color(float na, int intensity = 256) {
+    int c = 20 + int(na * (255 - 20));
+
+    int r = (c > 127) ? (c * 2) & 0xff : 0;
+    int g = (c <= 127) ? (255 - c * 2) : 0;
+    int b = (c > 127) ? (255 - c * 2) & 0xff : (c * 2);
+    r = r * intensity >> 8;
+    g = g * intensity >> 8;
+    b = b * intensity >> 8;
+
+    return (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+}
+
+/// render draws series ind at the view's size, one row per range of samples: the band between the range's
+/// minimum and maximum, so a single outlier stays visible however many samples share the row, and over it
+/// the line through the means.
+void CPlotView::render(int ind) {
+    const CSeriesSummary &series = m_Series[ind];
+    if (series.empty()) return;
+
     int w = width();
     int h = height();
+    if (w < 5 || h < 1) return;
 
     float mn = 0.;
     float mx = 1.;
-    if (normalize) {
-        mn = 99999999.;
-        mx = -99999999.;
-        for (qsizetype i = 0; i < len; i++) {
-            mn = min(mn, dat[i]);
-            mx = max(mx, dat[i]);
-        }
+    if (m_Normalize[ind]) {
+        mn = series.minimum();
+        mx = series.maximum();
         if (mn == mx) {
             mn -= .5;
             mx += .5;
         }
     }
 
-    {
-        QImage img(w, h, QImage::Format_RGB32);
-        img.fill(0);
-
-        auto acc = new float[h];
-        memset(acc, 0, h * sizeof(float));
-        auto cnt = new int[h];
-        memset(cnt, 0, h * sizeof(int));
-
-        for (qsizetype i = 0; i < len; i++) {
-            float v = dat[i];
-            qsizetype ind2 = qsizetype((i / double(len)) * (h - 1) + .5);
-            acc[ind2] += (v - mn) / (mx - mn);
-            cnt[ind2]++;
-        }
+    std::vector<float> mean(h), lo(h), hi(h);
+    series.sample(h, mean.data(), lo.data(), hi.data());
 
-        auto p = (unsigned int *) img.bits();
-        int px = -1;
-        int pc = -1;
-        for (int i = 0; i < h; i++) {
-            int x = px;
-            int c = pc;
-            if (cnt[i] == 0 && px == -1) continue;
-            if (cnt[i] > 0) {
-                float na = acc[i] / cnt[i];
-                x = int(na * (w - 4) + .5) + 2; // slight offset so not to interfere with border
-                px = x;
-                c = 20 + int(na * (255 - 20));
-                pc = c;
-            }
-
-            quint8 r = (c > 127) ? (c * 2) : (0);
-            quint8 g = (c <= 127) ? (255 - c * 2) : (0);
-            quint8 b = (c > 127) ? (255 - c * 2) : (c * 2);
-
-            unsigned int v = (0xff << 24) | (r << 16) | (g << 8) | (b << 0);
-            p[i * w + x] = v;
-        }
+    QImage img(w, h, QImage::Format_RGB32);
+    img.fill(0);
+
+    auto normalized = [mn, mx](float v) {
+        return min(1.f, max(0.f, (v - mn) / (mx - mn)));
+    };
+    auto column = [w](float na) {
+        return int(na * (w - 4) + .5) + 2; // slight offset so not to interfere with border
+    };
+
+    int px = -1;
+    for (int i = 0; i < h; i++) {
+        auto p = (unsigned int *) img.scanLine(i);
 
-        delete[] acc;
-        delete[] cnt;
+        float na = normalized(mean[i]);
+        int x = column(na);
+        int x0 = column(normalized(lo[i]));
+        int x1 = column(normalized(hi[i]));
 
-        setImage(ind, img);
+        unsigned int band = plot_color(na, 96);
+        for (int j = x0; j <= x1; j++) {
+            p[j] = band;
+        }
+
+        // Joining each mean to the previous row's keeps the line unbroken where it moves by more than a pixel.
+        unsigned int v = plot_color(na);
+        int l0 = x;
+        int l1 = x;
+        if (px >= 0 && px < x) l0 = px + 1;
+        if (px > x) l1 = px - 1;
+        for (int j = l0; j <= l1; j++) {
+            p[j] = v;
+        }
+        px = x;
     }
+
+    setImage(ind, img);
 }
 
 void CPlotView::paintEvent(QPaintEvent *e) {
@@ -138,6 +169,9 @@ void CPlotView::paintEvent(QPaintEvent *e) {
 void CPlotView::resizeEvent(QResizeEvent *e) {
     QLabel::resizeEvent(e);
 
+    for (int i = 0; i < 2; i++) {
+        render(i);
+    }
     update_pix();
 }
 
@@ -0,0 +1,817 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <deque>
+
+#include "parallel.h"
+#include "search.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SEARCH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SEARCH_TARGET(t) __attribute__((target(t)))
+#else
+#define SEARCH_TARGET(t)
+#endif
+
+using std::min;
+using std::max;
+
+// The workers take chunks of this size in turn, whose hits are added to the list as they complete.
+static const int64_t s_ChunkSize = int64_t(8) << 20;
+
+// Ranges shorter than this are not worth a worker of their own.
+static const int64_t s_MinBytesPerWorker = int64_t(32) << 20;
+
+// Positions passed by the filter are collected in blocks of this many before the patterns are checked.
+static const int64_t s_FilterBlock = 64 << 10;
+
+// Each call to the regex engine sees a window of s_RegexStride + s_RegexMaxLength bytes and keeps the
+// matches starting in its first s_RegexStride bytes, so matches of up to s_RegexMaxLength bytes are found
+// exactly, longer ones may be cut at the end of the window or missed. libstdc++ matches by recursing once or more per byte
+// consumed, taking up to 1 KB of stack each, the window rather than the data then bounds the stack used.
+static const int64_t s_RegexMaxLength = 512;
+static const int64_t s_RegexStride = 1536;
+
+// The automaton takes 1 KB per state, patterns needing more than this many are refused.
+static const size_t s_MaxStates = size_t(1) << 16;
+
+static int hex_digit(char c) {
+    if ('0' <= c && c <= '9') return c - '0';
+    if ('a' <= c && c <= 'f') return c - 'a' + 10;
+    if ('A' <= c && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/// parse_hex_pattern parses pairs of hex digits, spaces between them being optional. A '?' in place of a
+/// digit is a wildcard for that nibble, so "??" matches any byte and "4?" any of 0x40 to 0x4f.
+/// @return false if s is empty or not such pairs.
+bool parse_hex_pattern(const std::string &s, SearchPattern_t &pattern) {
+    pattern = SearchPattern_t();
+
+    std::string digits;
+    for (char c : s) {
+        if (c == ' ' || c == '\t') continue;
+        if (c != '?' && hex_digit(c) < 0) return false;
+        digits.push_back(c);
+    }
+    if (digits.empty() || digits.size() % 2 != 0) return false;
+
+    for (size_t i = 0; i < digits.size(); i += 2) {
+        uint8_t v = 0;
+        uint8_t m = 0;
+        for (int j = 0; j < 2; j++) {
+            int shift = j == 0 ? 4 : 0;
+            if (digits[i + j] != '?') {
+                v |= uint8_t(hex_digit(digits[i + j]) << shift);
+                m |= uint8_t(0xf << shift);
+            }
+        }
+        pattern.bytes.push_back(v);
+        pattern.mask.push_back(m);
+    }
+    return true;
+}
+
+/// ascii_pattern returns the pattern matching the bytes of s exactly.
+SearchPattern_t ascii_pattern(const std::string &s) {
+    SearchPattern_t pattern;
+    pattern.bytes.assign(s.begin(), s.end());
+    pattern.mask.assign(s.size(), 0xff);
+    return pattern;
+}
+
+/// utf16_pattern converts utf8 to the pattern matching it in UTF-16LE.
+/// @return false if utf8 is empty or not valid UTF-8.
+bool utf16_pattern(const std::string &utf8, SearchPattern_t &pattern) {
+    pattern = SearchPattern_t();
+
+    size_t i = 0;
+    while (i < utf8.size()) {
+        uint8_t c = uint8_t(utf8[i]);
+        int extra = c < 0x80 ? 0 : (c & 0xe0) == 0xc0 ? 1 : (c & 0xf0) == 0xe0 ? 2 : (c & 0xf8) == 0xf0 ? 3 : -1;
+        if (extra < 0 || i + extra >= utf8.size()) return false;
+
+        uint32_t cp = extra == 0 ? c : c & (0x3f >> extra);
+        for (int j = 1; j <= extra; j++) {
+            uint8_t cc = uint8_t(utf8[i + j]);
+            if ((cc & 0xc0) != 0x80) return false;
+            cp = (cp << 6) | (cc & 0x3f);
+        }
+        i += extra + 1;
+
+        auto add = [&](uint32_t u) {
+            pattern.bytes.push_back(uint8_t(u & 0xff));
+            pattern.bytes.push_back(uint8_t(u >> 8));
+        };
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            add(0xd800 + (cp >> 10));
+            add(0xdc00 + (cp & 0x3ff));
+        } else {
+            add(cp);
+        }
+    }
+
+    pattern.mask.assign(pattern.bytes.size(), 0xff);
+    return !pattern.bytes.empty();
+}
+
+/// regex_pattern returns the pattern matching the ECMAScript regular expression s.
+SearchPattern_t regex_pattern(const std::string &s) {
+    SearchPattern_t pattern;
+    pattern.regex = s;
+    return pattern;
+}
+
+static bool hit_before(const SearchHit_t &h, int64_t offset) {
+    return h.offset < offset;
+}
+
+CSearchHits::CSearchHits()
+        : m_Count(0), m_MaxLength(0), m_Limit(INT64_MAX) {
+}
+
+void CSearchHits::clear() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Chunks.clear();
+    m_Count = 0;
+    m_MaxLength = 0;
+    m_Limit = INT64_MAX;
+}
+
+/// add adds the hits, sorted by offset, of the chunk starting at start. Once more than s_MaxHits are held,
+/// those of the highest offsets are dropped, so the list keeps the lowest whatever order chunks complete in.
+void CSearchHits::add(int64_t start, const std::vector<SearchHit_t> &hits) {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    auto last = std::lower_bound(hits.begin(), hits.end(), m_Limit, hit_before);
+    if (last == hits.begin()) return;
+
+    auto &chunk = m_Chunks[start];
+    chunk.assign(hits.begin(), last);
+    for (const auto &h : chunk) {
+        m_MaxLength = max(m_MaxLength, h.length);
+    }
+    m_Count += chunk.size();
+
+    while (m_Count > s_MaxHits) {
+        auto it = std::prev(m_Chunks.end());
+        auto &v = it->second;
+        size_t excess = m_Count - s_MaxHits;
+        if (excess >= v.size()) {
+            m_Limit = min(m_Limit, v.front().offset);
+            m_Count -= v.size();
+            m_Chunks.erase(it);
+            continue;
+        }
+
+        // Cut at an offset, so that no hit starting there is kept while others are dropped.
+        m_Limit = min(m_Limit, v[v.size() - excess].offset);
+        while (!v.empty() && v.back().offset >= m_Limit) {
+            v.pop_back();
+            m_Count--;
+        }
+        if (v.empty()) m_Chunks.erase(it);
+    }
+}
+
+/// accepts returns whether hits starting at offset would still be kept, false from the first one dropped on.
+bool CSearchHits::accepts(int64_t offset) const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return offset < m_Limit;
+}
+
+size_t CSearchHits::size() const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Count;
+}
+
+bool CSearchHits::truncated() const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Limit != INT64_MAX;
+}
+
+/// within copies the hits overlapping [start, end) to out, sorted by offset.
+void CSearchHits::within(int64_t start, int64_t end, std::vector<SearchHit_t> &out) const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    out.clear();
+
+    // Hits starting up to the longest hit before start may reach into the range.
+    int64_t lo = start - m_MaxLength + 1;
+    auto it = m_Chunks.upper_bound(lo);
+    if (it != m_Chunks.begin()) --it;
+
+    for (; it != m_Chunks.end() && it->first < end; ++it) {
+        const auto &v = it->second;
+        for (auto h = std::lower_bound(v.begin(), v.end(), lo, hit_before); h != v.end() && h->offset < end; ++h) {
+            if (h->offset + h->length > start) out.push_back(*h);
+        }
+    }
+}
+
+/// next finds the first hit starting at or after offset.
+bool CSearchHits::next(int64_t offset, SearchHit_t &hit) const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    auto it = m_Chunks.upper_bound(offset);
+    if (it != m_Chunks.begin()) --it;
+
+    for (; it != m_Chunks.end(); ++it) {
+        const auto &v = it->second;
+        auto h = std::lower_bound(v.begin(), v.end(), offset, hit_before);
+        if (h != v.end()) {
+            hit = *h;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// previous finds the last hit starting before offset.
+bool CSearchHits::previous(int64_t offset, SearchHit_t &hit) const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for (auto it = m_Chunks.lower_bound(offset); it != m_Chunks.begin();) {
+        --it;
+        const auto &v = it->second;
+        auto h = std::lower_bound(v.begin(), v.end(), offset, hit_before);
+        if (h != v.begin()) {
+            hit = *(h - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/// rank returns the number of hits starting before offset.
+size_t CSearchHits::rank(int64_t offset) const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    size_t rv = 0;
+    for (auto it = m_Chunks.begin(); it != m_Chunks.end() && it->first < offset; ++it) {
+        const auto &v = it->second;
+        rv += std::lower_bound(v.begin(), v.end(), offset, hit_before) - v.begin();
+    }
+    return rv;
+}
+
+/// density counts the hits starting within each of n_out equal parts of [start, end).
+void CSearchHits::density(int64_t start, int64_t end, int n_out, uint32_t *counts) const {
+    std::fill(counts, counts + n_out, 0);
+    if (end <= start || n_out <= 0) return;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    auto it = m_Chunks.upper_bound(start);
+    if (it != m_Chunks.begin()) --it;
+
+    double scale = double(n_out) / double(end - start);
+    for (; it != m_Chunks.end() && it->first < end; ++it) {
+        const auto &v = it->second;
+        for (auto h = std::lower_bound(v.begin(), v.end(), start, hit_before); h != v.end() && h->offset < end; ++h) {
+            counts[min(n_out - 1, int(double(h->offset - start) * scale))]++;
+        }
+    }
+}
+
+typedef void (*filter_fn_t)(const uint8_t *, int64_t, int64_t, const int *, const uint8_t *, std::vector<int64_t> &);
+
+/// filter_scalar appends the positions i in [start, end) where dat[i + off[k]] equals byte[k] for both k.
+static void filter_scalar(const uint8_t *dat, int64_t start, int64_t end, const int *off, const uint8_t *byte,
+                          std::vector<int64_t> &out) {
+    for (int64_t i = start; i < end; i++) {
+        if (dat[i + off[0]] == byte[0] && dat[i + off[1]] == byte[1]) out.push_back(i);
+    }
+}
+
+typedef int64_t (*skip_fn_t)(const uint8_t *, int64_t, int64_t, const uint8_t *);
+
+/// skip_scalar returns the first position in [start, end) holding any of the 4 bytes, or end.
+static int64_t skip_scalar(const uint8_t *dat, int64_t start, int64_t end, const uint8_t *bytes) {
+    for (int64_t i = start; i < end; i++) {
+        uint8_t c = dat[i];
+        if (c == bytes[0] || c == bytes[1] || c == bytes[2] || c == bytes[3]) return i;
+    }
+    return end;
+}
+
+#ifdef SEARCH_X86
+static inline int lowest_bit(uint32_t m) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, m);
+    return int(i);
+#else
+    return __builtin_ctz(m);
+#endif
+}
+
+SEARCH_TARGET("sse2")
+static void filter_sse2(const uint8_t *dat, int64_t start, int64_t end, const int *off, const uint8_t *byte,
+                        std::vector<int64_t> &out) {
+    __m128i f0 = _mm_set1_epi8(char(byte[0]));
+    __m128i f1 = _mm_set1_epi8(char(byte[1]));
+    const uint8_t *p0 = dat + off[0];
+    const uint8_t *p1 = dat + off[1];
+
+    int64_t i = start;
+    for (; i + 16 <= end; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p0 + i)), f0);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p1 + i)), f1);
+        uint32_t m = uint32_t(_mm_movemask_epi8(_mm_and_si128(a, b)));
+        while (m != 0) {
+            out.push_back(i + lowest_bit(m));
+            m &= m - 1;
+        }
+    }
+    filter_scalar(dat, i, end, off, byte, out);
+}
+
+SEARCH_TARGET("avx2")
+static void filter_avx2(const uint8_t *dat, int64_t start, int64_t end, const int *off, const uint8_t *byte,
+                        std::vector<int64_t> &out) {
+    __m256i f0 = _mm256_set1_epi8(char(byte[0]));
+    __m256i f1 = _mm256_set1_epi8(char(byte[1]));
+    const uint8_t *p0 = dat + off[0];
+    const uint8_t *p1 = dat + off[1];
+
+    int64_t i = start;
+    for (; i + 32 <= end; i += 32) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (p0 + i)), f0);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (p1 + i)), f1);
+        uint32_t m = uint32_t(_mm256_movemask_epi8(_mm256_and_si256(a, b)));
+        while (m != 0) {
+            out.push_back(i + lowest_bit(m));
+            m &= m - 1;
+        }
+    }
+    filter_scalar(dat, i, end, off, byte, out);
+}
+
+SEARCH_TARGET("sse2")
+static int64_t skip_sse2(const uint8_t *dat, int64_t start, int64_t end, const uint8_t *bytes) {
+    __m128i b0 = _mm_set1_epi8(char(bytes[0]));
+    __m128i b1 = _mm_set1_epi8(char(bytes[1]));
+    __m128i b2 = _mm_set1_epi8(char(bytes[2]));
+    __m128i b3 = _mm_set1_epi8(char(bytes[3]));
+
+    int64_t i = start;
+    for (; i + 16 <= end; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (dat + i));
+        __m128i a = _mm_or_si128(_mm_cmpeq_epi8(v, b0), _mm_cmpeq_epi8(v, b1));
+        __m128i b = _mm_or_si128(_mm_cmpeq_epi8(v, b2), _mm_cmpeq_epi8(v, b3));
+        uint32_t m = uint32_t(_mm_movemask_epi8(_mm_or_si128(a, b)));
+        if (m != 0) return i + lowest_bit(m);
+    }
+    return skip_scalar(dat, i, end, bytes);
+}
+
+SEARCH_TARGET("avx2")
+static int64_t skip_avx2(const uint8_t *dat, int64_t start, int64_t end, const uint8_t *bytes) {
+    __m256i b0 = _mm256_set1_epi8(char(bytes[0]));
+    __m256i b1 = _mm256_set1_epi8(char(bytes[1]));
+    __m256i b2 = _mm256_set1_epi8(char(bytes[2]));
+    __m256i b3 = _mm256_set1_epi8(char(bytes[3]));
+
+    int64_t i = start;
+    for (; i + 32 <= end; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (dat + i));
+        __m256i a = _mm256_or_si256(_mm256_cmpeq_epi8(v, b0), _mm256_cmpeq_epi8(v, b1));
+        __m256i b = _mm256_or_si256(_mm256_cmpeq_epi8(v, b2), _mm256_cmpeq_epi8(v, b3));
+        uint32_t m = uint32_t(_mm256_movemask_epi8(_mm256_or_si256(a, b)));
+        if (m != 0) return i + lowest_bit(m);
+    }
+    return skip_scalar(dat, i, end, bytes);
+}
+
+static bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+#endif
+
+struct FilterKernel_t {
+    filter_fn_t fn;
+    skip_fn_t skip;
+    const char *name;
+};
+
+static FilterKernel_t select_filter() {
+#ifdef SEARCH_X86
+    if (cpu_has_avx2()) return {filter_avx2, skip_avx2, "avx2"};
+    return {filter_sse2, skip_sse2, "sse2"};
+#else
+    return {filter_scalar, skip_scalar, "scalar"};
+#endif
+}
+
+static const FilterKernel_t &filter_kernel() {
+    static const FilterKernel_t k = select_filter();
+    return k;
+}
+
+CSearch::CSearch()
+        : m_MaxLength(0), m_Filtered(false), m_FilterOffset(), m_FilterByte(), m_ByteClass(), m_Classes(0), m_SkipCount(0), m_SkipBytes() {
+}
+
+/// compile prepares the search for patterns, replacing any previous ones.
+/// @param [out] error Why the patterns were refused.
+/// @return false if any pattern is empty or an invalid expression, or the patterns need too many states.
+bool CSearch::compile(const std::vector<SearchPattern_t> &patterns, std::string &error) {
+    m_Patterns.clear();
+    m_Regexes.clear();
+    m_MaxLength = 0;
+    m_Filtered = false;
+    m_Next.clear();
+    m_Anchors.clear();
+    m_Suffix.clear();
+    m_Starts.clear();
+    m_Classes = 0;
+    m_SkipCount = 0;
+    m_Unanchored.clear();
+
+    if (patterns.empty()) {
+        error = "no pattern";
+        return false;
+    }
+
+    for (size_t i = 0; i < patterns.size(); i++) {
+        const auto &sp = patterns[i];
+        if (!sp.regex.empty()) {
+            try {
+                m_Regexes.push_back({std::regex(sp.regex, std::regex::ECMAScript | std::regex::optimize), int(i)});
+            } catch (const std::regex_error &e) {
+                error = "invalid regular expression: " + std::string(e.what());
+                return false;
+            }
+            continue;
+        }
+        if (sp.bytes.empty() || sp.bytes.size() != sp.mask.size()) {
+            error = "empty pattern";
+            return false;
+        }
+
+        Pattern_t p;
+        p.mask = sp.mask;
+        p.bytes.resize(sp.bytes.size());
+        for (size_t j = 0; j < sp.bytes.size(); j++) {
+            p.bytes[j] = sp.bytes[j] & sp.mask[j];
+        }
+        p.index = int(i);
+
+        p.anchor_offset = 0;
+        p.anchor_length = 0;
+        for (int j = 0; j < int(p.mask.size());) {
+            if (p.mask[j] != 0xff) {
+                j++;
+                continue;
+            }
+            int k = j;
+            while (k < int(p.mask.size()) && p.mask[k] == 0xff) k++;
+            if (k - j > p.anchor_length) {
+                p.anchor_offset = j;
+                p.anchor_length = k - j;
+            }
+            j = k;
+        }
+
+        m_MaxLength = max(m_MaxLength, int(p.bytes.size()));
+        m_Patterns.push_back(std::move(p));
+    }
+
+    // A single anchored pattern is filtered on its first and last exactly given bytes.
+    if (m_Patterns.size() == 1 && m_Patterns[0].anchor_length > 0) {
+        const Pattern_t &p = m_Patterns[0];
+        int first = 0;
+        while (p.mask[first] != 0xff) first++;
+        int last = int(p.mask.size()) - 1;
+        while (p.mask[last] != 0xff) last--;
+
+        m_Filtered = true;
+        m_FilterOffset[0] = first;
+        m_FilterOffset[1] = last;
+        m_FilterByte[0] = p.bytes[first];
+        m_FilterByte[1] = p.bytes[last];
+        return true;
+    }
+
+    // Bytes found in no anchor all behave alike and share class 0, the others have a class each, which
+    // keeps the rows of the automaton short enough for it to stay in the L1 cache.
+    std::vector<uint8_t> used(256, 0);
+    for (int k = 0; k < int(m_Patterns.size()); k++) {
+        const Pattern_t &p = m_Patterns[k];
+        if (p.anchor_length == 0) {
+            m_Unanchored.push_back(k);
+            continue;
+        }
+        for (int j = p.anchor_offset; j < p.anchor_offset + p.anchor_length; j++) {
+            used[p.bytes[j]] = 1;
+        }
+    }
+    int distinct = int(std::count(used.begin(), used.end(), 1));
+    if (distinct == 0) {
+        return true;
+    }
+    m_Classes = distinct == 256 ? 256 : distinct + 1;
+    for (int c = 0, k = m_Classes - distinct; c < 256; c++) {
+        m_ByteClass[c] = used[c] ? uint8_t(k++) : 0;
+    }
+    const int w = m_Classes;
+
+    // The trie of the anchors, then the transitions of its states that leave it, from the states of their
+    // longest proper suffixes, breadth first.
+    std::vector<int32_t> next(w, -1);
+    m_Anchors.emplace_back();
+    for (int k = 0; k < int(m_Patterns.size()); k++) {
+        const Pattern_t &p = m_Patterns[k];
+        if (p.anchor_length == 0) continue;
+
+        int s = 0;
+        for (int j = p.anchor_offset; j < p.anchor_offset + p.anchor_length; j++) {
+            size_t e = size_t(s) * w + m_ByteClass[p.bytes[j]];
+            if (next[e] < 0) {
+                if (m_Anchors.size() >= s_MaxStates) {
+                    error = "too many patterns";
+                    return false;
+                }
+                next[e] = int32_t(m_Anchors.size());
+                m_Anchors.emplace_back();
+                next.resize(next.size() + w, -1);
+            }
+            s = next[e];
+        }
+        m_Anchors[s].push_back(k);
+    }
+
+    size_t states = m_Anchors.size();
+    std::vector<int32_t> fail(states, 0);
+    std::vector<uint8_t> matches(states, 0);
+    m_Suffix.assign(states, -1);
+
+    std::deque<int32_t> queue;
+    for (int c = 0; c < w; c++) {
+        if (next[c] < 0) {
+            next[c] = 0;
+        } else {
+            queue.push_back(next[c]);
+        }
+    }
+    while (!queue.empty()) {
+        int32_t s = queue.front();
+        queue.pop_front();
+
+        matches[s] = !m_Anchors[s].empty() || m_Suffix[s] >= 0;
+        for (int c = 0; c < w; c++) {
+            int32_t &t = next[size_t(s) * w + c];
+            int32_t f = next[size_t(fail[s]) * w + c];
+            if (t < 0) {
+                t = f;
+            } else {
+                fail[t] = f;
+                m_Suffix[t] = m_Anchors[f].empty() ? m_Suffix[f] : f;
+                queue.push_back(t);
+            }
+        }
+    }
+
+    // Transitions hold the offset of the row of the next state, shifted left, and whether it matches.
+    m_Next.resize(next.size());
+    for (size_t e = 0; e < next.size(); e++) {
+        m_Next[e] = (next[e] * w) << 1 | matches[next[e]];
+    }
+
+    // Up to 4 starting bytes are skipped to with SIMD, the first repeated to fill the unused ones.
+    m_Starts.assign(256, 0);
+    for (int c = 0; c < 256; c++) {
+        m_Starts[c] = next[m_ByteClass[c]] != 0;
+    }
+    int starting = int(std::count(m_Starts.begin(), m_Starts.end(), 1));
+    if (starting <= 4) {
+        int k = 0;
+        for (int c = 0; c < 256; c++) {
+            if (m_Starts[c]) m_SkipBytes[k++] = uint8_t(c);
+        }
+        for (int j = k; j < 4; j++) {
+            m_SkipBytes[j] = m_SkipBytes[0];
+        }
+        m_SkipCount = k;
+    }
+
+    return true;
+}
+
+/// kernelName returns the name of the method the patterns are found with.
+const char *CSearch::kernelName() const {
+    if (m_Filtered) return filter_kernel().name;
+    if (m_Anchors.size() > 1) return "aho-corasick";
+    if (!m_Unanchored.empty()) return "scalar";
+    return "regex";
+}
+
+bool CSearch::matches(const Pattern_t &p, const uint8_t *dat) const {
+    for (size_t k = 0; k < p.bytes.size(); k++) {
+        if ((dat[k] & p.mask[k]) != p.bytes[k]) return false;
+    }
+    return true;
+}
+
+/// find appends the hits starting within [start, end) of dat, of n bytes, to hits, sorted by offset.
+/// @param [in] cancel Optional flag polled by the slower regular expressions, which give up once it is set.
+void CSearch::find(const uint8_t *dat, int64_t n, int64_t start, int64_t end, std::vector<SearchHit_t> &hits,
+                   const std::atomic<bool> *cancel) const {
+    size_t first = hits.size();
+
+    if (m_Filtered) {
+        findFiltered(dat, n, start, end, hits);
+    } else {
+        if (m_Anchors.size() > 1) findAutomaton(dat, n, start, end, hits);
+        for (int k : m_Unanchored) {
+            findEverywhere(m_Patterns[k], dat, n, start, end, hits);
+        }
+    }
+    for (const auto &r : m_Regexes) {
+        findRegex(r, dat, n, start, end, hits, cancel);
+    }
+
+    std::sort(hits.begin() + first, hits.end(), [](const SearchHit_t &a, const SearchHit_t &b) {
+        return a.offset < b.offset || (a.offset == b.offset && a.pattern < b.pattern);
+    });
+}
+
+void CSearch::findFiltered(const uint8_t *dat, int64_t n, int64_t start, int64_t end, std::vector<SearchHit_t> &hits) const {
+    const Pattern_t &p = m_Patterns[0];
+    int64_t len = int64_t(p.bytes.size());
+
+    // The filter reads up to the last byte of a pattern starting before end.
+    end = min(end, n - len + 1);
+
+    filter_fn_t fn = filter_kernel().fn;
+    std::vector<int64_t> candidates;
+    candidates.reserve(s_FilterBlock);
+    for (int64_t b = start; b < end; b += s_FilterBlock) {
+        candidates.clear();
+        fn(dat, b, min(end, b + s_FilterBlock), m_FilterOffset, m_FilterByte, candidates);
+        for (int64_t i : candidates) {
+            if (matches(p, dat + i)) hits.push_back({i, int32_t(len), p.index});
+        }
+    }
+}
+
+void CSearch::findAutomaton(const uint8_t *dat, int64_t n, int64_t start, int64_t end, std::vector<SearchHit_t> &hits) const {
+    // The anchors of patterns starting before end end before this.
+    int64_t scan_end = min(n, end + m_MaxLength - 1);
+
+    const int32_t *next = m_Next.data();
+    const uint8_t *classes = m_ByteClass;
+    const uint8_t *starts = m_Starts.data();
+    skip_fn_t skip = m_SkipCount > 0 ? filter_kernel().skip : nullptr;
+    int32_t e = 0;
+    for (int64_t i = start; i < scan_end; i++) {
+        // At the root, bytes that start no anchor are skipped without the dependent table lookups, with
+        // SIMD when there are few bytes that do.
+        if (e == 0) {
+            if (skip) {
+                i = skip(dat, i, scan_end, m_SkipBytes);
+            } else {
+                while (i < scan_end && !starts[dat[i]]) i++;
+            }
+            if (i == scan_end) break;
+        }
+
+        e = next[(e >> 1) + classes[dat[i]]];
+        if ((e & 1) == 0) continue;
+
+        int32_t s = (e >> 1) / m_Classes;
+        for (int32_t t = m_Anchors[s].empty() ? m_Suffix[s] : s; t >= 0; t = m_Suffix[t]) {
+            for (int k : m_Anchors[t]) {
+                const Pattern_t &p = m_Patterns[k];
+                int64_t len = int64_t(p.bytes.size());
+                int64_t pos = i - p.anchor_length + 1 - p.anchor_offset;
+                if (pos < start || pos >= end || pos + len > n) continue;
+                if (matches(p, dat + pos)) hits.push_back({pos, int32_t(len), p.index});
+            }
+        }
+    }
+}
+
+void CSearch::findEverywhere(const Pattern_t &p, const uint8_t *dat, int64_t n, int64_t start, int64_t end,
+                             std::vector<SearchHit_t> &hits) const {
+    int64_t len = int64_t(p.bytes.size());
+    end = min(end, n - len + 1);
+    for (int64_t i = start; i < end; i++) {
+        if (matches(p, dat + i)) hits.push_back({i, int32_t(len), p.index});
+    }
+}
+
+/// findRegex appends the non-empty matches of r starting within [start, end), searching a bounded window
+/// at a time. Matches overlapping the previous one found are skipped, as by std::regex_iterator.
+void CSearch::findRegex(const Regex_t &r, const uint8_t *dat, int64_t n, int64_t start, int64_t end,
+                        std::vector<SearchHit_t> &hits, const std::atomic<bool> *cancel) const {
+    end = min(end, n);
+
+    std::cmatch m;
+    for (int64_t p = start; p < end;) {
+        if (cancel && *cancel) return;
+
+        int64_t w_end = min(n, p + s_RegexStride + s_RegexMaxLength);
+
+        auto flags = std::regex_constants::match_default;
+        if (p > 0) flags |= std::regex_constants::match_prev_avail;
+        if (w_end < n) flags |= std::regex_constants::match_not_eol | std::regex_constants::match_not_eow;
+
+        bool found;
+        try {
+            found = std::regex_search((const char *) dat + p, (const char *) dat + w_end, m, r.re, flags);
+        } catch (const std::regex_error &) {
+            // Engines bounding their own stack or step count throw instead, the window is given up.
+            found = false;
+        }
+
+        int64_t q = found ? p + m.position(0) : w_end;
+        if (q >= end) break;
+
+        // Past the stride, the match may have been cut short or missed for lack of bytes, the next window,
+        // starting at the stride, finds it again.
+        if (q >= p + s_RegexStride && w_end < n) {
+            p += s_RegexStride;
+            continue;
+        }
+
+        int64_t len = m.length(0);
+        if (len == 0) {
+            p = q + 1;
+            continue;
+        }
+
+        hits.push_back({q, int32_t(len), r.index});
+        p = q + len;
+    }
+}
+
+/// run searches the n bytes of dat, its chunks handed out to the workers in offset order, adding the hits of
+/// each chunk to hits as it is done. No chunk is started past the first hit dropped once the list is full.
+/// @param [in] cancel Optional flag, polled between chunks, that abandons the search when set.
+/// @param [in,out] done Optional counter the bytes searched are added to.
+/// @return false if cancelled.
+bool CSearch::run(const uint8_t *dat, int64_t n, CSearchHits &hits, const std::atomic<bool> *cancel,
+                  std::atomic<int64_t> *done) const {
+    int64_t chunks = (n + s_ChunkSize - 1) / s_ChunkSize;
+    std::atomic<int64_t> next(0);
+    parallel_run(parallel_worker_count(n, s_MinBytesPerWorker), [&](int) {
+        std::vector<SearchHit_t> found;
+        for (int64_t i = next++; i < chunks; i = next++) {
+            int64_t c = i * s_ChunkSize;
+            if (cancel && *cancel) return;
+            if (!hits.accepts(c)) return;
+
+            int64_t ce = min(n, c + s_ChunkSize);
+            found.clear();
+            find(dat, n, c, ce, found, cancel);
+            if (cancel && *cancel) return;
+
+            hits.add(c, found);
+            if (done) *done += ce - c;
+        }
+    });
+
+    return !(cancel && *cancel);
+}
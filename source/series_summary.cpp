@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "series_summary.h"
+
+using std::min;
+using std::max;
+
+CSeriesSummary::CSeriesSummary()
+        : m_Min(0.f), m_Max(0.f) {
+}
+
+/// build copies the n values of dat and summarizes them.
+void CSeriesSummary::build(const float *dat, int64_t n) {
+    build(dat, nullptr, nullptr, n);
+}
+
+/// build copies a series already reduced to n points, the mean, minimum and maximum of each, and
+/// summarizes it so that the envelope of any range is that of the points' minima and maxima.
+/// @param [in] mean Mean of each point.
+/// @param [in] mn Optional minimum of each point, the mean if null.
+/// @param [in] mx Optional maximum of each point, the mean if null.
+/// @param [in] n Number of points.
+void CSeriesSummary::build(const float *mean, const float *mn, const float *mx, int64_t n) {
+    clear();
+
+    if (mean == nullptr || n <= 0) {
+        return;
+    }
+
+    m_Values.assign(mean, mean + n);
+    if (mn) m_ValueMin.assign(mn, mn + n);
+    if (mx) m_ValueMax.assign(mx, mx + n);
+
+    // The first level reads the points, every other one the level below.
+    int64_t sn = n;
+    while (sn > 1) {
+        const Level_t *src = m_Levels.empty() ? nullptr : &m_Levels.back();
+        int64_t dn = (sn + s_Fanout - 1) / s_Fanout;
+
+        Level_t dst;
+        dst.min.resize(dn);
+        dst.max.resize(dn);
+        dst.sum.resize(dn);
+        for (int64_t i = 0; i < dn; i++) {
+            int64_t b = i * s_Fanout;
+            int64_t e = min(sn, b + s_Fanout);
+            float lo, hi;
+            double s = 0.;
+            if (src) {
+                lo = src->min[b];
+                hi = src->max[b];
+                for (int64_t j = b; j < e; j++) {
+                    lo = min(lo, src->min[j]);
+                    hi = max(hi, src->max[j]);
+                    s += src->sum[j];
+                }
+            } else {
+                lo = valueMin(b);
+                hi = valueMax(b);
+                for (int64_t j = b; j < e; j++) {
+                    lo = min(lo, valueMin(j));
+                    hi = max(hi, valueMax(j));
+                    s += m_Values[j];
+                }
+            }
+            dst.min[i] = lo;
+            dst.max[i] = hi;
+            dst.sum[i] = s;
+        }
+
+        m_Levels.emplace_back(std::move(dst));
+        sn = dn;
+    }
+
+    if (m_Levels.empty()) {
+        m_Min = valueMin(0);
+        m_Max = valueMax(0);
+    } else {
+        m_Min = m_Levels.back().min[0];
+        m_Max = m_Levels.back().max[0];
+    }
+}
+
+void CSeriesSummary::clear() {
+    m_Values.clear();
+    m_Values.shrink_to_fit();
+    m_ValueMin.clear();
+    m_ValueMin.shrink_to_fit();
+    m_ValueMax.clear();
+    m_ValueMax.shrink_to_fit();
+    m_Levels.clear();
+    m_Min = m_Max = 0.f;
+}
+
+/// memoryUsage returns the number of bytes held by the values, their envelope and all levels.
+int64_t CSeriesSummary::memoryUsage() const {
+    int64_t rv = int64_t((m_Values.capacity() + m_ValueMin.capacity() + m_ValueMax.capacity()) * sizeof(float));
+    for (const auto &l : m_Levels) {
+        rv += int64_t((l.min.capacity() + l.max.capacity()) * sizeof(float) + l.sum.capacity() * sizeof(double));
+    }
+    return rv;
+}
+
+/// summarize computes the minimum, maximum and sum of the values [start, end), which must not be empty.
+/// Values are read singly at the ends of the range up to the first whole group, and whole groups from the
+/// coarsest level they fit, so at most 2 * s_Fanout entries of each level are read.
+void CSeriesSummary::summarize(int64_t start, int64_t end, float &mn, float &mx, double &sum) const {
+    start = max<int64_t>(0, start);
+    end = min(size(), end);
+
+    mn = valueMin(start);
+    mx = valueMax(start);
+    sum = 0.;
+
+    int64_t b = start;
+    int64_t e = end;
+    for (int li = -1; b < e; li++) {
+        const Level_t *l = li < 0 ? nullptr : &m_Levels[li];
+        auto add = [&](int64_t i) {
+            if (l) {
+                mn = min(mn, l->min[i]);
+                mx = max(mx, l->max[i]);
+                sum += l->sum[i];
+            } else {
+                mn = min(mn, valueMin(i));
+                mx = max(mx, valueMax(i));
+                sum += m_Values[i];
+            }
+        };
+
+        // Entries up to the first group boundary of the level above and from the last one, the rest is
+        // covered by that level. The top level is read whole.
+        if (li + 1 == int(m_Levels.size())) {
+            for (int64_t i = b; i < e; i++) {
+                add(i);
+            }
+            break;
+        }
+
+        int64_t gb = (b + s_Fanout - 1) / s_Fanout;
+        int64_t ge = e / s_Fanout;
+        if (gb >= ge) {
+            for (int64_t i = b; i < e; i++) {
+                add(i);
+            }
+            break;
+        }
+        for (int64_t i = b; i < gb * s_Fanout; i++) {
+            add(i);
+        }
+        for (int64_t i = ge * s_Fanout; i < e; i++) {
+            add(i);
+        }
+        b = gb;
+        e = ge;
+    }
+}
+
+/// sample splits the series into n_out consecutive ranges of equal length, or single values when there are
+/// fewer values than ranges, and computes the mean, minimum and maximum of each.
+/// @param [in] n_out Number of ranges.
+/// @param [out] mean Mean of each range.
+/// @param [out] mn Optional minimum of each range.
+/// @param [out] mx Optional maximum of each range.
+void CSeriesSummary::sample(int n_out, float *mean, float *mn, float *mx) const {
+    int64_t n = size();
+    for (int i = 0; i < n_out; i++) {
+        if (n == 0) {
+            mean[i] = 0.f;
+            if (mn) mn[i] = 0.f;
+            if (mx) mx[i] = 0.f;
+            continue;
+        }
+
+        int64_t s = n * i / n_out;
+        int64_t e = max(s + 1, n * (i + 1) / n_out);
+
+        float lo, hi;
+        double sum;
+        summarize(s, e, lo, hi, sum);
+        mean[i] = float(sum / double(e - s));
+        if (mn) mn[i] = lo;
+        if (mx) mx[i] = hi;
+    }
+}
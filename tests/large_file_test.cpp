@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Runs the analyses of the viewer over a sparse file of 8 GiB, all zeros but for a single 0xff byte
+// beyond 4 GiB, so that counts and offsets no longer fit 32 bits. The expected results follow from
+// the position of that byte alone.
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "byte_classes.h"
+#include "byte_index.h"
+#include "class_pyramid.h"
+#include "entropy_pyramid.h"
+#include "histogram_calc.h"
+#include "mapped_file.h"
+#include "overview.h"
+
+using std::vector;
+
+static const int64_t s_FileSize = int64_t(8) << 30;
+static const int64_t s_Marker = (int64_t(6) << 30) + 12345;
+
+// ctest reports the test as skipped rather than failed when the file cannot be created.
+static const int s_SkipReturnCode = 77;
+
+static int s_Failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char *what, int line) {
+    if (!ok) {
+        fprintf(stderr, "line %d: check failed: %s\n", line, what);
+        s_Failures++;
+    }
+}
+
+/// create_sparse_file creates filename as a hole of s_FileSize bytes holding the marker byte.
+static bool create_sparse_file(const char *filename) {
+    int fd = open(filename, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        perror(filename);
+        return false;
+    }
+
+    const uint8_t marker = 0xff;
+    bool ok = ftruncate(fd, s_FileSize) == 0 && pwrite(fd, &marker, 1, s_Marker) == 1;
+    if (!ok) {
+        perror(filename);
+    }
+    close(fd);
+    return ok;
+}
+
+static void test_byte_index(const CMappedFile &f) {
+    CByteIndex index;
+    index.build(f.data(), f.size());
+    CHECK(index.size() == s_FileSize);
+    CHECK(index.blockSize() <= (4 << 20));
+
+    uint64_t counts[256];
+    index.counts(0, s_FileSize, counts);
+    CHECK(counts[0] == uint64_t(s_FileSize - 1));
+    CHECK(counts[0xff] == 1);
+
+    index.counts(s_Marker - 1000, s_Marker + 1000, counts);
+    CHECK(counts[0] == 1999);
+    CHECK(counts[0xff] == 1);
+
+    index.counts(s_Marker + 1, s_FileSize, counts);
+    CHECK(counts[0] == uint64_t(s_FileSize - s_Marker - 1));
+    CHECK(counts[0xff] == 0);
+}
+
+static void test_histo_2d(const CMappedFile &f) {
+    int *hist = generate_histo_2d(f.data(), f.size(), HistoDtype_t::U8);
+    CHECK(hist != nullptr);
+    if (hist == nullptr) return;
+
+    // s_FileSize - 3 digrams of zeros, saturated.
+    CHECK(hist[0] == INT_MAX);
+    CHECK(hist[0x00ff] == 1);
+    CHECK(hist[0xff00] == 1);
+
+    int64_t others = 0;
+    for (int i = 1; i < 256 * 256; i++) {
+        if (i != 0x00ff && i != 0xff00) others += hist[i];
+    }
+    CHECK(others == 0);
+    delete[] hist;
+}
+
+static void test_histo_3d(const CMappedFile &f) {
+    SparseHisto3D_t hist;
+    CHECK(generate_histo_3d(f.data(), f.size(), HistoDtype_t::U8, hist));
+    CHECK(hist.size() == 4);
+    if (hist.size() != 4) return;
+
+    CHECK(hist[0].index == 0);
+    CHECK(hist[0].count == uint64_t(s_FileSize - 5));
+    CHECK(hist[1].index == 0x0000ff && hist[1].count == 1);
+    CHECK(hist[2].index == 0x00ff00 && hist[2].count == 1);
+    CHECK(hist[3].index == 0xff0000 && hist[3].count == 1);
+}
+
+static void test_entropy(const CMappedFile &f) {
+    const int64_t bs = 256;
+
+    int64_t len = 0;
+    float *dd = generate_entropy(f.data(), f.size(), len, bs);
+    CHECK(len == s_FileSize / bs);
+    if (dd == nullptr) return;
+
+    // A window of 255 zeros and a single 0xff, the only one with any entropy.
+    double p = 1. / bs;
+    double expected = -(p * std::log2(p) + (1. - p) * std::log2(1. - p)) / 8.;
+    CHECK(std::fabs(dd[s_Marker / bs] - expected) < 1e-6);
+
+    int64_t nonzero = 0;
+    for (int64_t i = 0; i < len; i++) {
+        if (dd[i] != 0.f) nonzero++;
+    }
+    CHECK(nonzero == 1);
+    delete[] dd;
+
+    CEntropyPyramid pyramid;
+    CHECK(pyramid.build(f.data(), f.size(), bs));
+    CHECK(pyramid.size() == s_FileSize);
+
+    const int n_out = 1024;
+    vector<float> mean(n_out), mn(n_out), mx(n_out);
+    pyramid.sample(0, s_FileSize, n_out, mean.data(), mn.data(), mx.data());
+
+    int64_t marker_out = s_Marker * n_out / s_FileSize;
+    CHECK(std::fabs(mx[marker_out] - expected) < 1e-4);
+    CHECK(mean[marker_out] > 0.f && mean[marker_out] < mx[marker_out]);
+    for (int i = 0; i < n_out; i++) {
+        if (i != marker_out) CHECK(mx[i] == 0.f);
+    }
+}
+
+static void test_overview(const CMappedFile &f) {
+    const CByteClasses &classes = byte_classes_scheme();
+
+    CClassPyramid pyramid;
+    pyramid.build(f.data(), f.size(), classes);
+    CHECK(pyramid.complete());
+
+    uint64_t class_counts[CByteClasses::s_MaxClasses + 1];
+    uint64_t sum = 0;
+    pyramid.counts(0, s_FileSize, class_counts, &sum);
+    CHECK(sum == 0xff);
+    for (int k = 1; k <= classes.classCount(); k++) {
+        CHECK(class_counts[k] == (k == classes.byteClass(0xff) ? 1u : 0u));
+    }
+
+    pyramid.counts(s_Marker + 1, s_FileSize, class_counts, &sum);
+    CHECK(sum == 0);
+
+    // The overview rendered from the pyramid matches the one counting every byte.
+    for (int byte_classes = 0; byte_classes < 2; byte_classes++) {
+        vector<uint32_t> from_bytes, from_pyramid;
+        int w0, h0, w1, h1;
+        render_overview(f.data(), f.size(), 256, 1024, byte_classes, true, from_bytes, w0, h0);
+        render_overview(pyramid, 0, f.size(), 256, 1024, byte_classes, true, from_pyramid, w1, h1);
+        CHECK(w0 == 256 && h0 == 1024);
+        CHECK(w0 == w1 && h0 == h1);
+        CHECK(from_bytes == from_pyramid);
+    }
+
+    COverviewImage img;
+    img.layout(s_FileSize, 256, 1024, true, true);
+    int64_t pixel_bytes = s_FileSize / (256 * 1024) + 1;
+    CHECK(img.pixelBytes() == pixel_bytes);
+    CHECK(img.pixelCount() == (s_FileSize + pixel_bytes - 1) / pixel_bytes);
+    CHECK(img.pixelsWithin(s_Marker) == s_Marker / pixel_bytes);
+    CHECK(img.pixelOffset(img.pixelCount() - 1) < int64_t(img.width()) * img.height());
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <scratch file>\n", argv[0]);
+        return 2;
+    }
+
+    if (!create_sparse_file(argv[1])) {
+        unlink(argv[1]);
+        return s_SkipReturnCode;
+    }
+
+    CMappedFile f;
+    bool opened = f.open(argv[1]);
+    // The mapping keeps the file alive, removing it now leaves nothing behind should a check crash.
+    unlink(argv[1]);
+    CHECK(opened && f.isMapped());
+    CHECK(f.size() == s_FileSize);
+    if (!opened || f.size() != s_FileSize) {
+        return 1;
+    }
+    f.advise(CMappedFile::Access_t::SEQUENTIAL);
+
+    test_byte_index(f);
+    test_histo_2d(f);
+    test_histo_3d(f);
+    test_entropy(f);
+    test_overview(f);
+
+    if (s_Failures > 0) {
+        fprintf(stderr, "%d checks failed\n", s_Failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
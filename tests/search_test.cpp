@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2015, 2017, 2020 Kent A. Vander Velden, kent.vandervelden@gmail.com
+ *
+ * This file is part of BinVis.
+ *
+ *     BinVis is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     BinVis is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with BinVis.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Searches buffers holding long runs of matching bytes, across the chunks a search is split into, and
+// checks the hits against the positions the runs and needles were placed at, or against a plain scan
+// for every pattern at every offset.
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstring>
+
+#include "search.h"
+
+using std::string;
+using std::vector;
+
+// Spans several of the chunks the search hands out.
+static const int64_t s_BufferSize = int64_t(20) << 20;
+
+static int s_Failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char *what, int line) {
+    if (!ok) {
+        fprintf(stderr, "line %d: check failed: %s\n", line, what);
+        s_Failures++;
+    }
+}
+
+/// search_all returns the hits of patterns over dat, or an empty list if they do not compile.
+static vector<SearchHit_t> search_all(const vector<SearchPattern_t> &patterns, const vector<uint8_t> &dat) {
+    CSearch search;
+    string error;
+    if (!search.compile(patterns, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return {};
+    }
+
+    CSearchHits hits;
+    search.run(dat.data(), int64_t(dat.size()), hits);
+
+    vector<SearchHit_t> out;
+    hits.within(0, int64_t(dat.size()), out);
+    return out;
+}
+
+/// covers returns whether hits, sorted by offset, lie within [start, end) and leave none of it out.
+static bool covers(const vector<SearchHit_t> &hits, int64_t start, int64_t end) {
+    int64_t reached = start;
+    for (const auto &h : hits) {
+        if (h.offset < start || h.offset > reached || h.offset + h.length > end) return false;
+        reached = std::max(reached, h.offset + h.length);
+    }
+    return reached == end;
+}
+
+/// random_bytes returns n random bytes, none of them zero.
+static vector<uint8_t> random_bytes(int64_t n) {
+    std::mt19937 rng(1);
+    vector<uint8_t> dat(n);
+    for (auto &c : dat) {
+        c = uint8_t(1 + rng() % 255);
+    }
+    return dat;
+}
+
+/// brute_force returns the hits of the byte patterns over dat, checking each pattern at each offset, in the
+/// order searches give them.
+static vector<SearchHit_t> brute_force(const vector<SearchPattern_t> &patterns, const vector<uint8_t> &dat) {
+    vector<SearchHit_t> hits;
+    for (int64_t i = 0; i < int64_t(dat.size()); i++) {
+        for (size_t k = 0; k < patterns.size(); k++) {
+            const auto &p = patterns[k];
+            int64_t len = int64_t(p.bytes.size());
+            if (i + len > int64_t(dat.size())) continue;
+            bool match = true;
+            for (int64_t j = 0; j < len && match; j++) {
+                match = (dat[i + j] & p.mask[j]) == p.bytes[j];
+            }
+            if (match) hits.push_back({i, int32_t(len), int32_t(k)});
+        }
+    }
+    return hits;
+}
+
+/// same_hits returns whether a and b hold the same hits in the same order.
+static bool same_hits(const vector<SearchHit_t> &a, const vector<SearchHit_t> &b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].offset != b[i].offset || a[i].length != b[i].length || a[i].pattern != b[i].pattern) return false;
+    }
+    return true;
+}
+
+/// hex_pattern returns the pattern parsed from s, failing the test if it does not parse.
+static SearchPattern_t hex_pattern(const string &s) {
+    SearchPattern_t p;
+    CHECK(parse_hex_pattern(s, p));
+    return p;
+}
+
+/// letters returns n random bytes out of the first k letters, so that short patterns match often.
+static vector<uint8_t> letters(int64_t n, int k) {
+    std::mt19937 rng(2);
+    vector<uint8_t> dat(n);
+    for (auto &c : dat) {
+        c = uint8_t('a' + rng() % k);
+    }
+    return dat;
+}
+
+static void test_long_run() {
+    vector<uint8_t> dat(s_BufferSize, 'a');
+
+    for (const char *re : {"a+", ".*", "(a|b)+"}) {
+        auto hits = search_all({regex_pattern(re)}, dat);
+        CHECK(!hits.empty());
+        CHECK(covers(hits, 0, s_BufferSize));
+    }
+}
+
+static void test_zero_run() {
+    const int64_t run_start = (int64_t(5) << 20) + 3;
+    const int64_t run_end = (int64_t(13) << 20) + 7;
+
+    auto dat = random_bytes(s_BufferSize);
+    std::fill(dat.begin() + run_start, dat.begin() + run_end, 0);
+
+    auto hits = search_all({regex_pattern("\\x00+")}, dat);
+    CHECK(covers(hits, run_start, run_end));
+}
+
+static void test_needles() {
+    auto dat = random_bytes(s_BufferSize);
+
+    // The second needle straddles the end of the first chunk.
+    const vector<int64_t> offsets = {100, (int64_t(8) << 20) - 4, int64_t(15) << 20, s_BufferSize - 9};
+    for (int64_t off : offsets) {
+        memcpy(dat.data() + off, "needle123", 9);
+    }
+
+    auto hits = search_all({regex_pattern("needle[0-9]+")}, dat);
+    CHECK(hits.size() == offsets.size());
+    for (size_t i = 0; i < hits.size() && i < offsets.size(); i++) {
+        CHECK(hits[i].offset == offsets[i]);
+        CHECK(hits[i].length == 9);
+    }
+
+    // The same needles given as a string.
+    auto plain = search_all({ascii_pattern("needle123")}, dat);
+    CHECK(plain.size() == offsets.size());
+}
+
+static void test_hex_patterns() {
+    SearchPattern_t p;
+    CHECK(parse_hex_pattern("4d5a ?? 0f 4? ?1", p));
+    CHECK(p.bytes == vector<uint8_t>({0x4d, 0x5a, 0x00, 0x0f, 0x40, 0x01}));
+    CHECK(p.mask == vector<uint8_t>({0xff, 0xff, 0x00, 0xff, 0xf0, 0x0f}));
+    CHECK(p.regex.empty());
+
+    CHECK(!parse_hex_pattern("", p));
+    CHECK(!parse_hex_pattern("  ", p));
+    CHECK(!parse_hex_pattern("4d5", p));
+    CHECK(!parse_hex_pattern("4g", p));
+    CHECK(!parse_hex_pattern("0x4d", p));
+
+    // Wildcards around and within the exactly given bytes, over data where each matches often.
+    auto dat = letters(s_BufferSize, 8);
+    for (const char *s : {"61 ?? 63", "?? 62 63", "6? 62", "61 ?2 ??"}) {
+        vector<SearchPattern_t> patterns = {hex_pattern(s)};
+        CHECK(same_hits(search_all(patterns, dat), brute_force(patterns, dat)));
+    }
+}
+
+static void test_utf16_patterns() {
+    // One, two, three and four byte UTF-8 sequences, the last becoming a surrogate pair.
+    SearchPattern_t p;
+    CHECK(utf16_pattern("A\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", p));
+    CHECK(p.bytes == vector<uint8_t>({0x41, 0x00, 0xe9, 0x00, 0xac, 0x20, 0x3d, 0xd8, 0x00, 0xde}));
+    CHECK(p.mask == vector<uint8_t>(10, 0xff));
+
+    CHECK(!utf16_pattern("", p));
+    CHECK(!utf16_pattern("\x80", p));
+    CHECK(!utf16_pattern("a\xc3", p));
+    CHECK(!utf16_pattern("\xe2\x28\xa1", p));
+    CHECK(!utf16_pattern("\xff", p));
+
+    auto dat = random_bytes(s_BufferSize);
+    const vector<int64_t> offsets = {7, (int64_t(8) << 20) - 5, s_BufferSize - 10};
+    const uint8_t text[] = {'n', 0, 'a', 0, 'm', 0, 0xe9, 0, 0xac, 0x20};
+    for (int64_t off : offsets) {
+        memcpy(dat.data() + off, text, sizeof(text));
+    }
+
+    CHECK(utf16_pattern("nam\xc3\xa9\xe2\x82\xac", p));
+    auto hits = search_all({p}, dat);
+    CHECK(hits.size() == offsets.size());
+    for (size_t i = 0; i < hits.size() && i < offsets.size(); i++) {
+        CHECK(hits[i].offset == offsets[i]);
+        CHECK(hits[i].length == int32_t(sizeof(text)));
+    }
+}
+
+static void test_multiple_patterns() {
+    // Patterns that overlap, contain one another and share prefixes and suffixes, found by the automaton.
+    vector<SearchPattern_t> patterns = {ascii_pattern("abc"), ascii_pattern("bcd"), ascii_pattern("abcd"),
+                                        ascii_pattern("cd"), hex_pattern("62 ?? 64"),
+                                        hex_pattern("?? 61 61"), ascii_pattern("dcba")};
+    auto dat = letters(s_BufferSize, 6);
+    CHECK(same_hits(search_all(patterns, dat), brute_force(patterns, dat)));
+
+    // The same pattern twice, a single byte and patterns made of wildcards only, checked at every offset.
+    patterns = {ascii_pattern("ab"), ascii_pattern("ab"), ascii_pattern("c"), hex_pattern("?? ??"),
+                hex_pattern("6? 6?")};
+    dat = letters(1 << 16, 3);
+    CHECK(same_hits(search_all(patterns, dat), brute_force(patterns, dat)));
+}
+
+/// chunk_hits returns one hit of length 1 at each of the n offsets from start.
+static vector<SearchHit_t> chunk_hits(int64_t start, int64_t n) {
+    vector<SearchHit_t> hits(n);
+    for (int64_t i = 0; i < n; i++) {
+        hits[i].offset = start + i;
+        hits[i].length = 1;
+        hits[i].pattern = 0;
+    }
+    return hits;
+}
+
+/// hits_from_zero returns whether hits are exactly those at the offsets [0, n).
+static bool hits_from_zero(const vector<SearchHit_t> &hits, int64_t n) {
+    if (int64_t(hits.size()) != n) return false;
+    for (int64_t i = 0; i < n; i++) {
+        if (hits[i].offset != i) return false;
+    }
+    return true;
+}
+
+static void test_truncated() {
+    const int64_t max_hits = int64_t(CSearchHits::s_MaxHits);
+
+    // Every byte is a hit, far more than the list holds.
+    vector<uint8_t> dat(s_BufferSize, 'a');
+    auto hits = search_all({ascii_pattern("a")}, dat);
+    CHECK(hits_from_zero(hits, max_hits));
+
+    // Chunks completing out of order, the later ones filling the list first, still leave the lowest hits.
+    const int64_t chunk = max_hits / 2 + 1000;
+    CSearchHits list;
+    list.add(3 * chunk, chunk_hits(3 * chunk, chunk));
+    list.add(2 * chunk, chunk_hits(2 * chunk, chunk));
+    CHECK(list.truncated());
+    CHECK(!list.accepts(4 * chunk - 1));
+    list.add(0, chunk_hits(0, chunk));
+    CHECK(!list.accepts(3 * chunk));
+    list.add(chunk, chunk_hits(chunk, chunk));
+    CHECK(list.accepts(chunk));
+    CHECK(!list.accepts(max_hits));
+    CHECK(list.size() == CSearchHits::s_MaxHits);
+
+    vector<SearchHit_t> out;
+    list.within(0, 4 * chunk, out);
+    CHECK(hits_from_zero(out, max_hits));
+}
+
+int main() {
+    test_long_run();
+    test_zero_run();
+    test_needles();
+    test_hex_patterns();
+    test_utf16_patterns();
+    test_multiple_patterns();
+    test_truncated();
+
+    if (s_Failures > 0) {
+        fprintf(stderr, "%d checks failed\n", s_Failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}